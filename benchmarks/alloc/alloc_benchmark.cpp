@@ -0,0 +1,140 @@
+// Counts global allocations per request for the echo routes from
+// example/main.cpp over a single keep-alive connection. The client side uses
+// fixed buffers only, so every allocation counted comes from the server.
+#include "alloc_counter.h"
+#include "server.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+void AddEchoRoutes(HTTP::ServerBuilder &builder) {
+  builder.AddRequest(HTTP::POST, "/echo", [](const HTTP::RequestData &request) {
+    HTTP::ResponseData response(request.get_allocator());
+    response.status = 200;
+    response.body = request.body;
+    return response;
+  });
+  builder.AddRequest(HTTP::GET, "/echo", [](const HTTP::RequestData &request) {
+    HTTP::ResponseData response(request.get_allocator());
+    response.status = 200;
+    auto it = request.params.find("msg");
+    if (it != request.params.end()) {
+      response.body = it->second;
+    }
+    return response;
+  });
+  builder.AddRequest(HTTP::GET, "/echo/*/echo", [](const HTTP::RequestData &request) {
+    HTTP::ResponseData response(request.get_allocator());
+    response.body = request.urlVariables.at(0);
+    response.status = 200;
+    return response;
+  });
+}
+
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::perror("connect");
+  std::exit(1);
+}
+
+// Sends one request and reads exactly one response; returns false on error.
+bool RoundTrip(int fd, const char *request, std::size_t length) {
+  if (send(fd, request, length, 0) != static_cast<ssize_t>(length)) {
+    return false;
+  }
+  static char buffer[64 * 1024];
+  std::size_t received = 0;
+  while (true) {
+    ssize_t n = recv(fd, buffer + received, sizeof(buffer) - received, 0);
+    if (n <= 0) {
+      return false;
+    }
+    received += n;
+    const char *end = static_cast<const char *>(memmem(buffer, received, "\r\n\r\n", 4));
+    if (end == nullptr) {
+      continue;
+    }
+    const char *field = static_cast<const char *>(memmem(buffer, end - buffer, "Content-Length: ", 16));
+    std::size_t body = field ? std::strtoul(field + 16, nullptr, 10) : 0;
+    if (received >= static_cast<std::size_t>(end + 4 - buffer) + body) {
+      return true;
+    }
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? std::atoi(argv[1]) : 8090;
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 10000;
+  if (!HTTP::AllocationCountingEnabled()) {
+    std::fprintf(stderr, "built without CORO_HTTP_COUNT_ALLOCATIONS\n");
+    return 1;
+  }
+
+  HTTP::ServerBuilder builder;
+  builder.SetPort(port);
+  builder.SetThreads(1);
+  AddEchoRoutes(builder);
+  auto server = builder.Build();
+  server.Start();
+
+  static char body[1024];
+  std::memset(body, 'x', sizeof(body));
+  static char post[2048];
+  int postLength = std::snprintf(post, sizeof(post),
+                                 "POST /echo HTTP/1.1\r\nHost: bench\r\nContent-Length: %zu\r\n\r\n%.*s",
+                                 sizeof(body), static_cast<int>(sizeof(body)), body);
+  struct Case {
+    const char *name;
+    const char *request;
+    std::size_t length;
+  } cases[] = {
+      {"GET /echo?msg=", "GET /echo?msg=benchmark HTTP/1.1\r\nHost: bench\r\n\r\n", 0},
+      {"GET /echo/*/echo", "GET /echo/segment/echo HTTP/1.1\r\nHost: bench\r\n\r\n", 0},
+      {"POST /echo (1 KiB)", post, static_cast<std::size_t>(postLength)},
+  };
+
+  int fd = Connect(port);
+  std::printf("%-20s %12s %14s\n", "route", "requests", "allocs/request");
+  for (auto &test : cases) {
+    if (test.length == 0) {
+      test.length = std::strlen(test.request);
+    }
+    for (int i = 0; i < 1000; ++i) {
+      if (!RoundTrip(fd, test.request, test.length)) {
+        std::fprintf(stderr, "request failed: %s\n", test.name);
+        return 1;
+      }
+    }
+    std::uint64_t before = HTTP::AllocationCount();
+    for (int i = 0; i < iterations; ++i) {
+      RoundTrip(fd, test.request, test.length);
+    }
+    std::uint64_t allocations = HTTP::AllocationCount() - before;
+    std::printf("%-20s %12d %14.3f\n", test.name, iterations,
+                static_cast<double>(allocations) / iterations);
+  }
+  close(fd);
+  server.Shutdown(std::chrono::steady_clock::now());
+  return 0;
+}
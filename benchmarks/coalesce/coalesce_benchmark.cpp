@@ -0,0 +1,153 @@
+// Measures request coalescing on a hot key. A server with `workers` workers
+// has one GET route whose handler stands for an expensive backend call: it
+// sleeps for `backend-ms` and counts its calls. `clients` keep-alive clients
+// request the same URL back to back, first with RouteOptions::coalesce off,
+// then on. For each run the benchmark reports throughput, handler calls per
+// request and latency percentiles.
+//   coalesce_benchmark [port] [workers] [clients] [seconds] [backend-ms]
+#include "server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::perror("connect");
+  std::exit(1);
+}
+
+// Sends a request and reads the response, which has a Content-Length.
+bool Exchange(int fd, const std::string &request, std::string &buffer) {
+  if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+      static_cast<ssize_t>(request.size())) {
+    return false;
+  }
+  buffer.clear();
+  std::size_t end;
+  char chunk[16384];
+  while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer.append(chunk, n);
+  }
+  std::size_t at = buffer.find("Content-Length: ");
+  std::size_t length = std::strtoul(buffer.c_str() + at + 16, nullptr, 10);
+  while (buffer.size() < end + 4 + length) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer.append(chunk, n);
+  }
+  return buffer.compare(9, 3, "200") == 0;
+}
+
+double Percentile(const std::vector<double> &sorted, double fraction) {
+  return sorted[static_cast<std::size_t>(fraction * (sorted.size() - 1))];
+}
+
+void Run(bool coalesce, int port, int workers, int clients, double seconds,
+         std::chrono::milliseconds backend) {
+  std::atomic<std::uint64_t> calls{0};
+  HTTP::ServerBuilder builder;
+  builder.SetPort(port);
+  builder.SetThreads(workers);
+  builder.AddRequest(
+      HTTP::GET, "/hot",
+      [&calls, backend](const HTTP::RequestData &request) {
+        calls.fetch_add(1, std::memory_order_relaxed);
+        std::this_thread::sleep_for(backend);
+        HTTP::ResponseData response(request.get_allocator());
+        response.body.assign(2048, 'h');
+        return response;
+      },
+      {.coalesce = coalesce});
+  auto server = builder.Build();
+  server.Start();
+
+  const std::string request = "GET /hot?id=42 HTTP/1.1\r\nHost: bench\r\n\r\n";
+  std::atomic<bool> stop{false};
+  std::mutex mutex;
+  std::vector<double> latencies;
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  for (int i = 0; i < clients; ++i) {
+    threads.emplace_back([&] {
+      std::vector<double> local;
+      int fd = Connect(port);
+      std::string buffer;
+      while (!stop.load(std::memory_order_relaxed)) {
+        auto sent = Clock::now();
+        if (!Exchange(fd, request, buffer)) {
+          std::fprintf(stderr, "request failed\n");
+          std::exit(1);
+        }
+        local.push_back(std::chrono::duration<double, std::milli>(Clock::now() - sent).count());
+      }
+      close(fd);
+      std::lock_guard lock(mutex);
+      latencies.insert(latencies.end(), local.begin(), local.end());
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  server.Shutdown(Clock::now());
+  std::sort(latencies.begin(), latencies.end());
+  std::printf("%-10s %12.0f %14.3f %10.1f %10.1f %10.1f\n", coalesce ? "on" : "off",
+              latencies.size() / elapsed.count(),
+              static_cast<double>(calls.load()) / latencies.size(), Percentile(latencies, 0.5),
+              Percentile(latencies, 0.99), latencies.back());
+  std::fflush(stdout);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? std::atoi(argv[1]) : 8099;
+  int workers = argc > 2 ? std::atoi(argv[2]) : 4;
+  int clients = argc > 3 ? std::atoi(argv[3]) : 64;
+  double seconds = argc > 4 ? std::atof(argv[4]) : 5.0;
+  std::chrono::milliseconds backend(argc > 5 ? std::atoi(argv[5]) : 20);
+
+  std::printf("%d workers, %d clients, %lld ms per handler call\n", workers, clients,
+              static_cast<long long>(backend.count()));
+  std::printf("%-10s %12s %14s %10s %10s %10s\n", "coalesce", "requests/s", "calls/request",
+              "p50 ms", "p99 ms", "max ms");
+  Run(false, port, workers, clients, seconds, backend);
+  // Another port, so that no connection of the first run is left to land on
+  // the second server.
+  Run(true, port + 1, workers, clients, seconds, backend);
+  return 0;
+}
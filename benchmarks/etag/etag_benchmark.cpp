@@ -0,0 +1,173 @@
+// Measures conditional GETs against a polling client. A one-worker server
+// serves the same 256 KiB body from a static route and from a dynamic one,
+// both with RouteOptions::etag. A client polls each route, once sending the
+// ETag it got back in If-None-Match and once without it, and the benchmark
+// reports requests per second and response bytes per request. It then
+// reports HashBody throughput, the cost a dynamic route pays per request.
+#include "etag.h"
+#include "server.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::perror("connect");
+  std::exit(1);
+}
+
+std::string RandomText(std::size_t size) {
+  static constexpr char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789 ,.{}\":";
+  std::mt19937_64 random(42);
+  std::string text(size, '\0');
+  for (char &c : text) {
+    c = letters[random() % (sizeof(letters) - 1)];
+  }
+  return text;
+}
+
+// Reads one response, which has a Content-Length unless it is a 304, and
+// returns its size in bytes, or 0 on error. etag receives its ETag.
+std::size_t ReadResponse(int fd, std::string &buffer, std::string &etag) {
+  buffer.clear();
+  std::size_t end;
+  char chunk[65536];
+  while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return 0;
+    }
+    buffer.append(chunk, n);
+  }
+  std::size_t at = buffer.find("\r\nETag: ");
+  if (at != std::string::npos && at < end) {
+    at += 8;
+    etag.assign(buffer, at, buffer.find("\r\n", at) - at);
+  }
+  std::size_t size = end + 4;
+  at = buffer.find("\r\nContent-Length: ");
+  if (at != std::string::npos && at < end) {
+    size += std::strtoul(buffer.c_str() + at + 18, nullptr, 10);
+  }
+  while (buffer.size() < size) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return 0;
+    }
+    buffer.append(chunk, n);
+  }
+  return size;
+}
+
+void Poll(int port, const char *path, bool conditional, double seconds) {
+  int fd = Connect(port);
+  std::string buffer;
+  std::string etag;
+  std::size_t requests = 0;
+  std::size_t bytes = 0;
+  auto start = Clock::now();
+  auto deadline = start + std::chrono::duration<double>(seconds);
+  while (Clock::now() < deadline) {
+    std::string request = "GET ";
+    request += path;
+    request += " HTTP/1.1\r\nHost: bench\r\n";
+    if (conditional && !etag.empty()) {
+      request += "If-None-Match: " + etag + "\r\n";
+    }
+    request += "\r\n";
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+        static_cast<ssize_t>(request.size())) {
+      break;
+    }
+    std::size_t size = ReadResponse(fd, buffer, etag);
+    if (size == 0) {
+      std::printf("%s: connection failed\n", path);
+      std::exit(1);
+    }
+    bytes += size;
+    ++requests;
+  }
+  close(fd);
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  char name[48];
+  std::snprintf(name, sizeof(name), "%s%s", path, conditional ? " If-None-Match" : "");
+  std::printf("%-28s %12.0f %16.0f\n", name, requests / elapsed.count(),
+              static_cast<double>(bytes) / requests);
+  std::fflush(stdout);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? std::atoi(argv[1]) : 8096;
+  double seconds = argc > 2 ? std::atof(argv[2]) : 2.0;
+  std::size_t size = argc > 3 ? std::strtoul(argv[3], nullptr, 10) << 10 : 256 << 10;
+
+  std::string body = RandomText(size);
+  HTTP::ServerBuilder builder;
+  builder.SetThreads(1);
+  builder.SetPort(port);
+  HTTP::ResponseData page;
+  page.headers["Content-Type"] = "application/json";
+  page.body = body;
+  builder.AddStatic("/static", page, {.etag = true});
+  builder.AddRequest(
+      HTTP::GET, "/dynamic",
+      [&body](const HTTP::RequestData &request) {
+        HTTP::ResponseData response(request.get_allocator());
+        response.headers["Content-Type"] = "application/json";
+        response.body = body;
+        return response;
+      },
+      {.etag = true});
+  auto server = builder.Build();
+  server.Start();
+
+  std::printf("%-28s %12s %16s\n", "route", "requests/s", "bytes/request");
+  for (const char *path : {"/static", "/dynamic"}) {
+    for (bool conditional : {false, true}) {
+      Poll(port, path, conditional, seconds);
+    }
+  }
+  server.Shutdown(Clock::now());
+
+  std::printf("\n%-28s %12s\n", "hash", "GB/s");
+  for (std::size_t length : {std::size_t{64}, std::size_t{4096}, size}) {
+    std::string data = RandomText(length);
+    volatile std::uint64_t sink = 0;
+    std::size_t rounds = (1ull << 30) / length;
+    auto start = Clock::now();
+    for (std::size_t i = 0; i < rounds; ++i) {
+      data[0] = static_cast<char>(i);
+      sink = sink ^ HTTP::HashBody(data);
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    char name[48];
+    std::snprintf(name, sizeof(name), "HashBody %zu B", length);
+    std::printf("%-28s %12.2f\n", name, rounds * length / elapsed.count() / 1e9);
+  }
+  return 0;
+}
@@ -0,0 +1,248 @@
+// Compares file-heavy handlers that block the worker with ones that await
+// HandlerContext::files. A one-worker server appends each request's 4 KiB
+// body to a log with fdatasync, and reads a 1 MiB file per request, both
+// ways. While writer or
+// reader clients keep it busy, a ping client measures the latency of a
+// trivial route on the same worker: with blocking calls every ping waits
+// behind the file I/O in progress. Reads are also done with O_DIRECT into
+// registered buffers.
+//   fileio_benchmark [directory] [port] [seconds] [clients]
+#include "server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+constexpr std::size_t kRecordSize = 4096;
+constexpr std::size_t kFileSize = 1 << 20;
+
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::perror("connect");
+  std::exit(1);
+}
+
+// Sends a request and reads the response, which has a Content-Length.
+// Returns the body size, or -1 on error.
+long Exchange(int fd, const std::string &request, std::string &buffer) {
+  if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+      static_cast<ssize_t>(request.size())) {
+    return -1;
+  }
+  buffer.clear();
+  std::size_t end;
+  char chunk[65536];
+  while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return -1;
+    }
+    buffer.append(chunk, n);
+  }
+  if (buffer.compare(9, 3, "200") != 0) {
+    return -1;
+  }
+  std::size_t at = buffer.find("Content-Length: ");
+  std::size_t length = std::strtoul(buffer.c_str() + at + 16, nullptr, 10);
+  while (buffer.size() < end + 4 + length) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return -1;
+    }
+    buffer.append(chunk, n);
+  }
+  return static_cast<long>(length);
+}
+
+struct Result {
+  double requestsPerSecond;
+  double megabytesPerSecond;
+  double pingP50;
+  double pingP99;
+};
+
+Result Run(int port, const std::string &request, int clients, double seconds) {
+  std::atomic<bool> stop{false};
+  std::atomic<std::uint64_t> requests{0};
+  std::atomic<std::uint64_t> bytes{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; ++i) {
+    threads.emplace_back([&] {
+      int fd = Connect(port);
+      std::string buffer;
+      while (!stop.load(std::memory_order_relaxed)) {
+        long size = Exchange(fd, request, buffer);
+        if (size < 0) {
+          std::fprintf(stderr, "request failed: %s", request.c_str());
+          std::exit(1);
+        }
+        requests.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+      }
+      close(fd);
+    });
+  }
+  std::vector<double> pings;
+  int fd = Connect(port);
+  std::string buffer;
+  const std::string ping = "GET /ping HTTP/1.1\r\nHost: bench\r\n\r\n";
+  auto start = Clock::now();
+  auto deadline = start + std::chrono::duration<double>(seconds);
+  while (Clock::now() < deadline) {
+    auto sent = Clock::now();
+    if (Exchange(fd, ping, buffer) < 0) {
+      std::exit(1);
+    }
+    pings.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  stop = true;
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  close(fd);
+  std::sort(pings.begin(), pings.end());
+  return {requests / elapsed.count(), bytes / elapsed.count() / 1e6,
+          pings[pings.size() / 2], pings[pings.size() * 99 / 100]};
+}
+
+HTTP::Coroutine ReadWhole(HTTP::HandlerContext &context, const std::string &path, bool direct,
+                          HTTP::ResponseData &response) {
+  int fd = co_await context.files.Open(path.c_str(), O_RDONLY | (direct ? O_DIRECT : 0));
+  if (fd < 0) {
+    response.status = 500;
+    co_return;
+  }
+  HTTP::FileBuffer buffer = context.files.Buffer();
+  std::uint64_t offset = 0;
+  while (true) {
+    int n = co_await context.files.ReadFile(fd, buffer, buffer.Size(), offset);
+    if (n <= 0) {
+      break;
+    }
+    response.body.append(buffer.Data(), n);
+    offset += n;
+  }
+  co_await context.files.Close(fd);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::string directory = argc > 1 ? argv[1] : ".";
+  int port = argc > 2 ? std::atoi(argv[2]) : 8097;
+  double seconds = argc > 3 ? std::atof(argv[3]) : 2.0;
+  int clients = argc > 4 ? std::atoi(argv[4]) : 4;
+
+  std::string logPath = directory + "/fileio_benchmark.log";
+  std::string dataPath = directory + "/fileio_benchmark.bin";
+  {
+    std::string data(kFileSize, 'd');
+    int fd = open(dataPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || write(fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+      std::perror(dataPath.c_str());
+      return 1;
+    }
+    close(fd);
+  }
+  int logFD = open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+  if (logFD < 0) {
+    std::perror(logPath.c_str());
+    return 1;
+  }
+
+  HTTP::ServerBuilder builder;
+  builder.SetThreads(1);
+  builder.SetPort(port);
+  builder.SetFileIO({.registeredBuffers = 8, .bufferSize = 256 * 1024});
+  builder.AddRequest(HTTP::GET, "/ping", [](const HTTP::RequestData &request) {
+    HTTP::ResponseData response(request.get_allocator());
+    response.body = "pong";
+    return response;
+  });
+  builder.AddRequest(HTTP::POST, "/blocking/append", [&](const HTTP::RequestData &request) {
+    HTTP::ResponseData response(request.get_allocator());
+    if (write(logFD, request.body.data(), request.body.size()) < 0 || fdatasync(logFD) != 0) {
+      response.status = 500;
+    }
+    return response;
+  });
+  builder.AddAsync(HTTP::POST, "/async/append",
+                   [&](HTTP::HandlerContext &context, const HTTP::RequestData &request,
+                       HTTP::ResponseData &response) -> HTTP::Coroutine {
+                     if (co_await context.files.WriteFile(logFD, request.body.data(),
+                                                          request.body.size(), 0) < 0 ||
+                         co_await context.files.Fsync(logFD, true) != 0) {
+                       response.status = 500;
+                     }
+                   });
+  builder.AddRequest(HTTP::GET, "/blocking/read", [&](const HTTP::RequestData &request) {
+    HTTP::ResponseData response(request.get_allocator());
+    int fd = open(dataPath.c_str(), O_RDONLY);
+    response.body.resize(kFileSize);
+    if (fd < 0 || pread(fd, response.body.data(), kFileSize, 0) < 0) {
+      response.status = 500;
+    }
+    close(fd);
+    return response;
+  });
+  builder.AddAsync(HTTP::GET, "/async/read",
+                   [&](HTTP::HandlerContext &context, const HTTP::RequestData &,
+                       HTTP::ResponseData &response) {
+                     return ReadWhole(context, dataPath, false, response);
+                   });
+  builder.AddAsync(HTTP::GET, "/async/read-direct",
+                   [&](HTTP::HandlerContext &context, const HTTP::RequestData &,
+                       HTTP::ResponseData &response) {
+                     return ReadWhole(context, dataPath, true, response);
+                   });
+  auto server = builder.Build();
+  server.Start();
+
+  std::printf("%-24s %12s %10s %14s %14s\n", "route", "requests/s", "MB/s", "ping p50 (us)",
+              "ping p99 (us)");
+  for (const char *path : {"/blocking/append", "/async/append", "/blocking/read", "/async/read",
+                           "/async/read-direct"}) {
+    std::string request;
+    if (std::strstr(path, "append") != nullptr) {
+      request = std::string("POST ") + path + " HTTP/1.1\r\nHost: bench\r\nContent-Length: " +
+                std::to_string(kRecordSize) + "\r\n\r\n" + std::string(kRecordSize, 'r');
+    } else {
+      request = std::string("GET ") + path + " HTTP/1.1\r\nHost: bench\r\n\r\n";
+    }
+    Result result = Run(port, request, clients, seconds);
+    std::printf("%-24s %12.0f %10.0f %14.0f %14.0f\n", path, result.requestsPerSecond,
+                result.megabytesPerSecond, result.pingP50, result.pingP99);
+    std::fflush(stdout);
+  }
+  server.Shutdown(Clock::now());
+  close(logFD);
+  unlink(logPath.c_str());
+  unlink(dataPath.c_str());
+  return 0;
+}
@@ -0,0 +1,208 @@
+// Measures multipart/form-data parsing. The first table uploads bodies of
+// growing size to a one-worker server whose form route only counts the file
+// bytes, and reports upload throughput and the process's peak resident
+// memory: streaming keeps the peak flat as uploads grow. The second feeds a
+// 64 MiB file part of random bytes to MultipartParser in chunks of different
+// sizes, as socket reads would, and reports parse throughput.
+#include "form.h"
+#include "server.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+constexpr std::string_view kBoundary = "----benchmark7MA4YWxkTrZu0gW";
+
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::perror("connect");
+  std::exit(1);
+}
+
+std::string Head() {
+  std::string head = "--";
+  head += kBoundary;
+  head += "\r\nContent-Disposition: form-data; name=\"title\"\r\n\r\nbenchmark\r\n--";
+  head += kBoundary;
+  head += "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"data.bin\"\r\n"
+          "Content-Type: application/octet-stream\r\n\r\n";
+  return head;
+}
+
+std::string Tail() {
+  std::string tail = "\r\n--";
+  tail += kBoundary;
+  tail += "--\r\n";
+  return tail;
+}
+
+std::string RandomBytes(std::size_t size) {
+  std::string bytes(size, '\0');
+  std::mt19937_64 random(42);
+  for (std::size_t i = 0; i + 8 <= size; i += 8) {
+    std::uint64_t value = random();
+    std::memcpy(bytes.data() + i, &value, 8);
+  }
+  return bytes;
+}
+
+// Returns the file bytes seen, or 0 if the parse failed.
+std::size_t Parse(const std::string &body, std::size_t chunk) {
+  HTTP::MultipartParser parser(kBoundary, 8 * 1024);
+  std::size_t fileBytes = 0;
+  bool inFile = false;
+  for (std::size_t offset = 0; offset < body.size(); offset += chunk) {
+    std::string_view input(body.data() + offset, std::min(chunk, body.size() - offset));
+    while (true) {
+      auto event = parser.Next(input);
+      if (event == HTTP::MultipartParser::Event::NEED_MORE ||
+          event == HTTP::MultipartParser::Event::DONE) {
+        break;
+      }
+      if (event == HTTP::MultipartParser::Event::ERROR) {
+        return 0;
+      }
+      if (event == HTTP::MultipartParser::Event::PART_BEGIN) {
+        inFile = !parser.Filename().empty();
+      } else if (event == HTTP::MultipartParser::Event::DATA && inFile) {
+        fileBytes += parser.Data().size();
+      }
+    }
+  }
+  return fileBytes;
+}
+
+long PeakKilobytes() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Uploads a body with a fileSize-byte file part and returns the seconds it
+// took to get the response, or a negative value on error.
+double Upload(int port, const std::string &file, std::size_t fileSize) {
+  std::string head = Head();
+  std::string tail = Tail();
+  std::string request = "POST /upload HTTP/1.1\r\nHost: bench\r\nContent-Type: "
+                        "multipart/form-data; boundary=";
+  request += kBoundary;
+  request += "\r\nContent-Length: " + std::to_string(head.size() + fileSize + tail.size()) +
+             "\r\n\r\n" + head;
+  auto start = std::chrono::steady_clock::now();
+  int fd = Connect(port);
+  auto sendAll = [fd](const char *data, std::size_t size) {
+    while (size > 0) {
+      ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+      if (n <= 0) {
+        return false;
+      }
+      data += n;
+      size -= n;
+    }
+    return true;
+  };
+  bool ok = sendAll(request.data(), request.size());
+  for (std::size_t sent = 0; ok && sent < fileSize; sent += file.size()) {
+    ok = sendAll(file.data(), std::min(file.size(), fileSize - sent));
+  }
+  ok = ok && sendAll(tail.data(), tail.size());
+  char buffer[512];
+  ssize_t n = ok ? recv(fd, buffer, sizeof(buffer) - 1, 0) : -1;
+  close(fd);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  if (n <= 0) {
+    return -1;
+  }
+  buffer[n] = '\0';
+  std::string expected = "\r\n\r\n" + std::to_string(fileSize);
+  return std::strstr(buffer, expected.c_str()) != nullptr ? elapsed.count() : -1;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? std::atoi(argv[1]) : 8095;
+  std::size_t maxMegabytes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1024;
+
+  HTTP::ServerBuilder builder;
+  builder.SetThreads(1);
+  builder.SetPort(port);
+  builder.AddForm(HTTP::POST, "/upload",
+                  [](HTTP::FormReader &form, const HTTP::RequestData &,
+                     HTTP::ResponseData &response) -> HTTP::Coroutine {
+                    std::size_t bytes = 0;
+                    HTTP::FormItem item;
+                    do {
+                      co_await form.Next(item);
+                      if (item.kind == HTTP::FormItem::FILE_DATA) {
+                        bytes += item.value.size();
+                      }
+                    } while (item.kind != HTTP::FormItem::END &&
+                             item.kind != HTTP::FormItem::ERROR);
+                    response.body = std::to_string(bytes);
+                  });
+  auto server = builder.Build();
+  server.Start();
+
+  std::string file = RandomBytes(1 << 20);
+  std::printf("%-12s %12s %16s\n", "upload", "MB/s", "peak RSS (KiB)");
+  for (std::size_t megabytes = 16; megabytes <= maxMegabytes; megabytes *= 4) {
+    std::size_t size = megabytes << 20;
+    double seconds = Upload(port, file, size);
+    if (seconds < 0) {
+      std::printf("upload of %zu MiB failed\n", megabytes);
+      return 1;
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "%zu MiB", megabytes);
+    std::printf("%-12s %12.0f %16ld\n", name, size / seconds / 1e6, PeakKilobytes());
+    std::fflush(stdout);
+  }
+  server.Shutdown(std::chrono::steady_clock::now());
+
+  std::size_t fileSize = 64 << 20;
+  std::string body = Head() + RandomBytes(fileSize) + Tail();
+  std::printf("\n%-12s %12s\n", "chunk", "MB/s");
+  for (std::size_t chunk : {256ul, 4096ul, 65536ul, body.size()}) {
+    auto start = std::chrono::steady_clock::now();
+    std::size_t parsed = 0;
+    for (int round = 0; round < 4; ++round) {
+      parsed += Parse(body, chunk);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (parsed != 4 * fileSize) {
+      std::printf("parse failed at chunk %zu\n", chunk);
+      return 1;
+    }
+    char name[32];
+    if (chunk == body.size()) {
+      std::snprintf(name, sizeof(name), "whole");
+    } else {
+      std::snprintf(name, sizeof(name), "%zu", chunk);
+    }
+    std::printf("%-12s %12.0f\n", name, parsed / elapsed.count() / 1e6);
+    std::fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+#!/bin/bash
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+cd "$SCRIPT_DIR"
+
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m'
+
+if ! command -v h2load &> /dev/null; then
+    echo -e "${YELLOW}h2load is not installed.${NC}"
+    echo "Please install nghttp2:"
+    echo "  Arch: sudo pacman -S nghttp2"
+    echo "  Ubuntu/Debian: sudo apt-get install nghttp2-client"
+    echo "  macOS: brew install nghttp2"
+    exit 1
+fi
+
+REQUESTS="${REQUESTS:-1000000}"
+THREADS="${THREADS:-4}"
+STREAMS="${STREAMS:-100}"
+H2_CONNECTIONS="${H2_CONNECTIONS:-4}"
+CPP_PORT=8080
+URL="http://127.0.0.1:$CPP_PORT/echo?msg=benchmark"
+RESULTS_DIR="results"
+TIMESTAMP=$(date +%Y%m%d_%H%M%S)
+
+mkdir -p "$RESULTS_DIR"
+
+CPP_PID=""
+
+cleanup() {
+    if [ -n "${CPP_PID}" ]; then
+        kill "$CPP_PID" 2>/dev/null || true
+        wait "$CPP_PID" 2>/dev/null || true
+    fi
+}
+
+trap cleanup EXIT
+
+cpp_server="../example/echo_server"
+if [ ! -f "$cpp_server" ]; then
+    echo -e "${RED}Error: Could not find echo_server binary${NC}"
+    echo "Please build it first in example/: cmake . && make"
+    exit 1
+fi
+
+pkill -f 'echo_server' 2>/dev/null || true
+sleep 1
+(cd "$(dirname "$cpp_server")" && exec ./"$(basename "$cpp_server")") &
+CPP_PID=$!
+
+for i in {1..30}; do
+    if curl -s --connect-timeout 1 --max-time 2 "$URL" > /dev/null 2>&1; then
+        break
+    fi
+    sleep 1
+done
+
+# Both runs keep STREAMS requests in flight: HTTP/1.1 needs one keep-alive
+# connection per request, h2c multiplexes them over H2_CONNECTIONS connections.
+echo -e "${BLUE}HTTP/1.1 keep-alive: $STREAMS connections, 1 request each${NC}"
+h2load --h1 -n "$REQUESTS" -t "$THREADS" -c "$STREAMS" -m 1 "$URL" \
+    > "$RESULTS_DIR/h1_${TIMESTAMP}.txt" 2>&1
+grep -E "finished in|requests:|time for request" "$RESULTS_DIR/h1_${TIMESTAMP}.txt"
+
+STREAMS_PER_CONNECTION=$((STREAMS / H2_CONNECTIONS))
+echo -e "\n${BLUE}h2c: $H2_CONNECTIONS connections, $STREAMS_PER_CONNECTION streams each${NC}"
+h2load -n "$REQUESTS" -t "$THREADS" -c "$H2_CONNECTIONS" -m "$STREAMS_PER_CONNECTION" "$URL" \
+    > "$RESULTS_DIR/h2c_${TIMESTAMP}.txt" 2>&1
+grep -E "finished in|requests:|time for request" "$RESULTS_DIR/h2c_${TIMESTAMP}.txt"
+
+echo -e "\n${GREEN}Results saved to $RESULTS_DIR/{h1,h2c}_${TIMESTAMP}.txt${NC}"
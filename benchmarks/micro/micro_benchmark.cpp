@@ -0,0 +1,283 @@
+// Microbenchmarks for the engine's building blocks, each measured apart from
+// the rest of the server: coroutine frames, IOUring round trips over a
+// socketpair and over loopback TCP, accept, ReadIterator parsing from memory,
+// route lookup and response serialization. For every case it reports
+// nanoseconds, global allocations and system calls per operation. System
+// calls are the ring's io_uring_enter calls (IOUring::Syscalls) plus the
+// plain calls the benchmark itself makes on the peer side.
+//   micro_benchmark [filter] [seconds-per-case]
+#include "alloc_counter.h"
+#include "arena.h"
+#include "date_header.h"
+#include "read_iterator.h"
+#include "server.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Direct system calls made by the benchmark code, added to the ring's count.
+std::uint64_t peerSyscalls = 0;
+
+struct Case {
+  const char *name;
+  // Runs the operation `iterations` times.
+  std::function<void(std::size_t iterations)> run;
+  // The ring the case drives, if any.
+  const HTTP::IOUring *ring{nullptr};
+};
+
+std::uint64_t Syscalls(const Case &c) {
+  return peerSyscalls + (c.ring != nullptr ? c.ring->Syscalls() : 0);
+}
+
+// Doubles the iteration count until one batch takes a tenth of the budget,
+// then runs enough batches to fill it.
+void Measure(const Case &c, double seconds) {
+  std::size_t iterations = 1;
+  while (true) {
+    auto start = Clock::now();
+    c.run(iterations);
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    if (elapsed.count() > seconds / 10 || iterations >= (1ull << 30)) {
+      iterations = static_cast<std::size_t>(iterations * seconds / elapsed.count());
+      break;
+    }
+    iterations *= 2;
+  }
+  iterations = std::max<std::size_t>(iterations, 1);
+  std::uint64_t allocations = HTTP::AllocationCount();
+  std::uint64_t syscalls = Syscalls(c);
+  auto start = Clock::now();
+  c.run(iterations);
+  std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  allocations = HTTP::AllocationCount() - allocations;
+  syscalls = Syscalls(c) - syscalls;
+  std::printf("%-34s %12zu %12.1f %12.3f %12.3f\n", c.name, iterations,
+              elapsed.count() / iterations, static_cast<double>(allocations) / iterations,
+              static_cast<double>(syscalls) / iterations);
+  std::fflush(stdout);
+}
+
+// Resumes coro and polls the ring until it finishes.
+void Drive(HTTP::IOUring &ring, HTTP::Coroutine coro) {
+  coro.resume();
+  while (!coro.done()) {
+    ring.Poll();
+  }
+}
+
+HTTP::Coroutine Empty() { co_return; }
+
+HTTP::Coroutine Nested() { co_await Empty(); }
+
+HTTP::Coroutine ReadLoop(HTTP::IOUring &ring, int fd, int peer, std::size_t iterations) {
+  std::array<char, 256> buffer;
+  for (std::size_t i = 0; i < iterations; ++i) {
+    ++peerSyscalls;
+    if (write(peer, "x", 1) != 1) {
+      co_return;
+    }
+    co_await ring.ReadAsync(fd, buffer);
+  }
+}
+
+HTTP::Coroutine WriteLoop(HTTP::IOUring &ring, int fd, int peer, std::size_t iterations) {
+  auto data = std::make_shared<std::string>(64, 'x');
+  char buffer[64];
+  for (std::size_t i = 0; i < iterations; ++i) {
+    co_await ring.WriteAsync(fd, data, 0, data->size());
+    ++peerSyscalls;
+    if (read(peer, buffer, sizeof(buffer)) <= 0) {
+      co_return;
+    }
+  }
+}
+
+HTTP::Coroutine AcceptLoop(HTTP::IOUring &ring, int listener, const sockaddr_in &address,
+                           std::size_t iterations) {
+  for (std::size_t i = 0; i < iterations; ++i) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    connect(client, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    int fd = co_await ring.AcceptAsync(listener);
+    close(fd);
+    close(client);
+    peerSyscalls += 4;
+  }
+}
+
+HTTP::Coroutine ParseQuery(HTTP::ReadIterator &iterator, HTTP::RequestData &request,
+                           HTTP::Status &status) {
+  co_await iterator.ParseVariables(request, status);
+}
+
+HTTP::Coroutine ParseHead(HTTP::ReadIterator &iterator, HTTP::RequestData &request,
+                          HTTP::Status &status) {
+  co_await iterator.ParseHeaders(request, status, 64 * 1024);
+  co_await iterator.ParseBody(request, status, 64 * 1024);
+}
+
+// A connected TCP pair over loopback.
+void LoopbackPair(int fds[2]) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+  listen(listener, 1);
+  getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length);
+  fds[1] = socket(AF_INET, SOCK_STREAM, 0);
+  connect(fds[1], reinterpret_cast<sockaddr *>(&address), sizeof(address));
+  fds[0] = accept(listener, nullptr, nullptr);
+  int one = 1;
+  setsockopt(fds[0], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  setsockopt(fds[1], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  close(listener);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : "";
+  double seconds = argc > 2 ? std::atof(argv[2]) : 1.0;
+  if (!HTTP::AllocationCountingEnabled()) {
+    std::printf("allocation counting is off; build with CORO_HTTP_COUNT_ALLOCATIONS\n");
+  }
+
+  HTTP::IOUring ring;
+  int pair[2];
+  socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+  int tcp[2];
+  LoopbackPair(tcp);
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in listenAddress{};
+  listenAddress.sin_family = AF_INET;
+  listenAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t listenLength = sizeof(listenAddress);
+  bind(listener, reinterpret_cast<sockaddr *>(&listenAddress), sizeof(listenAddress));
+  listen(listener, 128);
+  getsockname(listener, reinterpret_cast<sockaddr *>(&listenAddress), &listenLength);
+
+  HTTP::Arena arena(16 * 1024);
+  const std::string query = "?user=42&sort=name&page=3&q=hello%20world HTTP/1.1\r\n";
+  std::string head = "Host: bench.example\r\n"
+                     "User-Agent: micro_benchmark/1.0 (X11; Linux x86_64)\r\n"
+                     "Accept: text/html,application/xhtml+xml,application/xml;q=0.9\r\n"
+                     "Accept-Encoding: gzip, deflate, br\r\n"
+                     "Accept-Language: en-US,en;q=0.5\r\n"
+                     "Cookie: session=0123456789abcdef0123456789abcdef\r\n"
+                     "Content-Type: application/octet-stream\r\n"
+                     "Content-Length: 1024\r\n"
+                     "\r\n";
+  head += std::string(1024, 'b');
+
+  HTTP::ServerBuilder builder;
+  for (int i = 0; i < 100; ++i) {
+    builder.AddRequest(HTTP::GET, "/api/v1/resource" + std::to_string(i) + "/*/profile",
+                       [](const HTTP::RequestData &request) {
+                         return HTTP::ResponseData(request.get_allocator());
+                       });
+  }
+  auto routes = builder.BuildRoutes();
+
+  HTTP::DateHeader date;
+  HTTP::ResponseData response;
+  response.headers["Content-Type"] = "application/json";
+  response.headers["Cache-Control"] = "no-store";
+  response.body = std::string(64, 'r');
+  std::string serialized;
+
+  std::vector<Case> cases = {
+      {"coroutine create/resume/destroy",
+       [](std::size_t n) {
+         for (std::size_t i = 0; i < n; ++i) {
+           HTTP::Coroutine coro = Empty();
+           coro.resume();
+         }
+       }},
+      {"coroutine nested co_await",
+       [](std::size_t n) {
+         for (std::size_t i = 0; i < n; ++i) {
+           HTTP::Coroutine coro = Nested();
+           coro.resume();
+         }
+       }},
+      {"ring read, socketpair",
+       [&](std::size_t n) { Drive(ring, ReadLoop(ring, pair[0], pair[1], n)); }, &ring},
+      {"ring write, socketpair",
+       [&](std::size_t n) { Drive(ring, WriteLoop(ring, pair[0], pair[1], n)); }, &ring},
+      {"ring read, loopback tcp",
+       [&](std::size_t n) { Drive(ring, ReadLoop(ring, tcp[0], tcp[1], n)); }, &ring},
+      {"ring write, loopback tcp",
+       [&](std::size_t n) { Drive(ring, WriteLoop(ring, tcp[0], tcp[1], n)); }, &ring},
+      {"ring accept, loopback tcp",
+       [&](std::size_t n) { Drive(ring, AcceptLoop(ring, listener, listenAddress, n)); },
+       &ring},
+      {"ReadIterator query, 4 params",
+       [&](std::size_t n) {
+         for (std::size_t i = 0; i < n; ++i) {
+           arena.Reset();
+           HTTP::RequestData request(arena.Allocator());
+           HTTP::ReadIterator iterator(query);
+           HTTP::Status status;
+           HTTP::Coroutine coro = ParseQuery(iterator, request, status);
+           coro.resume();
+         }
+       }},
+      {"ReadIterator headers+body, 1 KiB",
+       [&](std::size_t n) {
+         for (std::size_t i = 0; i < n; ++i) {
+           arena.Reset();
+           HTTP::RequestData request(arena.Allocator());
+           HTTP::ReadIterator iterator(head);
+           HTTP::Status status;
+           HTTP::Coroutine coro = ParseHead(iterator, request, status);
+           coro.resume();
+         }
+       }},
+      {"route lookup, 100 routes",
+       [&](std::size_t n) {
+         for (std::size_t i = 0; i < n; ++i) {
+           arena.Reset();
+           HTTP::RequestData request(arena.Allocator());
+           request.method = HTTP::GET;
+           HTTP::Status status;
+           HTTP::Server::FindRoute(routes->trie, request, "/api/v1/resource57/1234/profile?x=1",
+                                   status);
+         }
+       }},
+      {"response serialization",
+       [&](std::size_t n) {
+         for (std::size_t i = 0; i < n; ++i) {
+           serialized.clear();
+           HTTP::SerializeResponse(serialized, response, response.body.size(), true,
+                                   date.Block());
+         }
+       }},
+  };
+
+  std::printf("%-34s %12s %12s %12s %12s\n", "case", "iterations", "ns/op", "allocs/op",
+              "syscalls/op");
+  for (const Case &c : cases) {
+    if (std::strstr(c.name, filter) != nullptr) {
+      Measure(c, seconds);
+    }
+  }
+  close(listener);
+  close(pair[0]);
+  close(pair[1]);
+  close(tcp[0]);
+  close(tcp[1]);
+  return 0;
+}
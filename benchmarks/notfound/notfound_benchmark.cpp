@@ -0,0 +1,145 @@
+// Floods a one-worker server with requests that fail routing or parsing, the
+// traffic a scanner produces, next to a matching request for reference.
+// Closed-loop client threads each keep one connection busy for a fixed time;
+// when the server closes a connection the client opens a new one and carries
+// on, so every case reports completed responses per second.
+//   hit          keep-alive GET of an existing route
+//   404          keep-alive GET of a missing path
+//   404 close    GET of a missing path with Connection: close
+//   405          keep-alive DELETE of a GET-only route
+//   400 close    malformed request line
+#include "server.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::perror("connect");
+  std::exit(1);
+}
+
+enum class Outcome { Open, Closed, Failed };
+
+// Sends one request and reads exactly one response. Reports whether the
+// server keeps the connection open afterwards.
+Outcome RoundTrip(int fd, const char *request, std::size_t length, char *buffer,
+                  std::size_t size) {
+  if (send(fd, request, length, MSG_NOSIGNAL) != static_cast<ssize_t>(length)) {
+    return Outcome::Failed;
+  }
+  std::size_t received = 0;
+  while (true) {
+    ssize_t n = recv(fd, buffer + received, size - received, 0);
+    if (n <= 0) {
+      return Outcome::Failed;
+    }
+    received += n;
+    const char *end = static_cast<const char *>(memmem(buffer, received, "\r\n\r\n", 4));
+    if (end == nullptr) {
+      continue;
+    }
+    const char *field =
+        static_cast<const char *>(memmem(buffer, end - buffer, "Content-Length: ", 16));
+    std::size_t body = field ? std::strtoul(field + 16, nullptr, 10) : 0;
+    if (received >= static_cast<std::size_t>(end + 4 - buffer) + body) {
+      bool close = memmem(buffer, end - buffer, "Connection: close", 17) != nullptr;
+      return close ? Outcome::Closed : Outcome::Open;
+    }
+  }
+}
+
+double Run(int port, const char *request, int clients, std::chrono::seconds duration) {
+  std::atomic<bool> stop{false};
+  std::atomic<std::uint64_t> completed{0};
+  std::size_t length = std::strlen(request);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; ++i) {
+    threads.emplace_back([&] {
+      int fd = Connect(port);
+      char buffer[4096];
+      std::uint64_t done = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        Outcome outcome = RoundTrip(fd, request, length, buffer, sizeof(buffer));
+        if (outcome != Outcome::Failed) {
+          ++done;
+        }
+        if (outcome != Outcome::Open) {
+          close(fd);
+          fd = Connect(port);
+        }
+      }
+      completed.fetch_add(done);
+      close(fd);
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(duration);
+  stop.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return completed.load() / elapsed.count();
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? std::atoi(argv[1]) : 8093;
+  int clients = argc > 2 ? std::atoi(argv[2]) : 4;
+  int seconds = argc > 3 ? std::atoi(argv[3]) : 3;
+
+  HTTP::ServerBuilder builder;
+  builder.SetThreads(1);
+  builder.SetPort(port);
+  builder.AddRequest(HTTP::GET, "/api/users", [](const HTTP::RequestData &request) {
+    HTTP::ResponseData response(request.get_allocator());
+    response.body = "ok";
+    return response;
+  });
+  auto server = builder.Build();
+  server.Start();
+
+  struct Case {
+    const char *name;
+    const char *request;
+  } cases[] = {
+      {"hit", "GET /api/users HTTP/1.1\r\nHost: bench\r\n\r\n"},
+      {"404", "GET /wp-login.php HTTP/1.1\r\nHost: bench\r\n\r\n"},
+      {"404 close", "GET /.env HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n"},
+      {"405", "DELETE /api/users HTTP/1.1\r\nHost: bench\r\n\r\n"},
+      {"400 close", "GET\t/ HTTP/1.1\r\nHost: bench\r\n\r\n"},
+  };
+
+  std::printf("%-10s %8s %14s\n", "case", "clients", "responses/s");
+  for (const auto &test : cases) {
+    double rate = Run(port, test.request, clients, std::chrono::seconds(seconds));
+    std::printf("%-10s %8d %14.0f\n", test.name, clients, rate);
+    std::fflush(stdout);
+  }
+  server.Shutdown(std::chrono::steady_clock::now());
+  return 0;
+}
@@ -0,0 +1,153 @@
+// Compares the two ways to spread a server over cores: one process with a
+// worker thread per core, and SetPrefork with one single-threaded process
+// per core, each with its own SO_REUSEPORT listener. Keep-alive clients send
+// requests back to back to a route returning a 1 KiB body, and the benchmark
+// reports throughput and latency percentiles for each mode.
+//   prefork_benchmark [port] [workers] [clients] [seconds]
+#include "server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::perror("connect");
+  std::exit(1);
+}
+
+// Sends a request and reads the response, which has a Content-Length.
+bool Exchange(int fd, const std::string &request, std::string &buffer) {
+  if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+      static_cast<ssize_t>(request.size())) {
+    return false;
+  }
+  buffer.clear();
+  std::size_t end;
+  char chunk[16384];
+  while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer.append(chunk, n);
+  }
+  std::size_t at = buffer.find("Content-Length: ");
+  std::size_t length = std::strtoul(buffer.c_str() + at + 16, nullptr, 10);
+  while (buffer.size() < end + 4 + length) {
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer.append(chunk, n);
+  }
+  return buffer.compare(9, 3, "200") == 0;
+}
+
+double Percentile(const std::vector<double> &sorted, double fraction) {
+  return sorted[static_cast<std::size_t>(fraction * (sorted.size() - 1))];
+}
+
+void Run(const char *mode, int port, int clients, double seconds) {
+  const std::string request = "GET /data HTTP/1.1\r\nHost: bench\r\n\r\n";
+  std::atomic<bool> stop{false};
+  std::mutex mutex;
+  std::vector<double> latencies;
+  std::vector<std::thread> threads;
+  auto start = Clock::now();
+  for (int i = 0; i < clients; ++i) {
+    threads.emplace_back([&] {
+      std::vector<double> local;
+      int fd = Connect(port);
+      std::string buffer;
+      while (!stop.load(std::memory_order_relaxed)) {
+        auto sent = Clock::now();
+        if (!Exchange(fd, request, buffer)) {
+          std::fprintf(stderr, "request failed in %s mode\n", mode);
+          std::exit(1);
+        }
+        local.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+      }
+      close(fd);
+      std::lock_guard lock(mutex);
+      latencies.insert(latencies.end(), local.begin(), local.end());
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+  std::sort(latencies.begin(), latencies.end());
+  std::printf("%-10s %12.0f %10.1f %10.1f %10.1f %10.1f\n", mode,
+              latencies.size() / elapsed.count(), Percentile(latencies, 0.5),
+              Percentile(latencies, 0.99), Percentile(latencies, 0.999), latencies.back());
+  std::fflush(stdout);
+}
+
+HTTP::Server Build(int port, int threads, int processes) {
+  HTTP::ServerBuilder builder;
+  builder.SetPort(port);
+  builder.SetThreads(threads);
+  builder.SetPrefork({.processes = processes});
+  builder.AddRequest(HTTP::GET, "/data", [](const HTTP::RequestData &request) {
+    HTTP::ResponseData response(request.get_allocator());
+    response.body.assign(1024, 'x');
+    return response;
+  });
+  return builder.Build();
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? std::atoi(argv[1]) : 8098;
+  int workers = argc > 2 ? std::atoi(argv[2]) : 4;
+  int clients = argc > 3 ? std::atoi(argv[3]) : 64;
+  double seconds = argc > 4 ? std::atof(argv[4]) : 5.0;
+
+  std::printf("%d workers, %d clients\n", workers, clients);
+  std::printf("%-10s %12s %10s %10s %10s %10s\n", "mode", "requests/s", "p50 us", "p99 us",
+              "p99.9 us", "max us");
+  {
+    auto server = Build(port, workers, 1);
+    server.Start();
+    Run("threads", port, clients, seconds);
+    server.Shutdown(Clock::now());
+  }
+  {
+    // Another port, so that no connection of the first run is left to land
+    // on the second server.
+    auto server = Build(port + 1, 1, workers);
+    server.Start();
+    Run("processes", port + 1, clients, seconds);
+    server.Shutdown(Clock::now());
+  }
+  return 0;
+}
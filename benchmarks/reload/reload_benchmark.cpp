@@ -0,0 +1,175 @@
+// Measures what publishing route tables costs the request path. Closed-loop
+// client threads keep one keep-alive connection each busy with GET requests,
+// first with a fixed table and then while another thread publishes a fresh
+// table (100 routes) at a fixed interval. Each table answers with its own
+// generation number, so the run also counts how many distinct tables served
+// requests.
+#include "server.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::perror("connect");
+  std::exit(1);
+}
+
+// Sends one request and returns the response body, or an empty string on
+// error.
+std::string RoundTrip(int fd, const char *request, std::size_t length) {
+  if (send(fd, request, length, 0) != static_cast<ssize_t>(length)) {
+    return {};
+  }
+  char buffer[4096];
+  std::size_t received = 0;
+  while (true) {
+    ssize_t n = recv(fd, buffer + received, sizeof(buffer) - received, 0);
+    if (n <= 0) {
+      return {};
+    }
+    received += n;
+    const char *end = static_cast<const char *>(memmem(buffer, received, "\r\n\r\n", 4));
+    if (end == nullptr) {
+      continue;
+    }
+    const char *field =
+        static_cast<const char *>(memmem(buffer, end - buffer, "Content-Length: ", 16));
+    std::size_t body = field ? std::strtoul(field + 16, nullptr, 10) : 0;
+    std::size_t head = static_cast<std::size_t>(end + 4 - buffer);
+    if (received >= head + body) {
+      return std::string(buffer + head, body);
+    }
+  }
+}
+
+std::unique_ptr<HTTP::RouteTable> Table(int generation) {
+  HTTP::ServerBuilder builder;
+  std::string body = "generation " + std::to_string(generation);
+  for (int i = 0; i < 100; ++i) {
+    builder.AddRequest(HTTP::GET, "/route/" + std::to_string(i),
+                       [body](const HTTP::RequestData &request) {
+                         HTTP::ResponseData response(request.get_allocator());
+                         response.body = body;
+                         return response;
+                       });
+  }
+  return builder.BuildRoutes();
+}
+
+struct Result {
+  double rate;
+  std::size_t generations;
+  std::uint64_t failures;
+};
+
+Result Run(HTTP::Server &server, int port, int clients, std::chrono::seconds duration,
+           std::chrono::microseconds interval) {
+  static const char request[] = "GET /route/42 HTTP/1.1\r\nHost: bench\r\n\r\n";
+  std::atomic<bool> stop{false};
+  std::atomic<std::uint64_t> completed{0};
+  std::atomic<std::uint64_t> failures{0};
+  std::mutex seenMutex;
+  std::set<std::string> seen;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; ++i) {
+    threads.emplace_back([&] {
+      int fd = Connect(port);
+      std::uint64_t done = 0;
+      std::set<std::string> local;
+      while (!stop.load(std::memory_order_relaxed)) {
+        std::string body = RoundTrip(fd, request, sizeof(request) - 1);
+        if (body.rfind("generation ", 0) != 0) {
+          failures.fetch_add(1);
+          close(fd);
+          fd = Connect(port);
+          continue;
+        }
+        local.insert(std::move(body));
+        ++done;
+      }
+      completed.fetch_add(done);
+      close(fd);
+      std::lock_guard lock(seenMutex);
+      seen.insert(local.begin(), local.end());
+    });
+  }
+  std::thread publisher;
+  if (interval.count() > 0) {
+    publisher = std::thread([&] {
+      for (int generation = 1; !stop.load(); ++generation) {
+        server.PublishRoutes(Table(generation));
+        std::this_thread::sleep_for(interval);
+      }
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(duration);
+  stop.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (publisher.joinable()) {
+    publisher.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return {completed.load() / elapsed.count(), seen.size(), failures.load()};
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? std::atoi(argv[1]) : 8094;
+  int clients = argc > 2 ? std::atoi(argv[2]) : 4;
+  int seconds = argc > 3 ? std::atoi(argv[3]) : 3;
+  int threads = argc > 4 ? std::atoi(argv[4]) : 2;
+
+  HTTP::ServerBuilder builder;
+  builder.SetThreads(threads);
+  builder.SetPort(port);
+  auto server = builder.Build();
+  server.PublishRoutes(Table(0));
+  server.Start();
+
+  std::printf("%-18s %8s %14s %12s %9s\n", "publish interval", "clients", "requests/s",
+              "generations", "failures");
+  for (int micros : {0, 10000, 1000, 100}) {
+    auto result = Run(server, port, clients, std::chrono::seconds(seconds),
+                      std::chrono::microseconds(micros));
+    char name[32];
+    if (micros == 0) {
+      std::snprintf(name, sizeof(name), "never");
+    } else {
+      std::snprintf(name, sizeof(name), "%d us", micros);
+    }
+    std::printf("%-18s %8d %14.0f %12zu %9llu\n", name, clients, result.rate, result.generations,
+                static_cast<unsigned long long>(result.failures));
+    std::fflush(stdout);
+  }
+  server.Shutdown(std::chrono::steady_clock::now());
+  return 0;
+}
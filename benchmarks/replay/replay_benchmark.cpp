@@ -0,0 +1,315 @@
+// Replays a capture written by ServerBuilder::SetCapture against a running
+// server. Requests keep their connections: every captured connection is
+// replayed on its own client connection, request after request, and the
+// gaps between arrivals are kept, divided by the speed factor (0 sends each
+// request as soon as the previous response is in). Up to `connections`
+// captured connections are replayed at once; the rest wait for a free slot.
+// Latency is measured from the time a request was due, not from when it was
+// sent, so a server that falls behind is charged for the queueing it causes.
+#include "capture.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Request {
+  std::uint64_t arrival;
+  std::string bytes;
+};
+
+struct Sequence {
+  std::vector<Request> requests;
+};
+
+struct Totals {
+  std::vector<double> latencies;
+  std::uint64_t byClass[6]{};
+  std::uint64_t errors{0};
+};
+
+int Connect(const sockaddr_in &address) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+bool SendAll(int fd, std::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+// The value of a header in a lowercased head, or an empty view.
+std::string_view FieldValue(std::string_view head, std::string_view field) {
+  std::size_t at = head.find(field);
+  if (at == std::string_view::npos) {
+    return {};
+  }
+  at += field.size();
+  return head.substr(at, head.find("\r\n", at) - at);
+}
+
+// Reads one response into buffer, which may already hold bytes of it, and
+// leaves any bytes after it there. Returns the status, or 0 on error.
+// closed is set when the connection cannot be used again.
+int ReadResponse(int fd, std::string &buffer, bool head, bool &closed) {
+  auto fill = [&] {
+    char chunk[16384];
+    ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+      return false;
+    }
+    buffer.append(chunk, n);
+    return true;
+  };
+  while (true) {
+    std::size_t end;
+    while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (!fill()) {
+        closed = true;
+        return 0;
+      }
+    }
+    std::string headers(buffer, 0, end + 2);
+    for (char &c : headers) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    int status = headers.size() > 12 ? std::atoi(headers.data() + 9) : 0;
+    if (status >= 100 && status < 200) {
+      buffer.erase(0, end + 4);
+      continue;
+    }
+    closed = FieldValue(headers, "\r\nconnection:").find("close") != std::string_view::npos;
+    std::size_t start = end + 4;
+    if (head || status == 204 || status == 304) {
+      buffer.erase(0, start);
+      return status;
+    }
+    if (FieldValue(headers, "\r\ntransfer-encoding:").find("chunked") != std::string_view::npos) {
+      std::size_t position = start;
+      while (true) {
+        std::size_t line;
+        while ((line = buffer.find("\r\n", position)) == std::string::npos) {
+          if (!fill()) {
+            closed = true;
+            return 0;
+          }
+        }
+        std::size_t size = std::strtoul(buffer.c_str() + position, nullptr, 16);
+        position = line + 2 + size + 2;
+        while (buffer.size() < position) {
+          if (!fill()) {
+            closed = true;
+            return 0;
+          }
+        }
+        if (size == 0) {
+          break;
+        }
+      }
+      buffer.erase(0, position);
+      return status;
+    }
+    std::string_view length = FieldValue(headers, "\r\ncontent-length:");
+    if (length.empty()) {
+      // The body runs to the end of the connection.
+      while (fill()) {
+      }
+      buffer.clear();
+      closed = true;
+      return status;
+    }
+    std::size_t size = std::strtoul(std::string(length).c_str(), nullptr, 10);
+    while (buffer.size() < start + size) {
+      if (!fill()) {
+        closed = true;
+        return 0;
+      }
+    }
+    buffer.erase(0, start + size);
+    return status;
+  }
+}
+
+void Replay(const Sequence &sequence, const sockaddr_in &address, Clock::time_point start,
+            std::uint64_t firstArrival, double speed, Totals &totals) {
+  int fd = -1;
+  std::string buffer;
+  for (const Request &request : sequence.requests) {
+    Clock::time_point due = Clock::now();
+    if (speed > 0) {
+      due = start + std::chrono::nanoseconds(
+                        static_cast<std::int64_t>((request.arrival - firstArrival) / speed));
+      std::this_thread::sleep_until(due);
+    }
+    if (fd < 0) {
+      fd = Connect(address);
+      buffer.clear();
+      if (fd < 0) {
+        totals.errors++;
+        continue;
+      }
+    }
+    bool closed = false;
+    int status = 0;
+    if (SendAll(fd, request.bytes)) {
+      status = ReadResponse(fd, buffer, request.bytes.starts_with("HEAD "), closed);
+    } else {
+      closed = true;
+    }
+    if (status == 0) {
+      totals.errors++;
+    } else {
+      std::chrono::duration<double, std::micro> latency = Clock::now() - due;
+      totals.latencies.push_back(latency.count());
+      totals.byClass[std::min(status / 100, 5)]++;
+    }
+    if (closed) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+double Percentile(const std::vector<double> &sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  std::size_t index = static_cast<std::size_t>(fraction * (sorted.size() - 1));
+  return sorted[index];
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::fprintf(stderr, "usage: %s capture-file [port] [speed] [connections]\n", argv[0]);
+    return 2;
+  }
+  int port = argc > 2 ? std::atoi(argv[2]) : 8080;
+  double speed = argc > 3 ? std::atof(argv[3]) : 1.0;
+  int connections = argc > 4 ? std::atoi(argv[4]) : 64;
+
+  std::FILE *file = std::fopen(argv[1], "rb");
+  if (file == nullptr) {
+    std::perror("fopen");
+    return 1;
+  }
+  std::map<std::uint64_t, Sequence> byConnection;
+  HTTP::CaptureHeader header;
+  std::string bytes;
+  std::size_t records = 0;
+  std::size_t truncated = 0;
+  while (HTTP::ReadCapture(file, header, bytes)) {
+    ++records;
+    if (header.flags & HTTP::CAPTURE_TRUNCATED) {
+      ++truncated;
+      continue;
+    }
+    // The final newline of the blank line can miss the capture when it
+    // arrived in a later read than the rest of the headers.
+    if (bytes.ends_with("\r\n\r") && bytes.find("\r\n\r\n") == std::string::npos) {
+      bytes.push_back('\n');
+    }
+    byConnection[header.connection].requests.push_back({header.arrival, bytes});
+  }
+  std::fclose(file);
+
+  std::vector<const Sequence *> sequences;
+  std::uint64_t firstArrival = UINT64_MAX;
+  std::uint64_t lastArrival = 0;
+  std::size_t requests = 0;
+  for (auto &[id, sequence] : byConnection) {
+    std::stable_sort(sequence.requests.begin(), sequence.requests.end(),
+                     [](const Request &a, const Request &b) { return a.arrival < b.arrival; });
+    firstArrival = std::min(firstArrival, sequence.requests.front().arrival);
+    lastArrival = std::max(lastArrival, sequence.requests.back().arrival);
+    requests += sequence.requests.size();
+    sequences.push_back(&sequence);
+  }
+  if (sequences.empty()) {
+    std::fprintf(stderr, "no replayable records in %s\n", argv[1]);
+    return 1;
+  }
+  std::sort(sequences.begin(), sequences.end(), [](const Sequence *a, const Sequence *b) {
+    return a->requests.front().arrival < b->requests.front().arrival;
+  });
+  double span = (lastArrival - firstArrival) / 1e9;
+  std::printf("%zu records, %zu truncated and skipped, %zu connections, %.1f s captured\n",
+              records, truncated, sequences.size(), span);
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  std::atomic<std::size_t> next{0};
+  std::mutex totalsMutex;
+  Totals totals;
+  Clock::time_point start = Clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < connections; ++i) {
+    threads.emplace_back([&] {
+      Totals local;
+      for (std::size_t index = next++; index < sequences.size(); index = next++) {
+        Replay(*sequences[index], address, start, firstArrival, speed, local);
+      }
+      std::lock_guard lock(totalsMutex);
+      totals.latencies.insert(totals.latencies.end(), local.latencies.begin(),
+                              local.latencies.end());
+      for (int c = 0; c < 6; ++c) {
+        totals.byClass[c] += local.byClass[c];
+      }
+      totals.errors += local.errors;
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = Clock::now() - start;
+
+  std::sort(totals.latencies.begin(), totals.latencies.end());
+  std::printf("%zu requests in %.2f s: %.0f requests/s (captured %.0f/s)\n", requests,
+              elapsed.count(), totals.latencies.size() / elapsed.count(),
+              span > 0 ? requests / span : 0.0);
+  std::printf("2xx %llu  3xx %llu  4xx %llu  5xx %llu  errors %llu\n",
+              static_cast<unsigned long long>(totals.byClass[2]),
+              static_cast<unsigned long long>(totals.byClass[3]),
+              static_cast<unsigned long long>(totals.byClass[4]),
+              static_cast<unsigned long long>(totals.byClass[5]),
+              static_cast<unsigned long long>(totals.errors));
+  std::printf("%-10s %12s\n", "latency", "us");
+  for (auto [name, fraction] : {std::pair{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99},
+                                {"p99.9", 0.999}, {"max", 1.0}}) {
+    std::printf("%-10s %12.1f\n", name, Percentile(totals.latencies, fraction));
+  }
+  return 0;
+}
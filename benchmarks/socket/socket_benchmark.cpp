@@ -0,0 +1,204 @@
+// Measures request latency under each SocketProfile option. For every
+// profile a one-worker server is started and three sequential workloads are
+// timed from a single client:
+//   small    keep-alive GET with a short body
+//   static   keep-alive GET of a 24 KiB static body, written in two parts,
+//            which is where Nagle and delayed ACKs interact
+//   connect  a new connection per request (DEFER_ACCEPT, FASTOPEN)
+#include "server.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+sockaddr_in Loopback(int port) {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  return address;
+}
+
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  sockaddr_in address = Loopback(port);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Reads exactly one response; returns false on error.
+bool ReadResponse(int fd) {
+  static char buffer[64 * 1024];
+  std::size_t received = 0;
+  while (true) {
+    ssize_t n = recv(fd, buffer + received, sizeof(buffer) - received, 0);
+    if (n <= 0) {
+      return false;
+    }
+    received += n;
+    const char *end = static_cast<const char *>(memmem(buffer, received, "\r\n\r\n", 4));
+    if (end == nullptr) {
+      continue;
+    }
+    const char *field =
+        static_cast<const char *>(memmem(buffer, end - buffer, "Content-Length: ", 16));
+    std::size_t body = field ? std::strtoul(field + 16, nullptr, 10) : 0;
+    std::size_t total = static_cast<std::size_t>(end + 4 - buffer) + body;
+    if (received >= total) {
+      return true;
+    }
+    if (received == sizeof(buffer)) {
+      received = 0;
+    }
+  }
+}
+
+struct Percentiles {
+  double p50;
+  double p99;
+};
+
+Percentiles Summarize(std::vector<double> &samples) {
+  if (samples.empty()) {
+    return {0, 0};
+  }
+  std::sort(samples.begin(), samples.end());
+  return {samples[samples.size() / 2], samples[samples.size() * 99 / 100]};
+}
+
+Percentiles KeepAlive(int port, const char *request, int iterations) {
+  int fd = Connect(port);
+  std::vector<double> samples;
+  std::size_t length = std::strlen(request);
+  for (int i = 0; i < iterations + iterations / 10 && fd >= 0; ++i) {
+    auto start = Clock::now();
+    if (send(fd, request, length, 0) != static_cast<ssize_t>(length) || !ReadResponse(fd)) {
+      break;
+    }
+    std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+    if (i >= iterations / 10) {
+      samples.push_back(elapsed.count());
+    }
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  return Summarize(samples);
+}
+
+Percentiles PerConnection(int port, const char *request, int iterations, bool fastOpen) {
+  std::vector<double> samples;
+  std::size_t length = std::strlen(request);
+  sockaddr_in address = Loopback(port);
+  for (int i = 0; i < iterations; ++i) {
+    auto start = Clock::now();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    bool ok;
+    if (fastOpen) {
+      ok = sendto(fd, request, length, MSG_FASTOPEN, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) == static_cast<ssize_t>(length);
+    } else {
+      ok = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0 &&
+           send(fd, request, length, 0) == static_cast<ssize_t>(length);
+    }
+    ok = ok && ReadResponse(fd);
+    close(fd);
+    if (!ok) {
+      break;
+    }
+    std::chrono::duration<double, std::micro> elapsed = Clock::now() - start;
+    samples.push_back(elapsed.count());
+  }
+  return Summarize(samples);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? std::atoi(argv[1]) : 8092;
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 500;
+
+  struct Case {
+    const char *name;
+    HTTP::SocketProfile profile;
+  };
+  std::vector<Case> cases;
+  cases.push_back({"Nagle (noDelay off)", {.noDelay = false}});
+  cases.push_back({"defaults (NODELAY)", {}});
+  cases.push_back({"TCP_DEFER_ACCEPT 1s", {.deferAccept = std::chrono::seconds(1)}});
+  cases.push_back({"TCP_FASTOPEN 256", {.fastOpenQueue = 256}});
+  cases.push_back({"SO_BUSY_POLL 50us", {.busyPoll = std::chrono::microseconds(50)}});
+  cases.push_back({"4 KiB socket buffers", {.sendBuffer = 4096, .receiveBuffer = 4096}});
+  cases.push_back({"1 MiB socket buffers", {.sendBuffer = 1 << 20, .receiveBuffer = 1 << 20}});
+
+  static const char small[] = "GET /small HTTP/1.1\r\nHost: bench\r\n\r\n";
+  static const char large[] = "GET /static HTTP/1.1\r\nHost: bench\r\n\r\n";
+  static const char once[] = "GET /small HTTP/1.1\r\nHost: bench\r\nConnection: close\r\n\r\n";
+
+  std::printf("%-24s %20s %20s %20s\n", "profile (p50/p99 us)", "small", "static 24 KiB",
+              "connect");
+  for (std::size_t i = 0; i < cases.size(); ++i) {
+    HTTP::ServerBuilder builder;
+    builder.SetThreads(1);
+    builder.SetPort(port + static_cast<int>(i));
+    builder.SetSocketProfile(cases[i].profile);
+    builder.AddRequest(HTTP::GET, "/small", [](const HTTP::RequestData &request) {
+      HTTP::ResponseData response(request.get_allocator());
+      response.body = "ok";
+      return response;
+    });
+    HTTP::ResponseData page;
+    page.body.assign(24 * 1024, 'x');
+    builder.AddStatic("/static", std::move(page));
+    auto server = builder.Build();
+    try {
+      server.Start();
+    } catch (const std::exception &error) {
+      std::printf("%-24s skipped: %s\n", cases[i].name, error.what());
+      continue;
+    }
+    int probe = -1;
+    for (int attempt = 0; attempt < 100 && probe < 0; ++attempt) {
+      probe = Connect(port + static_cast<int>(i));
+      if (probe < 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    }
+    close(probe);
+
+    int current = port + static_cast<int>(i);
+    auto smallLatency = KeepAlive(current, small, iterations);
+    auto largeLatency = KeepAlive(current, large, iterations);
+    auto connectLatency = PerConnection(current, once, iterations / 4,
+                                        cases[i].profile.fastOpenQueue > 0);
+    char columns[3][32];
+    std::snprintf(columns[0], sizeof(columns[0]), "%.1f / %.1f", smallLatency.p50,
+                  smallLatency.p99);
+    std::snprintf(columns[1], sizeof(columns[1]), "%.1f / %.1f", largeLatency.p50,
+                  largeLatency.p99);
+    std::snprintf(columns[2], sizeof(columns[2]), "%.1f / %.1f", connectLatency.p50,
+                  connectLatency.p99);
+    std::printf("%-24s %20s %20s %20s\n", cases[i].name, columns[0], columns[1], columns[2]);
+    std::fflush(stdout);
+    server.Shutdown(Clock::now());
+  }
+  return 0;
+}
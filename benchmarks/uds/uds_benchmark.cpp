@@ -0,0 +1,133 @@
+// Compares request throughput over loopback TCP and a UNIX domain socket.
+// One server listens on both; closed-loop client threads each keep one
+// connection busy with small GET requests for a fixed time per transport.
+#include "server.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+int Connect(bool unixSocket, int port, const std::string &path) {
+  int fd = socket(unixSocket ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+  sockaddr_storage storage{};
+  socklen_t length;
+  if (unixSocket) {
+    auto *address = reinterpret_cast<sockaddr_un *>(&storage);
+    address->sun_family = AF_UNIX;
+    std::strncpy(address->sun_path, path.c_str(), sizeof(address->sun_path) - 1);
+    length = sizeof(sockaddr_un);
+  } else {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    auto *address = reinterpret_cast<sockaddr_in *>(&storage);
+    address->sin_family = AF_INET;
+    address->sin_port = htons(port);
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    length = sizeof(sockaddr_in);
+  }
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<sockaddr *>(&storage), length) == 0) {
+      return fd;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::perror("connect");
+  std::exit(1);
+}
+
+// Sends one request and reads exactly one response; returns false on error.
+bool RoundTrip(int fd, const char *request, std::size_t length, char *buffer, std::size_t size) {
+  if (send(fd, request, length, 0) != static_cast<ssize_t>(length)) {
+    return false;
+  }
+  std::size_t received = 0;
+  while (true) {
+    ssize_t n = recv(fd, buffer + received, size - received, 0);
+    if (n <= 0) {
+      return false;
+    }
+    received += n;
+    const char *end = static_cast<const char *>(memmem(buffer, received, "\r\n\r\n", 4));
+    if (end == nullptr) {
+      continue;
+    }
+    const char *field =
+        static_cast<const char *>(memmem(buffer, end - buffer, "Content-Length: ", 16));
+    std::size_t body = field ? std::strtoul(field + 16, nullptr, 10) : 0;
+    if (received >= static_cast<std::size_t>(end + 4 - buffer) + body) {
+      return true;
+    }
+  }
+}
+
+double Run(bool unixSocket, int port, const std::string &path, int clients,
+           std::chrono::seconds duration) {
+  static const char request[] = "GET /echo?msg=benchmark HTTP/1.1\r\nHost: bench\r\n\r\n";
+  std::atomic<bool> stop{false};
+  std::atomic<std::uint64_t> completed{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < clients; ++i) {
+    threads.emplace_back([&] {
+      int fd = Connect(unixSocket, port, path);
+      char buffer[4096];
+      std::uint64_t done = 0;
+      while (!stop.load(std::memory_order_relaxed) &&
+             RoundTrip(fd, request, sizeof(request) - 1, buffer, sizeof(buffer))) {
+        ++done;
+      }
+      completed.fetch_add(done);
+      close(fd);
+    });
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::this_thread::sleep_for(duration);
+  stop.store(true);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  return completed.load() / elapsed.count();
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? std::atoi(argv[1]) : 8091;
+  int clients = argc > 2 ? std::atoi(argv[2]) : 4;
+  int seconds = argc > 3 ? std::atoi(argv[3]) : 5;
+  int threads = argc > 4 ? std::atoi(argv[4]) : 1;
+  std::string path = "/tmp/coro_http_uds_benchmark.sock";
+
+  HTTP::ServerBuilder builder;
+  builder.SetThreads(threads);
+  builder.AddListener(HTTP::Listener::Tcp("127.0.0.1", port));
+  builder.AddListener(HTTP::Listener::Unix(path));
+  builder.AddRequest(HTTP::GET, "/echo", [](const HTTP::RequestData &request) {
+    HTTP::ResponseData response(request.get_allocator());
+    auto it = request.params.find("msg");
+    if (it != request.params.end()) {
+      response.body = it->second;
+    }
+    return response;
+  });
+  auto server = builder.Build();
+  server.Start();
+
+  std::printf("%-10s %8s %14s\n", "transport", "clients", "requests/s");
+  for (bool unixSocket : {false, true}) {
+    double rate = Run(unixSocket, port, path, clients, std::chrono::seconds(seconds));
+    std::printf("%-10s %8d %14.0f\n", unixSocket ? "unix" : "tcp", clients, rate);
+  }
+  server.Shutdown(std::chrono::steady_clock::now());
+  return 0;
+}
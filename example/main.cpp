@@ -6,14 +6,14 @@ int main() {
   builder.SetPort(8080);
   builder.SetThreads(22);
   builder.AddRequest(HTTP::POST, "/echo", [](const HTTP::RequestData &request) {
-    HTTP::ResponseData response;
+    HTTP::ResponseData response(request.get_allocator());
     response.status = 200;
     response.body = request.body;
     return response;
   });
 
   builder.AddRequest(HTTP::GET, "/echo", [](const HTTP::RequestData &request) {
-    HTTP::ResponseData response;
+    HTTP::ResponseData response(request.get_allocator());
     response.status = 200;
     auto it = request.params.find("msg");
     if (it != request.params.end()) {
@@ -23,7 +23,7 @@ int main() {
   });
   builder.AddRequest(HTTP::GET, "/echo/*/echo",
                      [](const HTTP::RequestData &request) {
-                       HTTP::ResponseData response;
+                       HTTP::ResponseData response(request.get_allocator());
                        response.body = request.urlVariables.at(0);
                        response.status = 200;
                        return response;
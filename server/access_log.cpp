@@ -0,0 +1,127 @@
+#include "access_log.h"
+#include <algorithm>
+#include <cmath>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+namespace HTTP {
+
+std::atomic<unsigned> AccessLog::reopenGeneration_{0};
+
+AccessLog::~AccessLog() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+int AccessLog::OpenFile(const std::string &path) {
+  return open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+
+void AccessLog::RequestReopen() { reopenGeneration_.fetch_add(1, std::memory_order_relaxed); }
+
+void AccessLog::Open(IOUring &ring, const AccessLogOptions &options,
+                     std::atomic<std::uint64_t> &dropped) {
+  ring_ = &ring;
+  options_ = options;
+  dropped_ = &dropped;
+  period_ = options.sampleRate > 0
+                ? static_cast<std::uint32_t>(std::lround(1.0 / std::min(options.sampleRate, 1.0)))
+                : 0;
+  countdown_ = period_;
+  active_ = std::make_shared<std::string>();
+  flushing_ = std::make_shared<std::string>();
+  active_->reserve(options.bufferSize);
+  flushing_->reserve(options.bufferSize);
+  generation_ = reopenGeneration_.load(std::memory_order_relaxed);
+  fd_ = OpenFile(options.path);
+  if (fd_ < 0) {
+    std::cerr << "[AccessLog] Could not open " << options.path << std::endl;
+  }
+}
+
+void AccessLog::Append(std::string_view record, Clock::time_point now) {
+  if (active_->size() + record.size() > options_.bufferSize) {
+    dropped_->fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (active_->empty()) {
+    oldest_ = now;
+  }
+  active_->append(record);
+  activeRecords_++;
+}
+
+// A rotated file is reopened only between batches, so a batch is never split
+// across the old and the new file.
+void AccessLog::Reopen() {
+  generation_ = reopenGeneration_.load(std::memory_order_relaxed);
+  int fd = OpenFile(options_.path);
+  if (fd < 0) {
+    std::cerr << "[AccessLog] Could not reopen " << options_.path << std::endl;
+    return;
+  }
+  close(fd_);
+  fd_ = fd;
+}
+
+void AccessLog::Flush(Clock::time_point now) {
+  if (writing_) {
+    return;
+  }
+  if (generation_ != reopenGeneration_.load(std::memory_order_relaxed)) {
+    Reopen();
+  }
+  if (active_->empty() ||
+      (active_->size() < options_.bufferSize / 2 && now - oldest_ < options_.flushInterval)) {
+    return;
+  }
+  std::swap(active_, flushing_);
+  flushingRecords_ = activeRecords_;
+  activeRecords_ = 0;
+  writing_ = true;
+  writer_ = Write();
+  writer_.resume();
+}
+
+Coroutine AccessLog::Write() {
+  auto batch = flushing_;
+  size_t sent = 0;
+  while (sent < batch->size()) {
+    size_t wrote = co_await ring_->WriteAsync(fd_, batch, sent, batch->size() - sent);
+    if (wrote == 0) {
+      dropped_->fetch_add(flushingRecords_, std::memory_order_relaxed);
+      break;
+    }
+    sent += wrote;
+  }
+  batch->clear();
+  writing_ = false;
+  co_return;
+}
+
+// Called once the worker has drained; whatever is still buffered is written
+// synchronously since the event loop is no longer running.
+void AccessLog::Close() {
+  if (fd_ < 0) {
+    return;
+  }
+  auto deadline = Clock::now() + std::chrono::seconds(1);
+  while (writing_ && Clock::now() < deadline) {
+    ring_->Poll();
+  }
+  if (writing_) {
+    return;
+  }
+  std::string_view rest = *active_;
+  while (!rest.empty()) {
+    ssize_t wrote = write(fd_, rest.data(), rest.size());
+    if (wrote <= 0) {
+      break;
+    }
+    rest.remove_prefix(wrote);
+  }
+  active_->clear();
+}
+} // namespace HTTP
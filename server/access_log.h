@@ -0,0 +1,65 @@
+#pragma once
+#include "coroutine.h"
+#include "io_uring.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+namespace HTTP {
+struct AccessLogOptions {
+  std::string path;
+  double sampleRate{1.0};
+  std::size_t bufferSize{256 * 1024};
+  std::chrono::milliseconds flushInterval{200};
+};
+
+// Per-worker access log. Records are appended to a buffer owned by the worker
+// thread and written in batches through the worker's ring while the next
+// batch fills. Each worker holds its own O_APPEND descriptor, so batches from
+// different workers never interleave mid-record. When both buffers are busy
+// records are dropped and counted rather than stalling the event loop.
+class AccessLog {
+  using Clock = std::chrono::steady_clock;
+  IOUring *ring_{nullptr};
+  AccessLogOptions options_;
+  std::atomic<std::uint64_t> *dropped_{nullptr};
+  int fd_{-1};
+  unsigned generation_{0};
+  std::uint32_t period_{0};
+  std::uint32_t countdown_{0};
+  std::shared_ptr<std::string> active_;
+  std::shared_ptr<std::string> flushing_;
+  std::size_t activeRecords_{0};
+  std::size_t flushingRecords_{0};
+  Clock::time_point oldest_{};
+  bool writing_{false};
+  Coroutine writer_;
+  static std::atomic<unsigned> reopenGeneration_;
+
+  Coroutine Write();
+  void Reopen();
+
+public:
+  AccessLog() = default;
+  AccessLog(const AccessLog &) = delete;
+  AccessLog &operator=(const AccessLog &) = delete;
+  ~AccessLog();
+  static int OpenFile(const std::string &path);
+  // Async-signal-safe; every worker reopens its file before its next batch.
+  static void RequestReopen();
+  void Open(IOUring &ring, const AccessLogOptions &options, std::atomic<std::uint64_t> &dropped);
+  bool Enabled() const { return fd_ >= 0; }
+  bool Sample() {
+    if (period_ == 0 || --countdown_ != 0) {
+      return false;
+    }
+    countdown_ = period_;
+    return true;
+  }
+  void Append(std::string_view record, Clock::time_point now);
+  void Flush(Clock::time_point now);
+  void Close();
+};
+} // namespace HTTP
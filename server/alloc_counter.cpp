@@ -0,0 +1,52 @@
+#include "alloc_counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace HTTP {
+
+namespace {
+std::atomic<std::uint64_t> allocations{0};
+} // namespace
+
+std::uint64_t AllocationCount() { return allocations.load(std::memory_order_relaxed); }
+
+bool AllocationCountingEnabled() {
+#ifdef HTTP_COUNT_ALLOCATIONS
+  return true;
+#else
+  return false;
+#endif
+}
+} // namespace HTTP
+
+#ifdef HTTP_COUNT_ALLOCATIONS
+// The array, nothrow and sized forms of the default library forward to these.
+// The aligned form is what std::pmr::new_delete_resource() uses.
+void *operator new(std::size_t size) {
+  HTTP::allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  HTTP::allocations.fetch_add(1, std::memory_order_relaxed);
+  auto align = static_cast<std::size_t>(alignment);
+  if (void *memory = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+
+void operator delete(void *memory, std::align_val_t) noexcept { std::free(memory); }
+
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept {
+  std::free(memory);
+}
+#endif
@@ -0,0 +1,8 @@
+#pragma once
+#include <cstdint>
+namespace HTTP {
+// Number of global operator new calls since startup. Only counts when the
+// library is built with CORO_HTTP_COUNT_ALLOCATIONS; otherwise always zero.
+std::uint64_t AllocationCount();
+bool AllocationCountingEnabled();
+} // namespace HTTP
@@ -0,0 +1,29 @@
+#include "arena.h"
+
+namespace HTTP {
+
+Arena::Arena(std::size_t size) : size_(size) {}
+
+void *Arena::do_allocate(std::size_t bytes, std::size_t alignment) {
+  if (!resource_ && size_ == 0) {
+    resource_.emplace();
+  } else if (!resource_) {
+    buffer_.reset(new std::byte[size_]);
+    resource_.emplace(buffer_.get(), size_);
+  }
+  return resource_->allocate(bytes, alignment);
+}
+
+std::pmr::polymorphic_allocator<> Arena::Allocator() { return this; }
+
+void Arena::Reset() {
+  if (resource_) {
+    resource_->release();
+  }
+}
+
+void Arena::Release() {
+  resource_.reset();
+  buffer_.reset();
+}
+} // namespace HTTP
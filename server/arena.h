@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+namespace HTTP {
+// Bump allocator owned by a single connection. The initial buffer is allocated
+// on the first allocation, so idle connections hold none, and is handed out
+// again after every Reset(), so requests that fit in it never reach the global
+// allocator; larger ones spill to the default resource until the next Reset().
+class Arena : public std::pmr::memory_resource {
+  std::size_t size_;
+  std::unique_ptr<std::byte[]> buffer_;
+  std::optional<std::pmr::monotonic_buffer_resource> resource_;
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void *, std::size_t, std::size_t) override {}
+  bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+public:
+  explicit Arena(std::size_t size);
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  std::pmr::polymorphic_allocator<> Allocator();
+  void Reset();
+  // Frees the buffer, for a connection that stops making requests. Nothing
+  // allocated from the arena may be used afterwards.
+  void Release();
+};
+} // namespace HTTP
@@ -0,0 +1,26 @@
+#include "capture.h"
+namespace HTTP {
+void AppendCapture(std::string &out, const CaptureHeader &header, std::string_view bytes) {
+  CaptureHeader copy = header;
+  copy.length = static_cast<std::uint32_t>(bytes.size());
+  out.append(reinterpret_cast<const char *>(&copy), sizeof(copy));
+  out.append(bytes);
+}
+
+bool ReadCapture(std::FILE *file, CaptureHeader &header, std::string &bytes) {
+  if (std::fread(&header, sizeof(header), 1, file) != 1) {
+    return false;
+  }
+  bytes.resize(header.length);
+  return header.length == 0 || std::fread(bytes.data(), header.length, 1, file) == 1;
+}
+
+AccessLogOptions CaptureLogOptions(const CaptureOptions &options) {
+  AccessLogOptions log;
+  log.path = options.path;
+  log.sampleRate = options.sampleRate;
+  log.bufferSize = options.bufferSize;
+  log.flushInterval = options.flushInterval;
+  return log;
+}
+} // namespace HTTP
@@ -0,0 +1,39 @@
+#pragma once
+#include "access_log.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+namespace HTTP {
+struct CaptureOptions {
+  std::string path;
+  // Fraction of connections whose requests are all recorded, so keep-alive
+  // sequences replay as they arrived.
+  double sampleRate{0.01};
+  // Longer requests are cut short and flagged CAPTURE_TRUNCATED.
+  std::size_t maxRequestBytes{64 * 1024};
+  std::size_t bufferSize{1024 * 1024};
+  std::chrono::milliseconds flushInterval{200};
+};
+
+// A capture file is a sequence of records, each this header in host byte
+// order followed by `length` raw request bytes: request line, headers and
+// body exactly as read from the socket. Workers append whole records to the
+// same file, so records of different connections interleave.
+struct CaptureHeader {
+  // When the request's first byte was read, in nanoseconds since the epoch.
+  std::uint64_t arrival{0};
+  // The same for every request read from one connection.
+  std::uint64_t connection{0};
+  std::uint32_t length{0};
+  std::uint32_t flags{0};
+};
+constexpr std::uint32_t CAPTURE_TRUNCATED = 1;
+
+void AppendCapture(std::string &out, const CaptureHeader &header, std::string_view bytes);
+// Reads the next record; false at the end of the file or on a short record.
+bool ReadCapture(std::FILE *file, CaptureHeader &header, std::string &bytes);
+// The batched writer the access log uses, configured for capture records.
+AccessLogOptions CaptureLogOptions(const CaptureOptions &options);
+} // namespace HTTP
@@ -0,0 +1,199 @@
+#include "coalesce.h"
+#include <algorithm>
+#include <functional>
+namespace HTTP {
+namespace {
+// Slot keys: 0 is free, 1 is being claimed, anything else is a flight.
+constexpr std::uint64_t kFree = 0;
+constexpr std::uint64_t kClaiming = 1;
+
+enum WaiterState { WAITING, WAKING, WOKEN, ABANDONED };
+} // namespace
+
+// A suspended follower. The leader wakes it on its own ring, so a follower on
+// another worker that shut down meanwhile must not be posted to: the state
+// tells the two sides apart, and self keeps the waiter alive until the leader
+// has taken it off the list.
+struct Coalescer::Waiter {
+  std::coroutine_handle<> coro;
+  IOUring *ring{nullptr};
+  Waiter *next{nullptr};
+  std::atomic<int> state{WAITING};
+  std::shared_ptr<Waiter> self;
+};
+
+// refs counts followers between finding the slot and reading its result; a
+// slot is only claimed again once it is free and refs is zero, so text and
+// result are written by one leader while no follower reads them.
+struct Coalescer::Slot {
+  std::atomic<std::uint64_t> key{kFree};
+  std::atomic<std::uint32_t> refs{0};
+  std::atomic<Waiter *> waiters{nullptr};
+  std::string text;
+  std::shared_ptr<const SharedResponse> result;
+};
+
+Coalescer::Waiter *Coalescer::Closed() {
+  static Waiter sentinel;
+  return &sentinel;
+}
+
+std::vector<std::shared_ptr<Coalescer::Waiter>> &Coalescer::Suspended() {
+  static thread_local std::vector<std::shared_ptr<Waiter>> suspended;
+  return suspended;
+}
+
+void Coalescer::Forget(const Waiter *waiter) {
+  auto &suspended = Suspended();
+  auto found = std::find_if(suspended.begin(), suspended.end(),
+                            [waiter](const auto &entry) { return entry.get() == waiter; });
+  if (found != suspended.end()) {
+    *found = std::move(suspended.back());
+    suspended.pop_back();
+  }
+}
+
+void Coalescer::Abandon() {
+  for (const auto &waiter : Suspended()) {
+    int expected = WAITING;
+    if (!waiter->state.compare_exchange_strong(expected, ABANDONED)) {
+      // A leader is posting to this ring; it still exists until Post returns.
+      while (waiter->state.load(std::memory_order_acquire) == WAKING) {
+      }
+      waiter->coro = nullptr;
+    }
+  }
+  Suspended().clear();
+}
+
+Coalescer::Coalescer() : slots_(std::make_unique<Slot[]>(kSlots)) {}
+
+Coalescer::~Coalescer() = default;
+
+void Coalescer::Land(Slot &slot, std::shared_ptr<const SharedResponse> response) {
+  slot.result = std::move(response);
+  Waiter *waiter = slot.waiters.exchange(Closed(), std::memory_order_acq_rel);
+  slot.key.store(kFree);
+  IOUring *current = IOUring::Current();
+  while (waiter != nullptr) {
+    std::shared_ptr<Waiter> owned = std::move(waiter->self);
+    waiter = waiter->next;
+    int expected = WAITING;
+    if (!owned->state.compare_exchange_strong(expected, WAKING)) {
+      continue;
+    }
+    if (owned->ring == current) {
+      owned->state.store(WOKEN, std::memory_order_release);
+      owned->coro.resume();
+      continue;
+    }
+    owned->ring->Post([owned] {
+      if (owned->coro) {
+        owned->coro.resume();
+      }
+    });
+    owned->state.store(WOKEN, std::memory_order_release);
+  }
+}
+
+Coalescer::Flight::~Flight() {
+  if (leading_ != nullptr) {
+    Land(*leading_, nullptr);
+  }
+}
+
+void Coalescer::Flight::Publish(std::shared_ptr<const SharedResponse> response) {
+  shared_ = response;
+  Land(*leading_, std::move(response));
+  leading_ = nullptr;
+}
+
+Coalescer::JoinAwaiter::~JoinAwaiter() {
+  if (joined_ == nullptr) {
+    return;
+  }
+  // Destroyed while suspended: keep the leader from waking this coroutine.
+  Forget(waiter_.get());
+  int expected = WAITING;
+  if (!waiter_->state.compare_exchange_strong(expected, ABANDONED)) {
+    while (waiter_->state.load(std::memory_order_acquire) == WAKING) {
+    }
+    // The wake-up posted to this ring has not run yet.
+    waiter_->coro = nullptr;
+  }
+  joined_->refs.fetch_sub(1, std::memory_order_release);
+}
+
+bool Coalescer::JoinAwaiter::await_ready() {
+  std::uint64_t hash = std::hash<std::string_view>{}(key_);
+  if (hash <= kClaiming) {
+    hash += 2;
+  }
+  Slot *slots = coalescer_.slots_.get();
+  for (std::size_t i = 0; i < kProbes; ++i) {
+    Slot &slot = slots[(hash + i) % kSlots];
+    if (slot.key.load(std::memory_order_acquire) != hash) {
+      continue;
+    }
+    // Checked again after counting in, as the flight may have landed and a
+    // new leader be claiming the slot.
+    slot.refs.fetch_add(1);
+    if (slot.key.load() == hash && slot.text == key_) {
+      joined_ = &slot;
+      return false;
+    }
+    slot.refs.fetch_sub(1, std::memory_order_release);
+    return true;
+  }
+  for (std::size_t i = 0; i < kProbes; ++i) {
+    Slot &slot = slots[(hash + i) % kSlots];
+    std::uint64_t expected = kFree;
+    if (!slot.key.compare_exchange_strong(expected, kClaiming)) {
+      continue;
+    }
+    if (slot.refs.load() != 0) {
+      slot.key.store(kFree);
+      continue;
+    }
+    slot.text.assign(key_);
+    slot.result.reset();
+    slot.waiters.store(nullptr, std::memory_order_relaxed);
+    slot.key.store(hash);
+    flight_.leading_ = &slot;
+    return true;
+  }
+  return true;
+}
+
+bool Coalescer::JoinAwaiter::await_suspend(std::coroutine_handle<> coro) {
+  waiter_ = std::make_shared<Waiter>();
+  waiter_->coro = coro;
+  waiter_->ring = &ring_;
+  waiter_->self = waiter_;
+  Suspended().push_back(waiter_);
+  Waiter *head = joined_->waiters.load(std::memory_order_acquire);
+  do {
+    if (head == Closed()) {
+      Forget(waiter_.get());
+      waiter_->self.reset();
+      waiter_->state.store(WOKEN, std::memory_order_relaxed);
+      return false;
+    }
+    waiter_->next = head;
+  } while (!joined_->waiters.compare_exchange_weak(head, waiter_.get(), std::memory_order_release,
+                                                   std::memory_order_acquire));
+  return true;
+}
+
+void Coalescer::JoinAwaiter::await_resume() {
+  if (joined_ == nullptr) {
+    return;
+  }
+  if (waiter_) {
+    Forget(waiter_.get());
+  }
+  flight_.shared_ = joined_->result;
+  joined_->refs.fetch_sub(1, std::memory_order_release);
+  joined_ = nullptr;
+}
+} // namespace HTTP
@@ -0,0 +1,98 @@
+#pragma once
+#include "io_uring.h"
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+namespace HTTP {
+// A response serialized once for every request that shares it, with either
+// Connection header. Bodies over 16 KiB are kept apart and go out in a
+// second write, as in Server::WriteResponse.
+struct SharedResponse {
+  std::shared_ptr<std::string> keepAlive;
+  std::shared_ptr<std::string> close;
+  std::shared_ptr<std::string> body;
+  int status{200};
+  std::size_t bodySize{0};
+};
+
+// Lets identical concurrent requests to a route share one run of its
+// handler. The first request for a key leads a flight; requests for the same
+// key that arrive before it lands, on any worker, suspend until the leader
+// publishes its response. Flights live in a fixed open-addressed table whose
+// slots are claimed and joined with atomics alone. A request that finds no
+// free slot, or another key with its hash, runs the handler on its own.
+class Coalescer {
+  struct Waiter;
+  struct Slot;
+  static constexpr std::size_t kSlots = 1024;
+  static constexpr std::size_t kProbes = 8;
+  std::unique_ptr<Slot[]> slots_;
+
+  // Marks a flight that has landed; late followers take its result at once.
+  static Waiter *Closed();
+  // The followers suspended on the calling thread, for Abandon.
+  static std::vector<std::shared_ptr<Waiter>> &Suspended();
+  static void Forget(const Waiter *waiter);
+  static void Land(Slot &slot, std::shared_ptr<const SharedResponse> response);
+
+public:
+  // One request's part in a flight.
+  class Flight {
+    friend class Coalescer;
+    Slot *leading_{nullptr};
+    std::shared_ptr<const SharedResponse> shared_;
+
+  public:
+    Flight() = default;
+    Flight(const Flight &) = delete;
+    Flight &operator=(const Flight &) = delete;
+    // A leader that never publishes, e.g. because its connection was
+    // cancelled, releases its followers to run the handler themselves.
+    ~Flight();
+    bool Leading() const { return leading_ != nullptr; }
+    // Set for a follower once the leader landed, and for the leader once it
+    // published; null for a request that runs its handler alone.
+    const SharedResponse *Shared() const { return shared_.get(); }
+    void Publish(std::shared_ptr<const SharedResponse> response);
+  };
+
+  class JoinAwaiter {
+    friend class Coalescer;
+    Coalescer &coalescer_;
+    IOUring &ring_;
+    std::string_view key_;
+    Flight &flight_;
+    Slot *joined_{nullptr};
+    std::shared_ptr<Waiter> waiter_;
+
+    JoinAwaiter(Coalescer &coalescer, IOUring &ring, std::string_view key, Flight &flight)
+        : coalescer_(coalescer), ring_(ring), key_(key), flight_(flight) {}
+
+  public:
+    JoinAwaiter(const JoinAwaiter &) = delete;
+    JoinAwaiter &operator=(const JoinAwaiter &) = delete;
+    ~JoinAwaiter();
+    bool await_ready();
+    bool await_suspend(std::coroutine_handle<> coro);
+    void await_resume();
+  };
+
+  Coalescer();
+  ~Coalescer();
+  // Keeps leaders on other workers from waking the followers suspended on the
+  // calling thread, whose ring is about to be destroyed. Suspended frames are
+  // never destroyed, so their JoinAwaiters cannot do it. Each worker calls
+  // this once it has drained.
+  static void Abandon();
+  // Leads a flight for key, joins the one in progress and waits for its
+  // response, or leaves flight empty. key only needs to live until then.
+  JoinAwaiter Join(IOUring &ring, std::string_view key, Flight &flight) {
+    return JoinAwaiter(*this, ring, key, flight);
+  }
+};
+} // namespace HTTP
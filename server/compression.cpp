@@ -0,0 +1,262 @@
+#include "compression.h"
+#include <cctype>
+#include <charconv>
+#include <optional>
+#include <stdexcept>
+#include <zlib.h>
+#ifdef HTTP_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace HTTP {
+
+namespace {
+constexpr std::size_t kChunk = 16 * 1024;
+
+static std::string_view trim(std::string_view s) {
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+static bool iequals(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) != b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool accepted(std::string_view parameters) {
+  auto q = parameters.find("q=");
+  if (q == std::string_view::npos) {
+    return true;
+  }
+  auto value = trim(parameters.substr(q + 2));
+  return !(value.starts_with("0") && value.find_first_not_of("0.") == std::string_view::npos);
+}
+} // namespace
+
+Encoding NegotiateEncoding(std::string_view acceptEncoding,
+                           const CompressionOptions &options) {
+  bool allowed[ENCODING_COUNT] = {};
+  bool named[ENCODING_COUNT] = {};
+  std::optional<bool> wildcard;
+  while (!acceptEncoding.empty()) {
+    auto comma = acceptEncoding.find(',');
+    auto item = trim(acceptEncoding.substr(0, comma));
+    acceptEncoding =
+        comma == std::string_view::npos ? std::string_view{} : acceptEncoding.substr(comma + 1);
+    auto semicolon = item.find(';');
+    auto name = trim(item.substr(0, semicolon));
+    bool ok = semicolon == std::string_view::npos || accepted(item.substr(semicolon + 1));
+    Encoding encoding = IDENTITY;
+    if (iequals(name, "gzip")) {
+      encoding = GZIP;
+    } else if (iequals(name, "deflate")) {
+      encoding = DEFLATE;
+    } else if (iequals(name, "zstd")) {
+      encoding = ZSTD;
+    } else if (name == "*") {
+      wildcard = ok;
+    }
+    if (encoding != IDENTITY) {
+      allowed[encoding] = ok;
+      named[encoding] = true;
+    }
+  }
+  // "*" stands only for the codings the header does not name (RFC 9110
+  // section 12.5.3), so "gzip;q=0, *" still refuses gzip.
+  if (wildcard) {
+    for (int encoding = IDENTITY + 1; encoding < ENCODING_COUNT; ++encoding) {
+      if (!named[encoding]) {
+        allowed[encoding] = *wildcard;
+      }
+    }
+  }
+#ifdef HTTP_WITH_ZSTD
+  if (options.zstd && allowed[ZSTD]) {
+    return ZSTD;
+  }
+#else
+  (void)options;
+#endif
+  if (allowed[GZIP]) {
+    return GZIP;
+  }
+  if (allowed[DEFLATE]) {
+    return DEFLATE;
+  }
+  return IDENTITY;
+}
+
+std::string_view EncodingName(Encoding encoding) {
+  switch (encoding) {
+  case DEFLATE:
+    return "deflate";
+  case GZIP:
+    return "gzip";
+  case ZSTD:
+    return "zstd";
+  default:
+    return "identity";
+  }
+}
+
+bool EncodingSupported(Encoding encoding) {
+#ifdef HTTP_WITH_ZSTD
+  return encoding < ENCODING_COUNT;
+#else
+  return encoding < ZSTD;
+#endif
+}
+
+struct Compressor::State {
+  z_stream zlib{};
+#ifdef HTTP_WITH_ZSTD
+  ZSTD_CCtx *zstd{nullptr};
+#endif
+};
+
+Compressor::Compressor(Encoding encoding, int level)
+    : state_(std::make_unique<State>()), encoding_(encoding) {
+  if (encoding_ == DEFLATE || encoding_ == GZIP) {
+    int windowBits = encoding_ == GZIP ? 15 + 16 : 15;
+    if (deflateInit2(&state_->zlib, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) !=
+        Z_OK) {
+      throw std::runtime_error("Could not initialize zlib");
+    }
+    return;
+  }
+#ifdef HTTP_WITH_ZSTD
+  if (encoding_ == ZSTD) {
+    state_->zstd = ZSTD_createCCtx();
+    if (state_->zstd == nullptr) {
+      throw std::runtime_error("Could not initialize zstd");
+    }
+    ZSTD_CCtx_setParameter(state_->zstd, ZSTD_c_compressionLevel, level);
+    return;
+  }
+#endif
+  throw std::runtime_error("Unsupported content encoding");
+}
+
+Compressor::~Compressor() {
+  if (!state_) {
+    return;
+  }
+  if (encoding_ == DEFLATE || encoding_ == GZIP) {
+    deflateEnd(&state_->zlib);
+  }
+#ifdef HTTP_WITH_ZSTD
+  if (state_->zstd != nullptr) {
+    ZSTD_freeCCtx(state_->zstd);
+  }
+#endif
+}
+
+Compressor::Compressor(Compressor &&rhs) noexcept
+    : state_(std::move(rhs.state_)), encoding_(rhs.encoding_) {}
+
+Compressor &Compressor::operator=(Compressor &&rhs) noexcept {
+  if (this != &rhs) {
+    Compressor old(std::move(*this));
+    state_ = std::move(rhs.state_);
+    encoding_ = rhs.encoding_;
+  }
+  return *this;
+}
+
+namespace {
+static void deflateStep(z_stream &stream, std::string_view input, int flush,
+                        std::string &output) {
+  stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+  do {
+    size_t offset = output.size();
+    output.resize(offset + kChunk);
+    stream.next_out = reinterpret_cast<Bytef *>(output.data() + offset);
+    stream.avail_out = kChunk;
+    int result = deflate(&stream, flush);
+    output.resize(offset + kChunk - stream.avail_out);
+    if (result == Z_STREAM_ERROR) {
+      throw std::runtime_error("Compression failed");
+    }
+    if (result == Z_STREAM_END) {
+      break;
+    }
+  } while (stream.avail_in > 0 || stream.avail_out == 0 ||
+           (flush == Z_FINISH));
+}
+
+#ifdef HTTP_WITH_ZSTD
+static void zstdStep(ZSTD_CCtx *context, std::string_view input, ZSTD_EndDirective mode,
+                     std::string &output) {
+  ZSTD_inBuffer in{input.data(), input.size(), 0};
+  while (true) {
+    size_t offset = output.size();
+    output.resize(offset + kChunk);
+    ZSTD_outBuffer out{output.data() + offset, kChunk, 0};
+    size_t remaining = ZSTD_compressStream2(context, &out, &in, mode);
+    output.resize(offset + out.pos);
+    if (ZSTD_isError(remaining)) {
+      throw std::runtime_error("Compression failed");
+    }
+    if (mode == ZSTD_e_continue ? in.pos == in.size : remaining == 0) {
+      break;
+    }
+  }
+}
+#endif
+} // namespace
+
+void Compressor::Update(std::string_view input, std::string &output) {
+#ifdef HTTP_WITH_ZSTD
+  if (encoding_ == ZSTD) {
+    zstdStep(state_->zstd, input, ZSTD_e_continue, output);
+    return;
+  }
+#endif
+  deflateStep(state_->zlib, input, Z_NO_FLUSH, output);
+}
+
+void Compressor::Flush(std::string &output) {
+#ifdef HTTP_WITH_ZSTD
+  if (encoding_ == ZSTD) {
+    zstdStep(state_->zstd, {}, ZSTD_e_flush, output);
+    return;
+  }
+#endif
+  deflateStep(state_->zlib, {}, Z_SYNC_FLUSH, output);
+}
+
+void Compressor::Finish(std::string &output) {
+#ifdef HTTP_WITH_ZSTD
+  if (encoding_ == ZSTD) {
+    zstdStep(state_->zstd, {}, ZSTD_e_end, output);
+    return;
+  }
+#endif
+  deflateStep(state_->zlib, {}, Z_FINISH, output);
+}
+
+std::string Compress(Encoding encoding, int level, std::string_view input) {
+  Compressor compressor(encoding, level);
+  std::string output;
+  output.reserve(input.size() / 2 + 64);
+  for (size_t offset = 0; offset < input.size(); offset += 4 * kChunk) {
+    compressor.Update(input.substr(offset, 4 * kChunk), output);
+  }
+  compressor.Finish(output);
+  return output;
+}
+
+} // namespace HTTP
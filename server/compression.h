@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+namespace HTTP {
+enum Encoding { IDENTITY, DEFLATE, GZIP, ZSTD, ENCODING_COUNT };
+struct CompressionOptions {
+  std::size_t minSize{1024};
+  int level{6};
+  std::size_t offloadSize{256 * 1024};
+  bool zstd{true};
+};
+Encoding NegotiateEncoding(std::string_view acceptEncoding, const CompressionOptions &options);
+std::string_view EncodingName(Encoding encoding);
+bool EncodingSupported(Encoding encoding);
+class Compressor {
+  struct State;
+  std::unique_ptr<State> state_;
+  Encoding encoding_;
+
+public:
+  Compressor(Encoding encoding, int level);
+  ~Compressor();
+  Compressor(Compressor &&rhs) noexcept;
+  Compressor &operator=(Compressor &&rhs) noexcept;
+  void Update(std::string_view input, std::string &output);
+  void Flush(std::string &output);
+  void Finish(std::string &output);
+};
+std::string Compress(Encoding encoding, int level, std::string_view input);
+} // namespace HTTP
@@ -1,5 +1,7 @@
 #pragma once
+#include "frame_pool.h"
 #include <coroutine>
+#include <cstddef>
 #include <exception>
 namespace HTTP {
 struct Promise;
@@ -13,6 +15,9 @@ struct Promise {
   size_t writeResult_{0};
   static thread_local std::coroutine_handle<Promise> *currentCoro_;
 
+  static void *operator new(std::size_t size) { return AllocateFrame(size); }
+  static void operator delete(void *frame, std::size_t size) noexcept { FreeFrame(frame, size); }
+
   Coroutine get_return_object();
   std::suspend_always initial_suspend() noexcept { return {}; }
   struct FinalAwaiter {
@@ -0,0 +1,40 @@
+#include "date_header.h"
+#include <cstdio>
+
+namespace HTTP {
+
+namespace {
+constexpr const char *kDays[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+constexpr const char *kMonths[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                   "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+} // namespace
+
+DateHeader::DateHeader() { Refresh(); }
+
+// Formats the IMF-fixdate by hand so the result does not depend on the locale.
+void DateHeader::Refresh() {
+  std::time_t now = std::time(nullptr);
+  if (now == second_) {
+    return;
+  }
+  second_ = now;
+  std::tm utc{};
+  gmtime_r(&now, &utc);
+  char buffer[32];
+  int length = std::snprintf(buffer, sizeof(buffer), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                             kDays[utc.tm_wday], utc.tm_mday, kMonths[utc.tm_mon],
+                             utc.tm_year + 1900, utc.tm_hour, utc.tm_min, utc.tm_sec);
+  date_.assign(buffer, length);
+  block_.assign("Date: ");
+  block_ += date_;
+  block_ += "\r\nServer: ";
+  block_ += ServerName();
+  block_ += "\r\n";
+}
+
+const std::string &DateHeader::Block() const { return block_; }
+
+std::string_view DateHeader::Date() const { return date_; }
+
+std::string_view DateHeader::ServerName() { return "coro_http_server"; }
+} // namespace HTTP
@@ -0,0 +1,18 @@
+#pragma once
+#include <ctime>
+#include <string>
+#include <string_view>
+namespace HTTP {
+class DateHeader {
+  std::string block_;
+  std::string date_;
+  std::time_t second_{-1};
+
+public:
+  DateHeader();
+  void Refresh();
+  const std::string &Block() const;
+  std::string_view Date() const;
+  static std::string_view ServerName();
+};
+} // namespace HTTP
@@ -0,0 +1,125 @@
+#include "etag.h"
+#include <cstring>
+namespace HTTP {
+namespace {
+constexpr std::uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+constexpr std::uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr std::uint64_t kPrime3 = 0x165667B19E3779F9ull;
+constexpr std::uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+constexpr std::uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+std::uint64_t rotl(std::uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+std::uint64_t read64(const char *p) {
+  std::uint64_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+std::uint32_t read32(const char *p) {
+  std::uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+std::uint64_t round(std::uint64_t accumulator, std::uint64_t input) {
+  accumulator += input * kPrime2;
+  return rotl(accumulator, 31) * kPrime1;
+}
+
+std::uint64_t merge(std::uint64_t accumulator, std::uint64_t lane) {
+  accumulator ^= round(0, lane);
+  return accumulator * kPrime1 + kPrime4;
+}
+} // namespace
+
+std::uint64_t HashBody(std::string_view data) {
+  const char *p = data.data();
+  const char *end = p + data.size();
+  std::uint64_t hash;
+  if (data.size() >= 32) {
+    std::uint64_t v1 = kPrime1 + kPrime2;
+    std::uint64_t v2 = kPrime2;
+    std::uint64_t v3 = 0;
+    std::uint64_t v4 = 0 - kPrime1;
+    for (; p + 32 <= end; p += 32) {
+      v1 = round(v1, read64(p));
+      v2 = round(v2, read64(p + 8));
+      v3 = round(v3, read64(p + 16));
+      v4 = round(v4, read64(p + 24));
+    }
+    hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    hash = merge(hash, v1);
+    hash = merge(hash, v2);
+    hash = merge(hash, v3);
+    hash = merge(hash, v4);
+  } else {
+    hash = kPrime5;
+  }
+  hash += data.size();
+  for (; p + 8 <= end; p += 8) {
+    hash ^= round(0, read64(p));
+    hash = rotl(hash, 27) * kPrime1 + kPrime4;
+  }
+  if (p + 4 <= end) {
+    hash ^= static_cast<std::uint64_t>(read32(p)) * kPrime1;
+    hash = rotl(hash, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    hash ^= static_cast<std::uint8_t>(*p) * kPrime5;
+    hash = rotl(hash, 11) * kPrime1;
+  }
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  hash *= kPrime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+ETag MakeETag(std::uint64_t hash) {
+  static constexpr char digits[] = "0123456789abcdef";
+  ETag tag;
+  tag.front() = '"';
+  tag.back() = '"';
+  for (int i = 16; i >= 1; --i) {
+    tag[i] = digits[hash & 0xf];
+    hash >>= 4;
+  }
+  return tag;
+}
+
+bool ETagMatches(std::string_view ifNoneMatch, std::string_view tag) {
+  while (!ifNoneMatch.empty()) {
+    std::size_t comma = ifNoneMatch.find(',');
+    std::string_view candidate = ifNoneMatch.substr(0, comma);
+    ifNoneMatch = comma == std::string_view::npos ? std::string_view{}
+                                                  : ifNoneMatch.substr(comma + 1);
+    while (!candidate.empty() && (candidate.front() == ' ' || candidate.front() == '\t')) {
+      candidate.remove_prefix(1);
+    }
+    while (!candidate.empty() && (candidate.back() == ' ' || candidate.back() == '\t')) {
+      candidate.remove_suffix(1);
+    }
+    if (candidate == "*") {
+      return true;
+    }
+    if (candidate.starts_with("W/")) {
+      candidate.remove_prefix(2);
+    }
+    if (candidate == tag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void MakeNotModified(ResponseData &response) {
+  response.status = 304;
+  response.body.clear();
+  for (const char *name : {"Content-Type", "Content-Encoding", "Content-Length"}) {
+    response.headers.erase(std::pmr::string(name, response.get_allocator()));
+  }
+}
+} // namespace HTTP
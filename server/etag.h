@@ -0,0 +1,20 @@
+#pragma once
+#include "request_data.h"
+#include <array>
+#include <cstdint>
+#include <string_view>
+namespace HTTP {
+// 64-bit XXH64 hash of a body. Four independent lanes consume 32 bytes per
+// round, so the loop is limited by multiply throughput rather than latency.
+std::uint64_t HashBody(std::string_view data);
+// A strong entity tag for the hash: 16 hex digits in quotes.
+using ETag = std::array<char, 18>;
+ETag MakeETag(std::uint64_t hash);
+inline std::string_view View(const ETag &tag) { return {tag.data(), tag.size()}; }
+// Whether an If-None-Match value is "*" or lists tag. The comparison is
+// weak, as RFC 9110 requires for If-None-Match: a W/ prefix is ignored.
+bool ETagMatches(std::string_view ifNoneMatch, std::string_view tag);
+// Turns a response into the body-less 304 for it, keeping headers such as
+// ETag, Vary and Cache-Control and dropping those that describe the body.
+void MakeNotModified(ResponseData &response);
+} // namespace HTTP
@@ -0,0 +1,85 @@
+#include "file_io.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+namespace HTTP {
+namespace {
+constexpr std::size_t kAlignment = 4096;
+
+char *AllocateAligned(std::size_t size) {
+  size = (size + kAlignment - 1) / kAlignment * kAlignment;
+  void *data = std::aligned_alloc(kAlignment, size);
+  if (data == nullptr) {
+    throw std::bad_alloc();
+  }
+  return static_cast<char *>(data);
+}
+} // namespace
+
+FileBuffer::FileBuffer(FileBuffer &&rhs) noexcept
+    : owner_(rhs.owner_), data_(rhs.data_), size_(rhs.size_), slot_(rhs.slot_),
+      index_(rhs.index_) {
+  rhs.owner_ = nullptr;
+  rhs.data_ = nullptr;
+  rhs.size_ = 0;
+  rhs.slot_ = -1;
+  rhs.index_ = -1;
+}
+
+FileBuffer &FileBuffer::operator=(FileBuffer &&rhs) noexcept {
+  if (this != &rhs) {
+    this->~FileBuffer();
+    new (this) FileBuffer(std::move(rhs));
+  }
+  return *this;
+}
+
+FileBuffer::~FileBuffer() {
+  if (owner_ != nullptr) {
+    owner_->Release(*this);
+  } else {
+    std::free(data_);
+  }
+}
+
+FileIO::~FileIO() {
+  if (registered_) {
+    ring_.UnregisterBuffers();
+  }
+  for (char *data : pool_) {
+    std::free(data);
+  }
+}
+
+bool FileIO::Configure(const FileIOOptions &options) {
+  bufferSize_ = options.bufferSize;
+  std::vector<iovec> iovecs;
+  for (std::size_t i = 0; i < options.registeredBuffers; ++i) {
+    pool_.push_back(AllocateAligned(bufferSize_));
+    iovecs.push_back({pool_.back(), bufferSize_});
+    free_.push_back(static_cast<int>(i));
+  }
+  if (!iovecs.empty()) {
+    registered_ = ring_.RegisterBuffers(iovecs);
+  }
+  return iovecs.empty() || registered_;
+}
+
+FileBuffer FileIO::Buffer(std::size_t size) {
+  FileBuffer buffer;
+  if (!free_.empty() && size <= bufferSize_) {
+    buffer.owner_ = this;
+    buffer.slot_ = free_.back();
+    free_.pop_back();
+    buffer.data_ = pool_[buffer.slot_];
+    buffer.size_ = bufferSize_;
+    buffer.index_ = registered_ ? buffer.slot_ : -1;
+    return buffer;
+  }
+  buffer.size_ = std::max(size, bufferSize_ != 0 ? bufferSize_ : kAlignment);
+  buffer.data_ = AllocateAligned(buffer.size_);
+  return buffer;
+}
+
+void FileIO::Release(FileBuffer &buffer) { free_.push_back(buffer.slot_); }
+} // namespace HTTP
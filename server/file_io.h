@@ -0,0 +1,107 @@
+#pragma once
+#include "io_uring.h"
+#include <cstdint>
+#include <fcntl.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+namespace HTTP {
+struct FileIOOptions {
+  // Buffers registered with each worker's ring, read and written with
+  // READ_FIXED/WRITE_FIXED. 0 leaves every buffer unregistered.
+  std::size_t registeredBuffers{0};
+  std::size_t bufferSize{1 << 20};
+};
+
+class FileIO;
+
+// A page-aligned buffer, so it suits O_DIRECT. Buffers from the registered
+// pool go back to it when destroyed; the others are freed.
+class FileBuffer {
+  FileIO *owner_{nullptr};
+  char *data_{nullptr};
+  std::size_t size_{0};
+  // The slot in the owner's pool, and the registered index (the same slot,
+  // or -1 when the pool is not registered).
+  int slot_{-1};
+  int index_{-1};
+  friend class FileIO;
+
+public:
+  FileBuffer() = default;
+  FileBuffer(FileBuffer &&rhs) noexcept;
+  FileBuffer &operator=(FileBuffer &&rhs) noexcept;
+  FileBuffer(const FileBuffer &) = delete;
+  FileBuffer &operator=(const FileBuffer &) = delete;
+  ~FileBuffer();
+  char *Data() const { return data_; }
+  std::size_t Size() const { return size_; }
+  bool Registered() const { return index_ >= 0; }
+};
+
+// Awaitable file operations on a worker's ring, for asynchronous handlers.
+// Each completes on the ring that started it, so the handler resumes on its
+// own worker without an offload thread. Results are those of the system
+// calls, with failures as negative errno values. With O_DIRECT, offsets and
+// lengths must be multiples of the device's logical block size.
+class FileIO {
+  IOUring &ring_;
+  std::size_t bufferSize_{0};
+  std::vector<char *> pool_;
+  std::vector<int> free_;
+  bool registered_{false};
+  friend class FileBuffer;
+
+  void Release(FileBuffer &buffer);
+
+public:
+  explicit FileIO(IOUring &ring) : ring_(ring) {}
+  FileIO(const FileIO &) = delete;
+  FileIO &operator=(const FileIO &) = delete;
+  ~FileIO();
+  // Allocates the pool and registers it with the ring. Returns false if
+  // registration failed; the buffers are then used unregistered.
+  bool Configure(const FileIOOptions &options);
+
+  FileAwaiter Open(const char *path, int flags, mode_t mode = 0644) {
+    return ring_.FileAsync({.op = FileRequest::OPEN, .path = path, .flags = flags, .mode = mode});
+  }
+  FileAwaiter ReadFile(int fd, void *buffer, unsigned length, std::uint64_t offset) {
+    return ring_.FileAsync(
+        {.op = FileRequest::READ, .fd = fd, .buffer = buffer, .length = length, .offset = offset});
+  }
+  FileAwaiter ReadFile(int fd, FileBuffer &buffer, unsigned length, std::uint64_t offset) {
+    return ring_.FileAsync({.op = FileRequest::READ, .fd = fd, .buffer = buffer.Data(),
+                            .length = length, .offset = offset, .bufferIndex = buffer.index_});
+  }
+  FileAwaiter WriteFile(int fd, const void *data, unsigned length, std::uint64_t offset) {
+    return ring_.FileAsync({.op = FileRequest::WRITE, .fd = fd,
+                            .buffer = const_cast<void *>(data), .length = length,
+                            .offset = offset});
+  }
+  FileAwaiter WriteFile(int fd, const FileBuffer &buffer, unsigned length, std::uint64_t offset) {
+    return ring_.FileAsync({.op = FileRequest::WRITE, .fd = fd, .buffer = buffer.Data(),
+                            .length = length, .offset = offset, .bufferIndex = buffer.index_});
+  }
+  // dataOnly is fdatasync.
+  FileAwaiter Fsync(int fd, bool dataOnly = false) {
+    return ring_.FileAsync({.op = FileRequest::FSYNC, .fd = fd,
+                            .flags = dataOnly ? static_cast<int>(IORING_FSYNC_DATASYNC) : 0});
+  }
+  FileAwaiter Statx(const char *path, struct statx &out, unsigned mask = STATX_BASIC_STATS,
+                    int flags = 0) {
+    return ring_.FileAsync({.op = FileRequest::STATX, .path = path, .buffer = &out,
+                            .flags = flags, .mode = mask});
+  }
+  FileAwaiter Close(int fd) { return ring_.FileAsync({.op = FileRequest::CLOSE, .fd = fd}); }
+
+  // A free pool buffer, or a new unregistered one of the pool's buffer size
+  // (at least size bytes) when the pool is empty or too small.
+  FileBuffer Buffer(std::size_t size = 0);
+};
+
+// What asynchronous handlers get besides the request: the worker's services.
+struct HandlerContext {
+  FileIO &files;
+};
+} // namespace HTTP
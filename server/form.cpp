@@ -0,0 +1,496 @@
+#include "form.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+namespace HTTP {
+namespace {
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool iequals_prefix(std::string_view text, std::string_view prefix) {
+  if (text.size() < prefix.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < prefix.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(text[i])) != prefix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+// The value of a `key=value` or `key="value"` parameter in a header such as
+// Content-Type or Content-Disposition.
+std::string_view header_parameter(std::string_view header, std::string_view key) {
+  std::size_t position = header.find(';');
+  while (position != std::string_view::npos) {
+    std::string_view rest = trim(header.substr(position + 1));
+    std::size_t next = rest.find(';');
+    std::string_view parameter = rest.substr(0, next);
+    std::size_t equals = parameter.find('=');
+    if (equals != std::string_view::npos && iequals_prefix(trim(parameter.substr(0, equals)), key) &&
+        trim(parameter.substr(0, equals)).size() == key.size()) {
+      std::string_view value = trim(parameter.substr(equals + 1));
+      if (value.size() >= 2 && value.front() == '"') {
+        // A quoted value may contain ';', so it ends at the closing quote.
+        std::string_view quoted = rest.substr(rest.find('"') + 1);
+        return quoted.substr(0, quoted.find('"'));
+      }
+      return value;
+    }
+    if (next == std::string_view::npos) {
+      break;
+    }
+    position = header.size() - rest.size() + next;
+  }
+  return {};
+}
+} // namespace
+
+std::size_t PercentDecode(char *data, std::size_t size, bool plusIsSpace) {
+  if (!plusIsSpace && std::memchr(data, '%', size) == nullptr) {
+    return size;
+  }
+  std::size_t read = 0;
+  std::size_t write = 0;
+  while (read < size) {
+    char c = data[read];
+    if (c == '%' && read + 2 < size) {
+      int high = hex_value(data[read + 1]);
+      int low = hex_value(data[read + 2]);
+      if (high >= 0 && low >= 0) {
+        data[write++] = static_cast<char>(high * 16 + low);
+        read += 3;
+        continue;
+      }
+    } else if (c == '+' && plusIsSpace) {
+      c = ' ';
+    }
+    data[write++] = c;
+    ++read;
+  }
+  return write;
+}
+
+MultipartParser::MultipartParser(std::string_view boundary, std::size_t maxHeaderSize)
+    : delimiter_("\r\n--"), pending_("\r\n"), maxHeaderSize_(maxHeaderSize) {
+  // The first delimiter has no CRLF in front of it; starting with one
+  // pending lets it match like every other.
+  delimiter_.append(boundary);
+}
+
+MultipartParser::Event MultipartParser::Scan(std::string_view &input) {
+  bool inPart = state_ == State::BODY;
+  if (!pending_.empty()) {
+    std::size_t take = std::min(delimiter_.size() - pending_.size(), input.size());
+    if (delimiter_.compare(pending_.size(), take, input.data(), take) == 0) {
+      pending_.append(input.data(), take);
+      input.remove_prefix(take);
+      if (pending_.size() < delimiter_.size()) {
+        return Event::NEED_MORE;
+      }
+      pending_.clear();
+      state_ = State::DELIMITER_END;
+      return inPart ? Event::PART_END : Event::NEED_MORE;
+    }
+    // Boundaries cannot contain CR, so no later byte of the held-back
+    // prefix can start a delimiter: all of it is data.
+    held_.swap(pending_);
+    pending_.clear();
+    if (inPart) {
+      data_ = held_;
+      return Event::DATA;
+    }
+  }
+  if (input.empty()) {
+    return Event::NEED_MORE;
+  }
+  // memchr is vectorized in the C library, and CR is rare in most data, so
+  // candidates are found at memory bandwidth and confirmed with memcmp.
+  const char *begin = input.data();
+  std::size_t size = input.size();
+  std::size_t position = 0;
+  while (true) {
+    const char *cr = static_cast<const char *>(std::memchr(begin + position, '\r', size - position));
+    if (cr == nullptr) {
+      data_ = input;
+      input = {};
+      return inPart ? Event::DATA : Event::NEED_MORE;
+    }
+    std::size_t at = cr - begin;
+    std::size_t available = size - at;
+    std::size_t compare = std::min(available, delimiter_.size());
+    if (std::memcmp(cr, delimiter_.data(), compare) != 0) {
+      position = at + 1;
+      continue;
+    }
+    if (at > 0) {
+      data_ = input.substr(0, at);
+      input.remove_prefix(at);
+      if (inPart) {
+        return Event::DATA;
+      }
+      return Scan(input);
+    }
+    if (available < delimiter_.size()) {
+      pending_.assign(input);
+      input = {};
+      return Event::NEED_MORE;
+    }
+    input.remove_prefix(delimiter_.size());
+    state_ = State::DELIMITER_END;
+    return inPart ? Event::PART_END : Event::NEED_MORE;
+  }
+}
+
+MultipartParser::Event MultipartParser::Next(std::string_view &input) {
+  while (true) {
+    switch (state_) {
+    case State::PREAMBLE:
+    case State::BODY: {
+      Event event = Scan(input);
+      if (event != Event::NEED_MORE || state_ != State::DELIMITER_END) {
+        return event;
+      }
+      break;
+    }
+    case State::DELIMITER_END:
+      // After a delimiter: "--" ends the body, otherwise optional padding
+      // and a CRLF start the next part's headers.
+      while (!input.empty()) {
+        line_.push_back(input.front());
+        input.remove_prefix(1);
+        if (line_ == "--") {
+          line_.clear();
+          state_ = State::EPILOGUE;
+          return Event::DONE;
+        }
+        if (line_.size() >= 2 && line_.ends_with("\r\n")) {
+          line_.clear();
+          headers_.clear();
+          state_ = State::HEADERS;
+          break;
+        }
+        if (line_.size() > 64) {
+          state_ = State::FAILED;
+          return Event::ERROR;
+        }
+      }
+      if (state_ == State::DELIMITER_END) {
+        return Event::NEED_MORE;
+      }
+      break;
+    case State::HEADERS:
+      while (!input.empty()) {
+        headers_.push_back(input.front());
+        input.remove_prefix(1);
+        if (headers_ == "\r\n" || headers_.ends_with("\r\n\r\n")) {
+          if (!ParsePartHeaders()) {
+            state_ = State::FAILED;
+            return Event::ERROR;
+          }
+          state_ = State::BODY;
+          return Event::PART_BEGIN;
+        }
+        if (headers_.size() > maxHeaderSize_) {
+          state_ = State::FAILED;
+          return Event::ERROR;
+        }
+      }
+      return Event::NEED_MORE;
+    case State::EPILOGUE:
+      input = {};
+      return Event::DONE;
+    case State::FAILED:
+      return Event::ERROR;
+    }
+  }
+}
+
+bool MultipartParser::ParsePartHeaders() {
+  name_.clear();
+  filename_.clear();
+  contentType_.clear();
+  bool disposition = false;
+  std::string_view rest = headers_;
+  while (!rest.empty()) {
+    std::size_t end = rest.find("\r\n");
+    std::string_view line = rest.substr(0, end);
+    rest = end == std::string_view::npos ? std::string_view{} : rest.substr(end + 2);
+    std::size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+    std::string_view field = line.substr(0, colon);
+    std::string_view value = trim(line.substr(colon + 1));
+    if (field.size() == 19 && iequals_prefix(field, "content-disposition")) {
+      if (!iequals_prefix(value, "form-data")) {
+        return false;
+      }
+      disposition = true;
+      name_.assign(header_parameter(value, "name"));
+      filename_.assign(header_parameter(value, "filename"));
+    } else if (field.size() == 12 && iequals_prefix(field, "content-type")) {
+      contentType_.assign(value);
+    }
+  }
+  return disposition && !name_.empty();
+}
+
+FormReader::FormReader(ReadIterator &iterator, FileIO &files, std::string_view contentType,
+                       std::size_t length, FormOptions options)
+    : iterator_(iterator), files_(files), remaining_(length), options_(options) {
+  if (length > options_.maxBodySize) {
+    status_ = 413;
+  } else if (iequals_prefix(contentType, "multipart/form-data")) {
+    std::string_view boundary = header_parameter(contentType, "boundary");
+    if (boundary.empty() || boundary.size() > 70) {
+      status_ = 400;
+    } else {
+      multipart_.emplace(boundary, options_.maxPartHeaderSize);
+    }
+  } else if (!iequals_prefix(contentType, "application/x-www-form-urlencoded")) {
+    status_ = 415;
+  }
+}
+
+std::string_view FormReader::Input() const {
+  return {iterator_.CurrentPtr(), std::min(iterator_.Available(), remaining_)};
+}
+
+void FormReader::Consume(std::size_t n) {
+  iterator_.Advance(n);
+  remaining_ -= n;
+}
+
+void FormReader::Fail(int status) {
+  if (status_ == 0) {
+    status_ = status;
+  }
+}
+
+Coroutine FormReader::Next(FormItem &item) {
+  item = FormItem{};
+  if (status_ != 0) {
+    item.kind = FormItem::ERROR;
+    co_return;
+  }
+  if (multipart_) {
+    co_await NextMultipart(item);
+  } else {
+    co_await NextUrlEncoded(item);
+  }
+  if (status_ != 0) {
+    item = FormItem{};
+    item.kind = FormItem::ERROR;
+  }
+}
+
+Coroutine FormReader::NextMultipart(FormItem &item) {
+  while (true) {
+    if (done_) {
+      co_await Skip();
+      item.kind = FormItem::END;
+      co_return;
+    }
+    std::string_view input = Input();
+    if (input.empty()) {
+      if (remaining_ == 0) {
+        Fail(400);
+        co_return;
+      }
+      co_await iterator_.Ensure();
+      if (iterator_.Available() == 0) {
+        Fail(400);
+        co_return;
+      }
+      continue;
+    }
+    std::size_t before = input.size();
+    auto event = multipart_->Next(input);
+    Consume(before - input.size());
+    switch (event) {
+    case MultipartParser::Event::NEED_MORE:
+      break;
+    case MultipartParser::Event::PART_BEGIN:
+      if (multipart_->Filename().empty()) {
+        value_.clear();
+        break;
+      }
+      inFile_ = true;
+      item.kind = FormItem::FILE_BEGIN;
+      item.name = multipart_->Name();
+      item.filename = multipart_->Filename();
+      item.contentType = multipart_->ContentType();
+      co_return;
+    case MultipartParser::Event::DATA:
+      if (inFile_) {
+        item.kind = FormItem::FILE_DATA;
+        item.value = multipart_->Data();
+        co_return;
+      }
+      if (value_.size() + multipart_->Data().size() > options_.maxFieldSize) {
+        Fail(413);
+        co_return;
+      }
+      value_.append(multipart_->Data());
+      break;
+    case MultipartParser::Event::PART_END:
+      if (inFile_) {
+        inFile_ = false;
+        item.kind = FormItem::FILE_END;
+        item.name = multipart_->Name();
+        co_return;
+      }
+      item.kind = FormItem::FIELD;
+      item.name = multipart_->Name();
+      item.value = value_;
+      co_return;
+    case MultipartParser::Event::DONE:
+      done_ = true;
+      break;
+    case MultipartParser::Event::ERROR:
+      Fail(400);
+      co_return;
+    }
+  }
+}
+
+Coroutine FormReader::NextUrlEncoded(FormItem &item) {
+  if (done_) {
+    item.kind = FormItem::END;
+    co_return;
+  }
+  if (!inValue_) {
+    name_.clear();
+  }
+  while (true) {
+    std::string_view input = Input();
+    if (input.empty() && remaining_ > 0) {
+      co_await iterator_.Ensure();
+      if (iterator_.Available() == 0) {
+        Fail(400);
+        co_return;
+      }
+      continue;
+    }
+    std::size_t stop = 0;
+    while (stop < input.size() && input[stop] != '&' && (inValue_ || input[stop] != '=')) {
+      ++stop;
+    }
+    std::string &target = inValue_ ? value_ : name_;
+    if (target.size() + stop > options_.maxFieldSize) {
+      Fail(413);
+      co_return;
+    }
+    target.append(input.data(), stop);
+    Consume(stop);
+    if (stop == input.size() && remaining_ > 0) {
+      continue;
+    }
+    bool last = stop == input.size();
+    char separator = last ? '&' : input[stop];
+    if (!last) {
+      Consume(1);
+    }
+    if (separator == '=') {
+      inValue_ = true;
+      value_.clear();
+      continue;
+    }
+    // A field ends at '&' or at the end of the body.
+    bool hadValue = inValue_;
+    inValue_ = false;
+    if (!hadValue) {
+      value_.clear();
+    }
+    done_ = last;
+    if (name_.empty()) {
+      if (done_) {
+        item.kind = FormItem::END;
+        co_return;
+      }
+      continue;
+    }
+    name_.resize(PercentDecode(name_.data(), name_.size(), true));
+    value_.resize(PercentDecode(value_.data(), value_.size(), true));
+    item.kind = FormItem::FIELD;
+    item.name = name_;
+    item.value = value_;
+    co_return;
+  }
+}
+
+Coroutine FormReader::Flush(int fd, const FileBuffer &buffer, std::size_t &used, bool &ok) {
+  // An offset of -1 writes at the file position and advances it, as write(2).
+  constexpr auto position = static_cast<std::uint64_t>(-1);
+  std::size_t written = 0;
+  while (ok && written < used) {
+    unsigned length = static_cast<unsigned>(used - written);
+    int n = co_await (written == 0
+                          ? files_.WriteFile(fd, buffer, length, position)
+                          : files_.WriteFile(fd, buffer.Data() + written, length, position));
+    if (n <= 0) {
+      ok = false;
+    } else {
+      written += n;
+    }
+  }
+  used = 0;
+}
+
+Coroutine FormReader::Save(int fd, bool &ok) {
+  ok = true;
+  FileBuffer buffer = files_.Buffer(64 * 1024);
+  std::size_t used = 0;
+  FormItem item;
+  while (true) {
+    co_await Next(item);
+    if (item.kind == FormItem::FILE_DATA) {
+      std::string_view data = item.value;
+      while (ok && !data.empty()) {
+        std::size_t n = std::min(data.size(), buffer.Size() - used);
+        std::memcpy(buffer.Data() + used, data.data(), n);
+        used += n;
+        data.remove_prefix(n);
+        if (used == buffer.Size()) {
+          co_await Flush(fd, buffer, used, ok);
+        }
+      }
+      continue;
+    }
+    co_await Flush(fd, buffer, used, ok);
+    ok = ok && item.kind == FormItem::FILE_END;
+    co_return;
+  }
+}
+
+Coroutine FormReader::Skip() {
+  while (remaining_ > 0) {
+    std::size_t available = Input().size();
+    if (available == 0) {
+      co_await iterator_.Ensure();
+      if (iterator_.Available() == 0) {
+        Fail(400);
+        co_return;
+      }
+      continue;
+    }
+    Consume(available);
+  }
+}
+} // namespace HTTP
@@ -0,0 +1,123 @@
+#pragma once
+#include "coroutine.h"
+#include "file_io.h"
+#include "read_iterator.h"
+#include "request_data.h"
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+namespace HTTP {
+// Decodes %XX escapes in place, and '+' as a space when plusIsSpace, and
+// returns the new length. Malformed escapes are kept as they are.
+std::size_t PercentDecode(char *data, std::size_t size, bool plusIsSpace);
+inline void PercentDecode(std::pmr::string &text, bool plusIsSpace) {
+  text.resize(PercentDecode(text.data(), text.size(), plusIsSpace));
+}
+
+// Incremental multipart/form-data parser. Next consumes input from the
+// front of the view it is given and returns one event at a time, so it can
+// be fed straight from the socket buffer. Part bodies come out as DATA
+// views into that input and are never copied, except for a delimiter
+// prefix held back at the end of an input.
+class MultipartParser {
+public:
+  enum class Event { NEED_MORE, PART_BEGIN, DATA, PART_END, DONE, ERROR };
+
+  MultipartParser(std::string_view boundary, std::size_t maxHeaderSize);
+  Event Next(std::string_view &input);
+  // The current part's bytes after DATA; valid until the next call.
+  std::string_view Data() const { return data_; }
+  // The current part's headers after PART_BEGIN.
+  std::string_view Name() const { return name_; }
+  std::string_view Filename() const { return filename_; }
+  std::string_view ContentType() const { return contentType_; }
+
+private:
+  enum class State { PREAMBLE, BODY, DELIMITER_END, HEADERS, EPILOGUE, FAILED };
+  std::string delimiter_;
+  std::string pending_;
+  std::string held_;
+  std::string line_;
+  std::string headers_;
+  std::string name_;
+  std::string filename_;
+  std::string contentType_;
+  std::string_view data_;
+  std::size_t maxHeaderSize_;
+  State state_{State::PREAMBLE};
+
+  Event Scan(std::string_view &input);
+  bool ParsePartHeaders();
+};
+
+struct FormOptions {
+  // Largest body accepted, checked against Content-Length.
+  std::size_t maxBodySize{1ull << 32};
+  // Largest field value that is buffered; file parts are streamed instead.
+  std::size_t maxFieldSize{64 * 1024};
+  std::size_t maxPartHeaderSize{8 * 1024};
+};
+
+struct FormItem {
+  enum Kind { FIELD, FILE_BEGIN, FILE_DATA, FILE_END, END, ERROR } kind{END};
+  // FIELD and FILE_BEGIN.
+  std::string_view name;
+  // FIELD: the decoded value. FILE_DATA: the next bytes of the file.
+  std::string_view value;
+  // FILE_BEGIN.
+  std::string_view filename;
+  std::string_view contentType;
+};
+
+// Reads an application/x-www-form-urlencoded or multipart/form-data body
+// while it arrives. Fields are delivered whole; multipart parts with a
+// filename are delivered as a run of FILE_DATA items, so an upload never
+// has to fit in memory. Views in an item stay valid until the next call.
+class FormReader {
+  ReadIterator &iterator_;
+  FileIO &files_;
+  std::size_t remaining_;
+  FormOptions options_;
+  std::optional<MultipartParser> multipart_;
+  std::string name_;
+  std::string value_;
+  bool inValue_{false};
+  bool inFile_{false};
+  bool done_{false};
+  int status_{0};
+
+  std::string_view Input() const;
+  void Consume(std::size_t n);
+  void Fail(int status);
+  Coroutine NextMultipart(FormItem &item);
+  Coroutine NextUrlEncoded(FormItem &item);
+  Coroutine Flush(int fd, const FileBuffer &buffer, std::size_t &used, bool &ok);
+
+public:
+  // contentType is the request's Content-Type; length its Content-Length.
+  // Save writes through files, on the worker's ring.
+  FormReader(ReadIterator &iterator, FileIO &files, std::string_view contentType,
+             std::size_t length, FormOptions options);
+  Coroutine Next(FormItem &item);
+  // Writes the rest of the current file part to fd, at its file position,
+  // and consumes its FILE_END; ok is false if the body or a write failed.
+  // The writes are submitted on the worker's ring, so the worker serves
+  // other connections while they complete.
+  Coroutine Save(int fd, bool &ok);
+  // Reads and drops whatever the handler left unread.
+  Coroutine Skip();
+  // 0, or the status to answer with: 400 for a malformed body, 413 for a
+  // field over maxFieldSize.
+  int Status() const { return status_; }
+};
+
+// A form route's handler. It reads the body through the FormReader and
+// fills in the response; the response is written when it returns.
+using FormHandler = std::function<Coroutine(FormReader &, const RequestData &, ResponseData &)>;
+struct FormRoute {
+  FormHandler handler;
+  FormOptions options;
+};
+} // namespace HTTP
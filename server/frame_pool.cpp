@@ -0,0 +1,62 @@
+#include "frame_pool.h"
+#include <array>
+#include <new>
+
+namespace HTTP {
+
+namespace {
+constexpr std::size_t kGranularity = 64;
+constexpr std::size_t kClassCount = 64;
+constexpr std::size_t kMaxCached = 1024;
+
+struct FrameNode {
+  FrameNode *next;
+};
+
+struct FramePool {
+  std::array<FrameNode *, kClassCount> heads{};
+  std::array<std::size_t, kClassCount> counts{};
+
+  ~FramePool() {
+    for (auto *head : heads) {
+      while (head != nullptr) {
+        FrameNode *next = head->next;
+        ::operator delete(head);
+        head = next;
+      }
+    }
+  }
+};
+
+thread_local FramePool pool;
+
+std::size_t SizeClass(std::size_t size) { return (size + kGranularity - 1) / kGranularity; }
+} // namespace
+
+void *AllocateFrame(std::size_t size) {
+  std::size_t sizeClass = SizeClass(size);
+  if (sizeClass >= kClassCount) {
+    return ::operator new(size);
+  }
+  if (FrameNode *frame = pool.heads[sizeClass]) {
+    pool.heads[sizeClass] = frame->next;
+    pool.counts[sizeClass]--;
+    return frame;
+  }
+  return ::operator new(sizeClass * kGranularity);
+}
+
+// Frames may be released on a different thread than the one that created them
+// (e.g. after an offload hop); they simply join that thread's free list.
+void FreeFrame(void *frame, std::size_t size) noexcept {
+  std::size_t sizeClass = SizeClass(size);
+  if (sizeClass >= kClassCount || pool.counts[sizeClass] == kMaxCached) {
+    ::operator delete(frame);
+    return;
+  }
+  auto *node = static_cast<FrameNode *>(frame);
+  node->next = pool.heads[sizeClass];
+  pool.heads[sizeClass] = node;
+  pool.counts[sizeClass]++;
+}
+} // namespace HTTP
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+namespace HTTP {
+// Per-thread free lists for coroutine frames, bucketed by size class, so that
+// the short-lived child coroutines awaited on every request reuse memory
+// instead of going back to the global allocator.
+void *AllocateFrame(std::size_t size);
+void FreeFrame(void *frame, std::size_t size) noexcept;
+} // namespace HTTP
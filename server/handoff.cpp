@@ -0,0 +1,95 @@
+#include "handoff.h"
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace HTTP {
+
+namespace {
+static sockaddr_un MakeAddress(std::string_view path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Handoff socket path is too long");
+  }
+  std::memcpy(address.sun_path, path.data(), path.size());
+  return address;
+}
+} // namespace
+
+std::vector<int> ReceiveListeners(std::string_view path) {
+  sockaddr_un address = MakeAddress(path);
+  int channel = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (channel == -1) {
+    throw std::runtime_error("Could not open handoff socket");
+  }
+  if (connect(channel, (sockaddr *)&address, sizeof(address)) == -1) {
+    close(channel);
+    return {};
+  }
+  char byte;
+  iovec io{.iov_base = &byte, .iov_len = 1};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxHandoffListeners)];
+  msghdr message{};
+  message.msg_iov = &io;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  ssize_t received = recvmsg(channel, &message, MSG_CMSG_CLOEXEC);
+  close(channel);
+  cmsghdr *header = CMSG_FIRSTHDR(&message);
+  if (received != 1 || header == nullptr || header->cmsg_level != SOL_SOCKET ||
+      header->cmsg_type != SCM_RIGHTS || header->cmsg_len <= CMSG_LEN(0)) {
+    throw std::runtime_error("Handoff did not carry a listener");
+  }
+  std::vector<int> listenerFDs((header->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+  std::memcpy(listenerFDs.data(), CMSG_DATA(header), listenerFDs.size() * sizeof(int));
+  return listenerFDs;
+}
+
+void SendListeners(std::string_view path, const std::vector<int> &listenerFDs) {
+  if (listenerFDs.empty() || listenerFDs.size() > kMaxHandoffListeners) {
+    throw std::runtime_error("Too many listeners to hand off");
+  }
+  sockaddr_un address = MakeAddress(path);
+  int channel = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (channel == -1) {
+    throw std::runtime_error("Could not open handoff socket");
+  }
+  unlink(std::string(path).c_str());
+  if (bind(channel, (sockaddr *)&address, sizeof(address)) == -1 ||
+      listen(channel, 1) == -1) {
+    close(channel);
+    throw std::runtime_error("Could not listen on handoff socket");
+  }
+  int successor = accept(channel, nullptr, nullptr);
+  close(channel);
+  unlink(std::string(path).c_str());
+  if (successor == -1) {
+    throw std::runtime_error("Could not accept handoff connection");
+  }
+  char byte = 0;
+  iovec io{.iov_base = &byte, .iov_len = 1};
+  std::size_t size = sizeof(int) * listenerFDs.size();
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxHandoffListeners)] = {};
+  msghdr message{};
+  message.msg_iov = &io;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = CMSG_SPACE(size);
+  cmsghdr *header = CMSG_FIRSTHDR(&message);
+  header->cmsg_level = SOL_SOCKET;
+  header->cmsg_type = SCM_RIGHTS;
+  header->cmsg_len = CMSG_LEN(size);
+  std::memcpy(CMSG_DATA(header), listenerFDs.data(), size);
+  ssize_t sent = sendmsg(successor, &message, MSG_NOSIGNAL);
+  close(successor);
+  if (sent != 1) {
+    throw std::runtime_error("Could not send listener");
+  }
+}
+
+} // namespace HTTP
@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <vector>
+namespace HTTP {
+constexpr std::size_t kMaxHandoffListeners = 32;
+// Listeners are passed in one message, in order; an empty result means
+// nobody was waiting at path.
+std::vector<int> ReceiveListeners(std::string_view path);
+void SendListeners(std::string_view path, const std::vector<int> &listenerFDs);
+} // namespace HTTP
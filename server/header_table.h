@@ -0,0 +1,98 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+namespace HTTP {
+enum KnownHeader {
+  ACCEPT,
+  ACCEPT_ENCODING,
+  AUTHORIZATION,
+  CONNECTION,
+  CONTENT_ENCODING,
+  CONTENT_LENGTH,
+  CONTENT_TYPE,
+  COOKIE,
+  EXPECT,
+  HOST,
+  HTTP2_SETTINGS,
+  IF_NONE_MATCH,
+  SEC_WEBSOCKET_KEY,
+  SEC_WEBSOCKET_VERSION,
+  TRANSFER_ENCODING,
+  UPGRADE,
+  USER_AGENT,
+  KNOWN_HEADER_COUNT
+};
+
+namespace detail {
+inline constexpr std::string_view kKnownHeaderNames[KNOWN_HEADER_COUNT] = {
+    "accept",          "accept-encoding",   "authorization",         "connection",
+    "content-encoding", "content-length",   "content-type",          "cookie",
+    "expect",          "host",              "http2-settings",        "if-none-match",
+    "sec-websocket-key", "sec-websocket-version", "transfer-encoding", "upgrade",
+    "user-agent"};
+
+constexpr std::size_t kHeaderTableSize = 32;
+
+constexpr char lower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32) : c; }
+
+// Length plus the first and last characters separate every known name; the
+// table is checked for collisions at compile time below.
+constexpr std::size_t headerHash(std::string_view name) {
+  return (name.size() + static_cast<unsigned char>(lower(name.front())) +
+          9 * static_cast<unsigned char>(lower(name.back()))) %
+         kHeaderTableSize;
+}
+
+constexpr std::array<int, kHeaderTableSize> buildHeaderTable() {
+  std::array<int, kHeaderTableSize> table{};
+  for (auto &slot : table) {
+    slot = -1;
+  }
+  for (int i = 0; i < KNOWN_HEADER_COUNT; ++i) {
+    auto &slot = table[headerHash(kKnownHeaderNames[i])];
+    slot = slot == -1 ? i : -2;
+  }
+  return table;
+}
+
+inline constexpr auto kHeaderTable = buildHeaderTable();
+
+constexpr bool headerTablePerfect() {
+  int found = 0;
+  for (int slot : kHeaderTable) {
+    if (slot == -2) {
+      return false;
+    }
+    found += slot >= 0;
+  }
+  return found == KNOWN_HEADER_COUNT;
+}
+static_assert(headerTablePerfect(), "known header hash has collisions");
+} // namespace detail
+
+constexpr std::optional<KnownHeader> LookupHeader(std::string_view name) {
+  if (name.empty()) {
+    return std::nullopt;
+  }
+  int slot = detail::kHeaderTable[detail::headerHash(name)];
+  if (slot < 0) {
+    return std::nullopt;
+  }
+  std::string_view known = detail::kKnownHeaderNames[slot];
+  if (known.size() != name.size()) {
+    return std::nullopt;
+  }
+  for (std::size_t i = 0; i < name.size(); ++i) {
+    if (detail::lower(name[i]) != known[i]) {
+      return std::nullopt;
+    }
+  }
+  return static_cast<KnownHeader>(slot);
+}
+
+constexpr std::string_view KnownHeaderName(KnownHeader header) {
+  return detail::kKnownHeaderNames[header];
+}
+} // namespace HTTP
@@ -0,0 +1,418 @@
+#include "hpack.h"
+#include <array>
+#include <cctype>
+#include <string>
+#include <unordered_map>
+
+namespace HTTP {
+
+namespace {
+struct HuffmanCode {
+  std::uint32_t code;
+  std::uint8_t length;
+};
+
+constexpr HuffmanCode kHuffman[256] = {
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+    {0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+    {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+    {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+    {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+    {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+    {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+    {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+    {0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+    {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+    {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+    {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+    {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+    {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+    {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+    {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+    {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+    {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+    {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+    {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+    {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+    {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+    {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+    {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+    {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+    {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+    {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+    {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+    {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+    {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+    {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+    {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+    {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+    {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+    {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+    {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+    {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+    {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+    {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+    {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+    {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+};
+
+constexpr std::uint32_t kEOS = 0x3fffffff;
+
+const HeaderField kStaticTable[] = {
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+constexpr std::size_t kStaticCount = sizeof(kStaticTable) / sizeof(kStaticTable[0]);
+constexpr std::size_t kEntryOverhead = 32;
+
+// Decoding walks a binary tree built once from the code table; node 0 is the
+// root, leaves carry the symbol (256 for EOS).
+struct HuffmanTree {
+  struct Node {
+    std::int16_t children[2]{-1, -1};
+    std::int16_t symbol{-1};
+  };
+  std::vector<Node> nodes{1};
+
+  void Add(std::uint32_t code, int length, int symbol) {
+    std::size_t current = 0;
+    for (int bit = length - 1; bit >= 0; --bit) {
+      int direction = (code >> bit) & 1;
+      if (nodes[current].children[direction] < 0) {
+        nodes[current].children[direction] = static_cast<std::int16_t>(nodes.size());
+        nodes.emplace_back();
+      }
+      current = nodes[current].children[direction];
+    }
+    nodes[current].symbol = static_cast<std::int16_t>(symbol);
+  }
+
+  HuffmanTree() {
+    nodes.reserve(513);
+    for (int symbol = 0; symbol < 256; ++symbol) {
+      Add(kHuffman[symbol].code, kHuffman[symbol].length, symbol);
+    }
+    Add(kEOS, 30, 256);
+  }
+};
+
+static const HuffmanTree &huffmanTree() {
+  static const HuffmanTree tree;
+  return tree;
+}
+
+static bool decodeInteger(std::string_view &input, int prefix, std::uint64_t &value) {
+  if (input.empty()) {
+    return false;
+  }
+  std::uint64_t mask = (1u << prefix) - 1;
+  value = static_cast<unsigned char>(input[0]) & mask;
+  input.remove_prefix(1);
+  if (value < mask) {
+    return true;
+  }
+  for (int shift = 0; shift <= 56; shift += 7) {
+    if (input.empty()) {
+      return false;
+    }
+    auto byte = static_cast<unsigned char>(input[0]);
+    input.remove_prefix(1);
+    value += std::uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool decodeString(std::string_view &input, std::string &output) {
+  if (input.empty()) {
+    return false;
+  }
+  bool huffman = static_cast<unsigned char>(input[0]) & 0x80;
+  std::uint64_t length;
+  if (!decodeInteger(input, 7, length) || length > input.size()) {
+    return false;
+  }
+  auto data = input.substr(0, length);
+  input.remove_prefix(length);
+  output.clear();
+  if (huffman) {
+    return HuffmanDecode(data, output);
+  }
+  output.assign(data);
+  return true;
+}
+
+static void encodeInteger(std::uint64_t value, int prefix, std::uint8_t flags, std::string &out) {
+  std::uint64_t mask = (1u << prefix) - 1;
+  if (value < mask) {
+    out.push_back(static_cast<char>(flags | value));
+    return;
+  }
+  out.push_back(static_cast<char>(flags | mask));
+  value -= mask;
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+static void encodeString(std::string_view value, std::string &out) {
+  encodeInteger(value.size(), 7, 0, out);
+  out.append(value);
+}
+
+struct StaticIndex {
+  std::unordered_map<std::string_view, std::size_t> byName;
+  std::unordered_map<std::string_view, std::size_t> status;
+
+  StaticIndex() {
+    for (std::size_t i = kStaticCount; i-- > 0;) {
+      byName[kStaticTable[i].first] = i + 1;
+      if (kStaticTable[i].first == ":status") {
+        status[kStaticTable[i].second] = i + 1;
+      }
+    }
+  }
+};
+
+static const StaticIndex &staticIndex() {
+  static const StaticIndex index;
+  return index;
+}
+} // namespace
+
+bool HuffmanDecode(std::string_view input, std::string &output) {
+  const auto &tree = huffmanTree();
+  std::size_t current = 0;
+  int depth = 0;
+  bool allOnes = true;
+  for (unsigned char byte : input) {
+    for (int bit = 7; bit >= 0; --bit) {
+      int direction = (byte >> bit) & 1;
+      auto next = tree.nodes[current].children[direction];
+      if (next < 0) {
+        return false;
+      }
+      current = next;
+      ++depth;
+      allOnes = allOnes && direction == 1;
+      auto symbol = tree.nodes[current].symbol;
+      if (symbol >= 0) {
+        if (symbol == 256) {
+          return false;
+        }
+        output.push_back(static_cast<char>(symbol));
+        current = 0;
+        depth = 0;
+        allOnes = true;
+      }
+    }
+  }
+  return depth < 8 && allOnes;
+}
+
+HpackDecoder::HpackDecoder(std::size_t limit, std::size_t maxHeaderList)
+    : maxSize_(limit), limit_(limit), maxHeaderList_(maxHeaderList) {}
+
+void HpackDecoder::Evict() {
+  while (size_ > maxSize_ && !table_.empty()) {
+    size_ -= table_.back().first.size() + table_.back().second.size() + kEntryOverhead;
+    table_.pop_back();
+  }
+}
+
+void HpackDecoder::Insert(std::string name, std::string value) {
+  std::size_t entry = name.size() + value.size() + kEntryOverhead;
+  if (entry > maxSize_) {
+    table_.clear();
+    size_ = 0;
+    return;
+  }
+  size_ += entry;
+  table_.emplace_front(std::move(name), std::move(value));
+  Evict();
+}
+
+const HeaderField *HpackDecoder::Lookup(std::uint64_t index) const {
+  if (index == 0) {
+    return nullptr;
+  }
+  if (index <= kStaticCount) {
+    return &kStaticTable[index - 1];
+  }
+  index -= kStaticCount + 1;
+  if (index >= table_.size()) {
+    return nullptr;
+  }
+  return &table_[index];
+}
+
+bool HpackDecoder::Decode(std::string_view block, std::vector<HeaderField> &headers) {
+  std::size_t listSize = 0;
+  bool fieldSeen = false;
+  while (!block.empty()) {
+    auto first = static_cast<unsigned char>(block[0]);
+    std::uint64_t index;
+    if (first & 0x80) {
+      if (!decodeInteger(block, 7, index)) {
+        return false;
+      }
+      const auto *field = Lookup(index);
+      if (!field) {
+        return false;
+      }
+      headers.push_back(*field);
+    } else if ((first & 0xe0) == 0x20) {
+      // Dynamic table size updates are only allowed before the first field.
+      if (fieldSeen || !decodeInteger(block, 5, index) || index > limit_) {
+        return false;
+      }
+      maxSize_ = index;
+      Evict();
+      continue;
+    } else {
+      bool indexing = (first & 0xc0) == 0x40;
+      if (!decodeInteger(block, indexing ? 6 : 4, index)) {
+        return false;
+      }
+      HeaderField field;
+      if (index != 0) {
+        const auto *named = Lookup(index);
+        if (!named) {
+          return false;
+        }
+        field.first = named->first;
+      } else if (!decodeString(block, field.first)) {
+        return false;
+      }
+      if (!decodeString(block, field.second)) {
+        return false;
+      }
+      if (indexing) {
+        Insert(field.first, field.second);
+      }
+      headers.push_back(std::move(field));
+    }
+    fieldSeen = true;
+    listSize += headers.back().first.size() + headers.back().second.size() + kEntryOverhead;
+    if (listSize > maxHeaderList_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void HpackEncoder::EncodeStatus(unsigned short status, std::string &out) {
+  auto text = std::to_string(status);
+  const auto &index = staticIndex();
+  auto it = index.status.find(text);
+  if (it != index.status.end()) {
+    encodeInteger(it->second, 7, 0x80, out);
+    return;
+  }
+  Encode(":status", text, out);
+}
+
+// Responses are encoded without touching the dynamic table: names found in the
+// static table are referenced by index, everything else is sent as a literal.
+void HpackEncoder::Encode(std::string_view name, std::string_view value, std::string &out) {
+  std::string lower(name);
+  for (auto &c : lower) {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  const auto &index = staticIndex();
+  auto it = index.byName.find(lower);
+  if (it != index.byName.end()) {
+    encodeInteger(it->second, 4, 0, out);
+  } else {
+    out.push_back('\0');
+    encodeString(lower, out);
+  }
+  encodeString(value, out);
+}
+} // namespace HTTP
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+namespace HTTP {
+using HeaderField = std::pair<std::string, std::string>;
+class HpackDecoder {
+  std::deque<HeaderField> table_;
+  std::size_t size_{0};
+  std::size_t maxSize_;
+  std::size_t limit_;
+  std::size_t maxHeaderList_;
+
+  void Insert(std::string name, std::string value);
+  void Evict();
+  const HeaderField *Lookup(std::uint64_t index) const;
+
+public:
+  explicit HpackDecoder(std::size_t limit = 4096, std::size_t maxHeaderList = 64 * 1024);
+  bool Decode(std::string_view block, std::vector<HeaderField> &headers);
+};
+class HpackEncoder {
+public:
+  static void Encode(std::string_view name, std::string_view value, std::string &out);
+  static void EncodeStatus(unsigned short status, std::string &out);
+};
+bool HuffmanDecode(std::string_view input, std::string &output);
+} // namespace HTTP
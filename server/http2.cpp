@@ -0,0 +1,840 @@
+#include "http2.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <utility>
+#include <sys/socket.h>
+
+namespace HTTP {
+
+namespace {
+enum FrameType : std::uint8_t {
+  DATA = 0x0,
+  HEADERS = 0x1,
+  PRIORITY = 0x2,
+  RST_STREAM = 0x3,
+  SETTINGS = 0x4,
+  PUSH_PROMISE = 0x5,
+  PING = 0x6,
+  GOAWAY = 0x7,
+  WINDOW_UPDATE = 0x8,
+  CONTINUATION = 0x9
+};
+
+enum FrameFlag : std::uint8_t {
+  END_STREAM = 0x1,
+  ACK = 0x1,
+  END_HEADERS = 0x4,
+  PADDED = 0x8,
+  PRIORITY_FLAG = 0x20
+};
+
+enum ErrorCode : std::uint32_t {
+  NO_ERROR = 0x0,
+  PROTOCOL_ERROR = 0x1,
+  FLOW_CONTROL_ERROR = 0x3,
+  STREAM_CLOSED = 0x5,
+  FRAME_SIZE_ERROR = 0x6,
+  REFUSED_STREAM = 0x7,
+  COMPRESSION_ERROR = 0x9,
+  ENHANCE_YOUR_CALM = 0xb
+};
+
+enum Setting : std::uint16_t {
+  ENABLE_PUSH = 0x2,
+  MAX_CONCURRENT_STREAMS = 0x3,
+  INITIAL_WINDOW_SIZE = 0x4,
+  MAX_FRAME_SIZE = 0x5
+};
+
+constexpr std::string_view kPreface = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+constexpr std::size_t kMaxFrame = 16384;
+constexpr std::size_t kMaxStreams = 128;
+constexpr std::size_t kMaxHeaderBlock = 64 * 1024;
+constexpr std::size_t kMaxOutbox = 256 * 1024;
+// Control frames and response headers a peer can leave queued by not reading.
+constexpr std::size_t kMaxControlOutbox = 64 * 1024;
+constexpr std::int64_t kMaxWindow = 0x7fffffff;
+constexpr std::uint32_t kReceiveWindow = 1 << 20;
+
+static bool iequals(std::string_view a, std::string_view b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) !=
+        std::tolower(static_cast<unsigned char>(b[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static std::uint32_t read32(const char *p) {
+  auto *u = reinterpret_cast<const unsigned char *>(p);
+  return (std::uint32_t(u[0]) << 24) | (std::uint32_t(u[1]) << 16) | (std::uint32_t(u[2]) << 8) |
+         std::uint32_t(u[3]);
+}
+
+static void put16(std::string &out, std::uint16_t value) {
+  out.push_back(static_cast<char>(value >> 8));
+  out.push_back(static_cast<char>(value));
+}
+
+static void put32(std::string &out, std::uint32_t value) {
+  put16(out, static_cast<std::uint16_t>(value >> 16));
+  put16(out, static_cast<std::uint16_t>(value));
+}
+
+static bool base64UrlDecode(std::string_view input, std::string &output) {
+  std::uint32_t buffer = 0;
+  int bits = 0;
+  for (char c : input) {
+    int value;
+    if (c >= 'A' && c <= 'Z') {
+      value = c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+      value = c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+      value = c - '0' + 52;
+    } else if (c == '-' || c == '+') {
+      value = 62;
+    } else if (c == '_' || c == '/') {
+      value = 63;
+    } else if (c == '=') {
+      break;
+    } else {
+      return false;
+    }
+    buffer = (buffer << 6) | value;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      output.push_back(static_cast<char>(buffer >> bits));
+    }
+  }
+  return true;
+}
+
+static bool stripPadding(std::uint8_t flags, std::string_view &payload) {
+  if (!(flags & PADDED)) {
+    return true;
+  }
+  if (payload.empty()) {
+    return false;
+  }
+  std::size_t padding = static_cast<unsigned char>(payload[0]);
+  payload.remove_prefix(1);
+  if (padding > payload.size()) {
+    return false;
+  }
+  payload.remove_suffix(padding);
+  return true;
+}
+
+static bool connectionSpecific(std::string_view name) {
+  return iequals(name, "connection") || iequals(name, "keep-alive") ||
+         iequals(name, "proxy-connection") || iequals(name, "transfer-encoding") ||
+         iequals(name, "upgrade");
+}
+} // namespace
+
+bool Http2Preface(std::string_view data) {
+  return data.size() >= 3 && kPreface.starts_with(data.substr(0, kPreface.size()));
+}
+
+Http2Connection::Http2Connection(IOUring &ring, ReadIterator &iterator, int fd, bool &idle,
+                                 const std::atomic_bool &stop, const DateHeader &date,
+                                 std::size_t maxBodySize, Http2Handler handler)
+    : ring_(ring), iterator_(iterator), fd_(fd), idle_(idle), stop_(stop), date_(date),
+      maxBodySize_(maxBodySize), handler_(std::move(handler)) {}
+
+bool Http2Connection::WakeAwaiter::await_ready() const noexcept {
+  return !connection_.outbox_.empty() || connection_.joined_;
+}
+
+void Http2Connection::WakeAwaiter::await_suspend(std::coroutine_handle<> h) noexcept {
+  connection_.writerWaiting_ = h;
+}
+
+bool Http2Connection::JoinAwaiter::await_ready() const noexcept {
+  return !writer_ || writer_.done();
+}
+
+std::coroutine_handle<> Http2Connection::JoinAwaiter::await_suspend(
+    std::coroutine_handle<> h) noexcept {
+  writer_.promise().continuation_ = h;
+  if (connection_.writerWaiting_) {
+    auto writer = connection_.writerWaiting_;
+    connection_.writerWaiting_ = {};
+    return writer;
+  }
+  return std::noop_coroutine();
+}
+
+Coroutine Http2Connection::ReadExact(char *destination, std::size_t size, bool &ok) {
+  ok = true;
+  while (size > 0) {
+    if (iterator_.Available() == 0) {
+      reading_ = false;
+      idle_ = running_ == 0 && streams_.empty();
+      Kick();
+      co_await iterator_.Ensure();
+      reading_ = true;
+      idle_ = false;
+    }
+    size_t available = iterator_.Available();
+    if (available == 0) {
+      ok = false;
+      co_return;
+    }
+    size_t take = std::min(available, size);
+    std::memcpy(destination, iterator_.CurrentPtr(), take);
+    iterator_.Advance(take);
+    destination += take;
+    size -= take;
+  }
+  co_return;
+}
+
+// All frames queued between two wakeups of the writer leave in a single write,
+// so responses of streams finished in the same read batch share one SQE.
+Coroutine Http2Connection::Writer() {
+  while (true) {
+    PumpData();
+    Settle();
+    if (outbox_.empty() || failed_) {
+      outbox_.clear();
+      if (joined_) {
+        co_return;
+      }
+      co_await WakeAwaiter{*this};
+      continue;
+    }
+    auto data = std::make_shared<std::string>(std::move(outbox_));
+    outbox_.clear();
+    size_t sent = 0;
+    while (!failed_ && sent < data->size()) {
+      size_t wrote = co_await ring_.WriteAsync(fd_, data, sent, data->size() - sent);
+      if (wrote == 0) {
+        failed_ = true;
+        (void)shutdown(fd_, SHUT_RDWR);
+      }
+      sent += wrote;
+    }
+  }
+}
+
+void Http2Connection::Kick() {
+  if (!reading_ && writerWaiting_) {
+    auto writer = writerWaiting_;
+    writerWaiting_ = {};
+    writer.resume();
+  }
+}
+
+void Http2Connection::Frame(std::uint8_t type, std::uint8_t flags, std::uint32_t stream,
+                            std::string_view payload) {
+  outbox_.push_back(static_cast<char>(payload.size() >> 16));
+  outbox_.push_back(static_cast<char>(payload.size() >> 8));
+  outbox_.push_back(static_cast<char>(payload.size()));
+  outbox_.push_back(static_cast<char>(type));
+  outbox_.push_back(static_cast<char>(flags));
+  put32(outbox_, stream & 0x7fffffff);
+  outbox_.append(payload);
+}
+
+void Http2Connection::GoAway(std::uint32_t code) {
+  if (goAway_) {
+    return;
+  }
+  goAway_ = true;
+  std::string payload;
+  // The id must not grow past the one sent when draining (RFC 9113, section 6.8).
+  put32(payload, draining_ ? drainStream_ : lastStream_);
+  put32(payload, code);
+  Frame(GOAWAY, 0, 0, payload);
+}
+
+void Http2Connection::Shutdown() {
+  if (draining_ || goAway_) {
+    return;
+  }
+  draining_ = true;
+  drainStream_ = lastStream_;
+  std::string payload;
+  put32(payload, drainStream_);
+  put32(payload, NO_ERROR);
+  Frame(GOAWAY, 0, 0, payload);
+  Kick();
+  Settle();
+}
+
+bool Http2Connection::Drained() const {
+  return draining_ && running_ == 0 && streams_.empty();
+}
+
+// Ends the read Serve is parked on once a draining session has answered every
+// stream; writes still go out, as after the shutdown in Writer.
+void Http2Connection::Settle() {
+  if (!reading_ && Drained()) {
+    (void)shutdown(fd_, SHUT_RD);
+  }
+}
+
+void Http2Connection::Reset(std::uint32_t id, std::uint32_t code) {
+  std::string payload;
+  put32(payload, code);
+  Frame(RST_STREAM, 0, id, payload);
+  if (auto it = streams_.find(id); it != streams_.end()) {
+    Release(it->second);
+    streams_.erase(it);
+  }
+}
+
+void Http2Connection::WindowUpdate(std::uint32_t id, std::uint32_t increment) {
+  std::string payload;
+  put32(payload, increment);
+  Frame(WINDOW_UPDATE, 0, id, payload);
+}
+
+// Connection credit is returned as DATA arrives while the buffered request
+// bodies fit in maxBodySize_; past that it is held back until a handler takes
+// its body or the stream is dropped.
+void Http2Connection::Credit(std::size_t length) {
+  receiveWindow_ += length;
+  if (buffered_ > maxBodySize_) {
+    withheld_ += length;
+    return;
+  }
+  length += std::exchange(withheld_, 0);
+  if (length > 0) {
+    WindowUpdate(0, length);
+  }
+}
+
+void Http2Connection::Release(Stream &stream) {
+  buffered_ -= stream.received;
+  stream.received = 0;
+  Credit(0);
+}
+
+// Answers before the request body is complete, then tells the peer to stop
+// sending it.
+void Http2Connection::Reject(std::uint32_t id, int status) {
+  Release(streams_.at(id));
+  Http2Response result;
+  result.response.status = status;
+  Respond(id, result);
+  std::string payload;
+  put32(payload, NO_ERROR);
+  Frame(RST_STREAM, 0, id, payload);
+}
+
+void Http2Connection::Queue(std::uint32_t id, Stream &stream) {
+  if (stream.pending && !stream.queued && stream.sendWindow > 0) {
+    stream.queued = true;
+    ready_.push_back(id);
+  }
+}
+
+// Streams with response data take turns one frame at a time, limited by the
+// connection and per-stream send windows.
+void Http2Connection::PumpData() {
+  while (!ready_.empty() && sendWindow_ > 0 && outbox_.size() < kMaxOutbox && !failed_) {
+    auto id = ready_.front();
+    ready_.pop_front();
+    auto it = streams_.find(id);
+    if (it == streams_.end()) {
+      continue;
+    }
+    auto &stream = it->second;
+    auto remaining = static_cast<std::int64_t>(stream.pending->size() - stream.pendingOffset);
+    auto chunk = std::min({remaining, static_cast<std::int64_t>(maxFrame_), stream.sendWindow,
+                           sendWindow_});
+    if (chunk <= 0) {
+      stream.queued = false;
+      continue;
+    }
+    bool last = chunk == remaining;
+    Frame(DATA, last ? END_STREAM : 0, id,
+          std::string_view(*stream.pending).substr(stream.pendingOffset, chunk));
+    stream.pendingOffset += chunk;
+    stream.sendWindow -= chunk;
+    sendWindow_ -= chunk;
+    if (last) {
+      streams_.erase(it);
+    } else {
+      ready_.push_back(id);
+    }
+  }
+}
+
+bool Http2Connection::ApplySettings(std::string_view payload) {
+  if (payload.size() % 6 != 0) {
+    GoAway(FRAME_SIZE_ERROR);
+    return false;
+  }
+  for (size_t offset = 0; offset < payload.size(); offset += 6) {
+    auto id = static_cast<std::uint16_t>(
+        (static_cast<unsigned char>(payload[offset]) << 8) |
+        static_cast<unsigned char>(payload[offset + 1]));
+    std::uint32_t value = read32(payload.data() + offset + 2);
+    switch (id) {
+    case ENABLE_PUSH:
+      if (value > 1) {
+        GoAway(PROTOCOL_ERROR);
+        return false;
+      }
+      break;
+    case INITIAL_WINDOW_SIZE: {
+      if (value > kMaxWindow) {
+        GoAway(FLOW_CONTROL_ERROR);
+        return false;
+      }
+      std::int64_t delta = static_cast<std::int64_t>(value) - initialWindow_;
+      initialWindow_ = value;
+      for (auto &[streamID, stream] : streams_) {
+        stream.sendWindow += delta;
+        Queue(streamID, stream);
+      }
+      break;
+    }
+    case MAX_FRAME_SIZE:
+      if (value < kMaxFrame || value > 0xffffff) {
+        GoAway(PROTOCOL_ERROR);
+        return false;
+      }
+      maxFrame_ = value;
+      break;
+    default:
+      break;
+    }
+  }
+  return true;
+}
+
+void Http2Connection::HandleHeaders(std::uint32_t id, bool endStream) {
+  std::vector<HeaderField> fields;
+  bool decoded = decoder_.Decode(headerBlock_, fields);
+  headerBlock_.clear();
+  if (!decoded) {
+    GoAway(COMPRESSION_ERROR);
+    return;
+  }
+  auto it = streams_.find(id);
+  if (it != streams_.end()) {
+    if (it->second.remoteClosed) {
+      Reset(id, STREAM_CLOSED);
+    } else if (!endStream) {
+      Reset(id, PROTOCOL_ERROR);
+    } else {
+      it->second.remoteClosed = true;
+      Dispatch(id);
+    }
+    return;
+  }
+  if (id % 2 == 0 || id <= lastStream_) {
+    GoAway(PROTOCOL_ERROR);
+    return;
+  }
+  lastStream_ = id;
+  if (draining_ || streams_.size() >= kMaxStreams) {
+    Reset(id, REFUSED_STREAM);
+    return;
+  }
+  auto &stream = streams_[id];
+  stream.sendWindow = initialWindow_;
+  stream.receiveWindow = kReceiveWindow;
+  bool hasMethod = false;
+  bool regular = false;
+  for (auto &[name, value] : fields) {
+    if (name.starts_with(':')) {
+      if (regular) {
+        stream.valid = false;
+      } else if (name == ":method") {
+        hasMethod = true;
+        if (value == "GET") {
+          stream.request.method = GET;
+        } else if (value == "POST") {
+          stream.request.method = POST;
+        } else if (value == "PUT") {
+          stream.request.method = PUT;
+        } else if (value == "PATCH") {
+          stream.request.method = PATCH;
+        } else if (value == "DELETE") {
+          stream.request.method = DELETE;
+        } else {
+          stream.valid = false;
+        }
+      } else if (name == ":path") {
+        stream.target = std::move(value);
+      } else if (name == ":authority") {
+        stream.request.knownHeaders[HOST] = value;
+        stream.request.headers["host"] = std::move(value);
+      } else if (name != ":scheme") {
+        stream.valid = false;
+      }
+      continue;
+    }
+    regular = true;
+    auto [header, inserted] = stream.request.headers.try_emplace(std::pmr::string(name), value);
+    if (!inserted) {
+      header->second += name == "cookie" ? "; " : ", ";
+      header->second += value;
+    }
+    if (auto known = LookupHeader(name)) {
+      stream.request.knownHeaders[*known] = header->second;
+    }
+  }
+  if (!hasMethod || stream.target.empty()) {
+    stream.valid = false;
+  }
+  if (endStream) {
+    stream.remoteClosed = true;
+    Dispatch(id);
+  }
+}
+
+void Http2Connection::HandleFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t id,
+                                  std::string_view payload) {
+  if (continuationStream_ != 0 && (type != CONTINUATION || id != continuationStream_)) {
+    GoAway(PROTOCOL_ERROR);
+    return;
+  }
+  switch (type) {
+  case DATA: {
+    std::size_t flowLength = payload.size();
+    if (id == 0 || !stripPadding(flags, payload)) {
+      GoAway(PROTOCOL_ERROR);
+      return;
+    }
+    if (static_cast<std::int64_t>(flowLength) > receiveWindow_) {
+      GoAway(FLOW_CONTROL_ERROR);
+      return;
+    }
+    receiveWindow_ -= flowLength;
+    auto it = streams_.find(id);
+    if (it == streams_.end() || it->second.remoteClosed) {
+      Credit(flowLength);
+      if (id > lastStream_) {
+        GoAway(PROTOCOL_ERROR);
+      } else {
+        Reset(id, STREAM_CLOSED);
+      }
+      return;
+    }
+    auto &stream = it->second;
+    Credit(flowLength);
+    if (static_cast<std::int64_t>(flowLength) > stream.receiveWindow) {
+      Reset(id, FLOW_CONTROL_ERROR);
+      return;
+    }
+    stream.receiveWindow -= flowLength;
+    if (payload.size() > maxBodySize_ - stream.request.body.size()) {
+      Reject(id, 413);
+      return;
+    }
+    stream.request.body.append(payload);
+    stream.received += flowLength;
+    buffered_ += flowLength;
+    if (flags & END_STREAM) {
+      stream.remoteClosed = true;
+      Dispatch(id);
+    } else if (flowLength > 0) {
+      stream.receiveWindow += flowLength;
+      WindowUpdate(id, flowLength);
+    }
+    return;
+  }
+  case HEADERS: {
+    if (id == 0 || !stripPadding(flags, payload)) {
+      GoAway(PROTOCOL_ERROR);
+      return;
+    }
+    if (flags & PRIORITY_FLAG) {
+      if (payload.size() < 5) {
+        GoAway(FRAME_SIZE_ERROR);
+        return;
+      }
+      payload.remove_prefix(5);
+    }
+    headerBlock_.assign(payload);
+    continuationEndStream_ = flags & END_STREAM;
+    if (flags & END_HEADERS) {
+      HandleHeaders(id, continuationEndStream_);
+    } else {
+      continuationStream_ = id;
+    }
+    return;
+  }
+  case CONTINUATION:
+    if (continuationStream_ == 0) {
+      GoAway(PROTOCOL_ERROR);
+      return;
+    }
+    if (headerBlock_.size() + payload.size() > kMaxHeaderBlock) {
+      GoAway(ENHANCE_YOUR_CALM);
+      return;
+    }
+    headerBlock_.append(payload);
+    if (flags & END_HEADERS) {
+      continuationStream_ = 0;
+      HandleHeaders(id, continuationEndStream_);
+    }
+    return;
+  case PRIORITY:
+    if (id == 0 || payload.size() != 5) {
+      GoAway(PROTOCOL_ERROR);
+    }
+    return;
+  case RST_STREAM:
+    if (id == 0 || payload.size() != 4) {
+      GoAway(PROTOCOL_ERROR);
+      return;
+    }
+    if (auto it = streams_.find(id); it != streams_.end()) {
+      Release(it->second);
+      streams_.erase(it);
+    }
+    return;
+  case SETTINGS:
+    if (id != 0) {
+      GoAway(PROTOCOL_ERROR);
+      return;
+    }
+    if (flags & ACK) {
+      return;
+    }
+    if (ApplySettings(payload)) {
+      Frame(SETTINGS, ACK, 0, {});
+    }
+    return;
+  case PUSH_PROMISE:
+    GoAway(PROTOCOL_ERROR);
+    return;
+  case PING:
+    if (id != 0 || payload.size() != 8) {
+      GoAway(id != 0 ? PROTOCOL_ERROR : FRAME_SIZE_ERROR);
+      return;
+    }
+    if (!(flags & ACK)) {
+      Frame(PING, ACK, 0, payload);
+    }
+    return;
+  case WINDOW_UPDATE: {
+    if (payload.size() != 4) {
+      GoAway(FRAME_SIZE_ERROR);
+      return;
+    }
+    std::uint32_t increment = read32(payload.data()) & 0x7fffffff;
+    if (id == 0) {
+      sendWindow_ += increment;
+      if (increment == 0 || sendWindow_ > kMaxWindow) {
+        GoAway(increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+      }
+      return;
+    }
+    auto it = streams_.find(id);
+    if (it == streams_.end()) {
+      return;
+    }
+    it->second.sendWindow += increment;
+    if (increment == 0 || it->second.sendWindow > kMaxWindow) {
+      Reset(id, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+      return;
+    }
+    Queue(id, it->second);
+    return;
+  }
+  default:
+    return;
+  }
+}
+
+void Http2Connection::Dispatch(std::uint32_t id) {
+  auto &stream = streams_[id];
+  // A declared length that disagrees with the DATA received makes the
+  // request malformed (RFC 9113, section 8.1.1).
+  if (auto length = stream.request.Header(CONTENT_LENGTH);
+      length && *length != std::to_string(stream.request.body.size())) {
+    Reset(id, PROTOCOL_ERROR);
+    return;
+  }
+  stream.dispatched = true;
+  Release(stream);
+  tasks_.erase(std::remove_if(tasks_.begin(), tasks_.end(),
+                              [](const Coroutine &c) { return !c || c.done(); }),
+               tasks_.end());
+  tasks_.push_back(RunStream(id));
+  tasks_.back().resume();
+}
+
+Coroutine Http2Connection::RunStream(std::uint32_t id) {
+  running_++;
+  RequestData request;
+  std::string target;
+  bool valid;
+  {
+    auto &stream = streams_.at(id);
+    request = std::move(stream.request);
+    target = std::move(stream.target);
+    valid = stream.valid;
+  }
+  Http2Response result;
+  if (valid) {
+    try {
+      co_await handler_(request, target, result);
+    } catch (...) {
+      result = Http2Response{};
+      result.response.status = 500;
+      result.response.body = "Internal server error";
+    }
+  } else {
+    result.response.status = 400;
+    result.response.body = "Invalid request";
+  }
+  running_--;
+  Respond(id, result);
+  co_return;
+}
+
+void Http2Connection::Respond(std::uint32_t id, Http2Response &result) {
+  auto it = streams_.find(id);
+  if (it == streams_.end() || failed_) {
+    return;
+  }
+  const ResponseData &data = result.cached ? *result.cached : result.response;
+  std::shared_ptr<std::string> body = std::move(result.body);
+  if (!data.body.empty()) {
+    if (body) {
+      auto combined = std::make_shared<std::string>(data.body);
+      combined->append(*body);
+      body = std::move(combined);
+    } else if (result.cached) {
+      body = std::make_shared<std::string>(data.body);
+    } else {
+      body = std::make_shared<std::string>(std::move(result.response.body));
+    }
+  }
+  std::string block;
+  HpackEncoder::EncodeStatus(data.status, block);
+  bool hasLength = false;
+  bool hasDate = false;
+  bool hasServer = false;
+  for (const auto &[name, value] : data.headers) {
+    if (connectionSpecific(name)) {
+      continue;
+    }
+    hasLength = hasLength || iequals(name, "content-length");
+    hasDate = hasDate || iequals(name, "date");
+    hasServer = hasServer || iequals(name, "server");
+    HpackEncoder::Encode(name, value, block);
+  }
+  if (!hasDate) {
+    HpackEncoder::Encode("date", date_.Date(), block);
+  }
+  if (!hasServer) {
+    HpackEncoder::Encode("server", DateHeader::ServerName(), block);
+  }
+  std::size_t length = body ? body->size() : 0;
+  if (!hasLength && data.status != 304) {
+    HpackEncoder::Encode("content-length", std::to_string(length), block);
+  }
+  bool endStream = length == 0;
+  std::size_t offset = 0;
+  do {
+    std::size_t chunk = std::min(maxFrame_, block.size() - offset);
+    std::uint8_t flags = offset + chunk == block.size() ? END_HEADERS : 0;
+    if (offset == 0 && endStream) {
+      flags |= END_STREAM;
+    }
+    Frame(offset == 0 ? HEADERS : CONTINUATION, flags, id,
+          std::string_view(block).substr(offset, chunk));
+    offset += chunk;
+  } while (offset < block.size());
+  if (endStream) {
+    streams_.erase(it);
+  } else {
+    it->second.pending = std::move(body);
+    it->second.pendingOffset = 0;
+    Queue(id, it->second);
+  }
+  Kick();
+}
+
+Coroutine Http2Connection::Serve(std::string_view upgradeSettings, Http2Response *upgraded) {
+  Coroutine writer = Writer();
+  writer.resume();
+  std::string settings;
+  put16(settings, MAX_CONCURRENT_STREAMS);
+  put32(settings, kMaxStreams);
+  put16(settings, INITIAL_WINDOW_SIZE);
+  put32(settings, kReceiveWindow);
+  put16(settings, ENABLE_PUSH);
+  put32(settings, 0);
+  Frame(SETTINGS, 0, 0, settings);
+  WindowUpdate(0, kReceiveWindow - 65535);
+
+  bool ok = true;
+  if (upgraded) {
+    std::string decoded;
+    ok = base64UrlDecode(upgradeSettings, decoded) && ApplySettings(decoded);
+    if (ok) {
+      auto &stream = streams_[1];
+      stream.remoteClosed = true;
+      stream.dispatched = true;
+      stream.sendWindow = initialWindow_;
+      lastStream_ = 1;
+      Respond(1, *upgraded);
+    }
+  }
+  // Upgraded after Drain shut the others down.
+  if (stop_.load()) {
+    Shutdown();
+  }
+  char preface[kPreface.size()];
+  if (ok) {
+    co_await ReadExact(preface, sizeof(preface), ok);
+  }
+  if (ok && std::string_view(preface, sizeof(preface)) != kPreface) {
+    GoAway(PROTOCOL_ERROR);
+  }
+  std::string payload;
+  while (ok && !goAway_ && !Drained()) {
+    char header[9];
+    co_await ReadExact(header, sizeof(header), ok);
+    if (!ok) {
+      break;
+    }
+    auto *u = reinterpret_cast<unsigned char *>(header);
+    std::size_t length = (std::size_t(u[0]) << 16) | (std::size_t(u[1]) << 8) | u[2];
+    std::uint32_t id = read32(header + 5) & 0x7fffffff;
+    if (length > kMaxFrame) {
+      GoAway(FRAME_SIZE_ERROR);
+      break;
+    }
+    payload.resize(length);
+    co_await ReadExact(payload.data(), length, ok);
+    if (ok) {
+      HandleFrame(u[3], u[4], id, payload);
+    }
+    // The HTTP/1.1 side answers with Connection: close from this point on;
+    // Drain reaches the sessions parked on a read.
+    if (stop_.load(std::memory_order_relaxed)) {
+      Shutdown();
+    }
+    // A peer that keeps sending PINGs, SETTINGS or requests without reading
+    // the replies would otherwise grow the outbox without bound.
+    if (outbox_.size() > kMaxOutbox + kMaxControlOutbox) {
+      GoAway(ENHANCE_YOUR_CALM);
+    }
+  }
+  reading_ = false;
+  for (auto &task : tasks_) {
+    co_await task;
+  }
+  joined_ = true;
+  co_await JoinAwaiter{*this, writer};
+  co_return;
+}
+} // namespace HTTP
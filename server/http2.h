@@ -0,0 +1,124 @@
+#pragma once
+#include "coroutine.h"
+#include "date_header.h"
+#include "hpack.h"
+#include "io_uring.h"
+#include "read_iterator.h"
+#include "request_data.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+namespace HTTP {
+struct Http2Response {
+  ResponseData response;
+  const ResponseData *cached{nullptr};
+  // Keeps cached valid until the response is encoded.
+  std::shared_ptr<const void> owner;
+  std::shared_ptr<std::string> body;
+};
+using Http2Handler =
+    std::function<Coroutine(RequestData &, std::string_view target, Http2Response &)>;
+class Http2Connection {
+  struct Stream {
+    RequestData request;
+    std::string target;
+    bool valid{true};
+    bool remoteClosed{false};
+    bool dispatched{false};
+    std::int64_t sendWindow{0};
+    std::int64_t receiveWindow{0};
+    // Flow-controlled bytes held in request.body until the handler takes it.
+    std::size_t received{0};
+    std::shared_ptr<std::string> pending;
+    std::size_t pendingOffset{0};
+    bool queued{false};
+  };
+  struct WakeAwaiter {
+    Http2Connection &connection_;
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> h) noexcept;
+    void await_resume() const noexcept {}
+  };
+  struct JoinAwaiter {
+    Http2Connection &connection_;
+    Coroutine &writer_;
+    bool await_ready() const noexcept;
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) noexcept;
+    void await_resume() const noexcept {}
+  };
+
+  IOUring &ring_;
+  ReadIterator &iterator_;
+  int fd_;
+  bool &idle_;
+  const std::atomic_bool &stop_;
+  const DateHeader &date_;
+  std::size_t maxBodySize_;
+  Http2Handler handler_;
+  HpackDecoder decoder_;
+  std::unordered_map<std::uint32_t, Stream> streams_;
+  std::deque<std::uint32_t> ready_;
+  std::vector<Coroutine> tasks_;
+  std::string headerBlock_;
+  std::uint32_t continuationStream_{0};
+  bool continuationEndStream_{false};
+  std::uint32_t lastStream_{0};
+  // Last stream named in the NO_ERROR GOAWAY; later ones are refused.
+  std::uint32_t drainStream_{0};
+  std::int64_t sendWindow_{65535};
+  std::int64_t initialWindow_{65535};
+  std::int64_t receiveWindow_{65535};
+  // Request body bytes buffered across undispatched streams, and connection
+  // window credit held back while that exceeds maxBodySize_.
+  std::size_t buffered_{0};
+  std::size_t withheld_{0};
+  std::size_t maxFrame_{16384};
+  std::string outbox_;
+  std::coroutine_handle<> writerWaiting_{};
+  std::size_t running_{0};
+  bool reading_{false};
+  bool joined_{false};
+  bool failed_{false};
+  bool goAway_{false};
+  bool draining_{false};
+
+  Coroutine ReadExact(char *destination, std::size_t size, bool &ok);
+  Coroutine Writer();
+  Coroutine RunStream(std::uint32_t id);
+  void Frame(std::uint8_t type, std::uint8_t flags, std::uint32_t stream,
+             std::string_view payload);
+  void Kick();
+  void PumpData();
+  void GoAway(std::uint32_t code);
+  bool Drained() const;
+  void Settle();
+  void Reset(std::uint32_t id, std::uint32_t code);
+  void WindowUpdate(std::uint32_t id, std::uint32_t increment);
+  void Credit(std::size_t length);
+  void Release(Stream &stream);
+  void Reject(std::uint32_t id, int status);
+  void Queue(std::uint32_t id, Stream &stream);
+  bool ApplySettings(std::string_view payload);
+  void HandleHeaders(std::uint32_t id, bool endStream);
+  void HandleFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t id,
+                   std::string_view payload);
+  void Dispatch(std::uint32_t id);
+  void Respond(std::uint32_t id, Http2Response &result);
+
+public:
+  Http2Connection(IOUring &ring, ReadIterator &iterator, int fd, bool &idle,
+                  const std::atomic_bool &stop, const DateHeader &date, std::size_t maxBodySize,
+                  Http2Handler handler);
+  Coroutine Serve(std::string_view upgradeSettings = {}, Http2Response *upgraded = nullptr);
+  // Sends GOAWAY(NO_ERROR), refuses new streams and ends Serve once the
+  // running ones are answered.
+  void Shutdown();
+};
+bool Http2Preface(std::string_view data);
+} // namespace HTTP
@@ -3,3 +3,58 @@
 using namespace HTTP;
 HTTPError::HTTPError(int status, std::string_view message)
     : status(status), message(message) {}
+
+CannedResponse::CannedResponse(int status, std::string_view reason, std::string_view body,
+                               std::string_view headers)
+    : bodySize(body.size()) {
+  std::string head = "HTTP/1.1 " + std::to_string(status) + " " + std::string(reason) +
+                     "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n" +
+                     std::string(headers);
+  std::string rest = "\r\n" + std::string(body);
+  keepAlive = std::make_shared<std::string>(head + "Connection: keep-alive\r\n" + rest);
+  close = std::make_shared<std::string>(head + "Connection: close\r\n" + rest);
+}
+
+const CannedResponse *HTTP::CannedError(int status) {
+  static const CannedResponse badRequest(400, "Bad Request", "Invalid request");
+  static const CannedResponse notFound(404, "Not Found", "Not found");
+  static const CannedResponse methodNotAllowed(405, "Method Not Allowed", "Method not allowed");
+  static const CannedResponse lengthRequired(411, "Length Required", "Content-Length required");
+  static const CannedResponse payloadTooLarge(413, "Content Too Large", "Request body too large");
+  static const CannedResponse uriTooLong(414, "URI Too Long", "Too many path parameters");
+  static const CannedResponse unsupportedMediaType(415, "Unsupported Media Type",
+                                                   "Unsupported form encoding");
+  static const CannedResponse headersTooLarge(431, "Request Header Fields Too Large",
+                                              "Request headers too large");
+  static const CannedResponse notImplemented(501, "Not Implemented",
+                                             "Transfer-Encoding not supported");
+  static const CannedResponse tooManyRequests(429, "Too Many Requests", "", "Retry-After: 1\r\n");
+  static const CannedResponse serviceUnavailable(503, "Service Unavailable", "",
+                                                 "Retry-After: 1\r\n");
+  switch (status) {
+  case 400:
+    return &badRequest;
+  case 404:
+    return &notFound;
+  case 405:
+    return &methodNotAllowed;
+  case 411:
+    return &lengthRequired;
+  case 413:
+    return &payloadTooLarge;
+  case 414:
+    return &uriTooLong;
+  case 415:
+    return &unsupportedMediaType;
+  case 429:
+    return &tooManyRequests;
+  case 431:
+    return &headersTooLarge;
+  case 501:
+    return &notImplemented;
+  case 503:
+    return &serviceUnavailable;
+  default:
+    return nullptr;
+  }
+}
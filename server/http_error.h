@@ -1,5 +1,7 @@
 #pragma once
 #include <exception>
+#include <memory>
+#include <string>
 #include <string_view>
 namespace HTTP {
 class HTTPError : public std::exception {
@@ -8,4 +10,40 @@ public:
   const int status;
   HTTPError(int status, std::string_view message);
 };
+
+// An error response serialized once, in a keep-alive and a close variant, and
+// written as is.
+struct CannedResponse {
+  std::shared_ptr<std::string> keepAlive;
+  std::shared_ptr<std::string> close;
+  std::size_t bodySize;
+  CannedResponse(int status, std::string_view reason, std::string_view body,
+                 std::string_view headers = {});
+  const std::shared_ptr<std::string> &Get(bool open) const { return open ? keepAlive : close; }
+};
+
+// The shared response for 400, 404, 405, 411, 413, 414, 415, 429, 431, 501
+// and 503, or nullptr.
+const CannedResponse *CannedError(int status);
+
+// Outcome of a parse or routing step. These steps run for every request, so
+// they report failures here instead of throwing HTTPError; a default Status
+// means success.
+struct Status {
+  int code{0};
+  std::string_view message;
+  // For 405: the methods the path does accept, and the route's own response.
+  std::string_view allow;
+  const CannedResponse *canned{nullptr};
+
+  Status() = default;
+  Status(int code, std::string_view message, std::string_view allow = {},
+         const CannedResponse *canned = nullptr)
+      : code(code), message(message), allow(allow), canned(canned) {}
+
+  bool Ok() const { return code == 0; }
+  // The request line was read in full, so the connection stays in step with
+  // the client once the headers and body are consumed.
+  bool Recoverable() const { return code == 404 || code == 405 || code == 429 || code == 503; }
+};
 } // namespace HTTP
@@ -7,12 +7,38 @@
 #include <optional>
 #include <stdexcept>
 #include <linux/errno.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace HTTP {
 
+thread_local IOUring *IOUring::current_ = nullptr;
+
 IOUring::~IOUring() {
+  if (current_ == this) {
+    current_ = nullptr;
+  }
   stopToken_ = true;
+  if (inProcess_ > 0) {
+    CancelAll();
+    struct __kernel_timespec ts = {.tv_sec = 0, .tv_nsec = 10000000};
+    while (inProcess_ > 0) {
+      io_uring_cqe *cqEntry;
+      if (io_uring_wait_cqe_timeout(&ring_, &cqEntry, &ts) < 0 || !cqEntry) {
+        break;
+      }
+      delete (SqeData *)io_uring_cqe_get_data(cqEntry);
+      io_uring_cqe_seen(&ring_, cqEntry);
+      inProcess_--;
+    }
+  }
+  for (auto *sqeData : freeSqes_) {
+    delete sqeData;
+  }
   io_uring_queue_exit(&ring_);
+  close(wakeFD_);
 }
 
 IOUring::IOUring() {
@@ -20,36 +46,77 @@ IOUring::IOUring() {
   if (ret < 0) {
     throw std::runtime_error("Failed to initialize io_uring");
   }
+  wakeFD_ = eventfd(0, EFD_CLOEXEC);
+  if (wakeFD_ < 0) {
+    io_uring_queue_exit(&ring_);
+    throw std::runtime_error("Failed to create eventfd");
+  }
+}
+
+IOUring::SqeData *IOUring::AcquireSqe(Entry &entry) {
+  if (freeSqes_.empty()) {
+    return new SqeData{entry.fd,          entry.type,         entry.coro,
+                       std::move(entry.writeData), entry.writeOffset, entry.writeLen,
+                       entry.traceRequest, entry.traceSequence};
+  }
+  SqeData *sqeData = freeSqes_.back();
+  freeSqes_.pop_back();
+  *sqeData = SqeData{entry.fd,          entry.type,         entry.coro,
+                     std::move(entry.writeData), entry.writeOffset, entry.writeLen,
+                     entry.traceRequest, entry.traceSequence};
+  return sqeData;
+}
+
+void IOUring::ReleaseSqe(SqeData *sqeData) {
+  sqeData->writeData.reset();
+  freeSqes_.push_back(sqeData);
 }
 
 void IOUring::AddEntries() {
   size_t fdsSize = 0;
-  for (int count = 0; count < QUEUE_DEPTH && !queue_.empty(); count++) {
-    auto entry = std::move(queue_.front());
-    queue_.pop_front();
-    
+  for (int count = 0; count < QUEUE_DEPTH && queueHead_ < queue_.size(); count++) {
     auto sqEntry = io_uring_get_sqe(&ring_);
     if (sqEntry == nullptr) {
-      queue_.push_front(std::move(entry));
       break;
     }
-    
-    SqeData *sqeData = new SqeData{
-        entry.fd, entry.type, entry.coro, std::move(entry.writeData), entry.writeOffset,
-        entry.writeLen};
+    Entry &entry = queue_[queueHead_++];
+    SqeData *sqeData = AcquireSqe(entry);
     
     if (entry.type == IOUring::READ) [[likely]] {
       io_uring_prep_read(sqEntry, entry.fd, entry.toRead.value(), 256, 0);
     } else if (entry.type == IOUring::ACCEPT) {
-      io_uring_prep_accept(sqEntry, entry.fd, nullptr, nullptr, 0);
+      io_uring_prep_accept(sqEntry, entry.fd, entry.peer, entry.peerLength, 0);
+    } else if (entry.type == IOUring::CONNECT) {
+      io_uring_prep_connect(sqEntry, entry.fd, entry.address, entry.addressLength);
+    } else if (entry.type == IOUring::SPLICE) {
+      io_uring_prep_splice(sqEntry, entry.spliceFrom, -1, entry.fd, -1, entry.writeLen, 0);
+    } else if (entry.type == IOUring::FILE) {
+      PrepareFile(sqEntry, entry.file);
+    } else if (entry.type == IOUring::WAKE) {
+      io_uring_prep_read(sqEntry, entry.fd, &wakeValue_, sizeof(wakeValue_), 0);
+    } else if (entry.type == IOUring::CANCEL) {
+      if (entry.fd >= 0) {
+        io_uring_prep_cancel_fd(sqEntry, entry.fd, IORING_ASYNC_CANCEL_ALL);
+      } else {
+        io_uring_prep_cancel(sqEntry, nullptr, IORING_ASYNC_CANCEL_ANY);
+      }
     } else {
       const char *ptr = sqeData->writeData->data() + sqeData->writeOffset;
       io_uring_prep_write(sqEntry, entry.fd, ptr, sqeData->writeLen, 0);
     }
     io_uring_sqe_set_data(sqEntry, sqeData);
+    if (sqeData->traceRequest != 0) [[unlikely]] {
+      tracer_->Record(sqeData->traceRequest, TRACE_SUBMIT, Tracer::Now(),
+                      sqeData->traceSequence, sqeData->opType);
+    }
     fdsSize++;
   }
+  if (queueHead_ == queue_.size()) {
+    queue_.clear();
+    queueHead_ = 0;
+  }
   if (fdsSize > 0) {
+    syscalls_++;
     int submitResult = io_uring_submit(&ring_);
     if (submitResult >= 0) {
       inProcess_ += fdsSize;
@@ -58,18 +125,32 @@ void IOUring::AddEntries() {
 }
 
 void IOUring::Poll() {
+  current_ = this;
   try {
+    if (!wakeArmed_) {
+      Entry entry;
+      entry.type = IOUring::WAKE;
+      entry.fd = wakeFD_;
+      queue_.push_back(entry);
+      wakeArmed_ = true;
+    }
+    if (hasPosted_.load(std::memory_order_acquire)) {
+      ResumePosted();
+    }
     AddEntries();
     
     if (inProcess_ > 0) {
       ProcessCalls();
     }
     
-    if (!queue_.empty()) {
+    if (queueHead_ < queue_.size()) {
       AddEntries();
     }
     
-    io_uring_submit(&ring_);
+    if (io_uring_sq_ready(&ring_) > 0) {
+      syscalls_++;
+      io_uring_submit(&ring_);
+    }
     
   } catch (const std::exception &e) {
     std::cerr << "[Poll] Exception: " << e.what() << std::endl;
@@ -77,6 +158,16 @@ void IOUring::Poll() {
   }
 }
 
+void IOUring::Enqueue(Entry &&entry) {
+  if (traceRequest_ != 0) [[unlikely]] {
+    entry.traceRequest = traceRequest_;
+    entry.traceSequence = tracer_->NextSequence();
+    tracer_->Record(traceRequest_, TRACE_ENQUEUE, Tracer::Now(), entry.traceSequence,
+                    entry.type);
+  }
+  queue_.push_back(std::move(entry));
+}
+
 void IOUring::Write(int fileDescriptor, std::shared_ptr<std::string> data, size_t offset,
                     size_t len, std::coroutine_handle<> coro) {
   if (fileDescriptor < 0) {
@@ -89,7 +180,7 @@ void IOUring::Write(int fileDescriptor, std::shared_ptr<std::string> data, size_
   entry.writeOffset = offset;
   entry.writeLen = len;
   entry.coro = coro;
-  queue_.push_back(std::move(entry));
+  Enqueue(std::move(entry));
   AddEntries();
 }
 
@@ -102,7 +193,7 @@ void IOUring::Read(int fileDescriptor, std::array<char, 256> &buffer, std::corou
   entry.fd = fileDescriptor;
   entry.toRead = buffer.begin();
   entry.coro = coro;
-  queue_.push_back(entry);
+  Enqueue(std::move(entry));
 }
 
 ReadAwaiter IOUring::ReadAsync(int fileDescriptor, std::array<char, 256> &buffer) {
@@ -116,7 +207,11 @@ void ReadAwaiter::await_suspend(std::coroutine_handle<> h) {
 
 void AcceptAwaiter::await_suspend(std::coroutine_handle<> h) {
   coro_ = std::coroutine_handle<Promise>::from_address(h.address());
-  ring_.Accept(fd_, h);
+  if (peer_ != nullptr) {
+    ring_.Accept(fd_, h, reinterpret_cast<sockaddr *>(peer_), &peerLength_);
+  } else {
+    ring_.Accept(fd_, h);
+  }
 }
 
 void WriteAwaiter::await_suspend(std::coroutine_handle<> h) {
@@ -124,20 +219,226 @@ void WriteAwaiter::await_suspend(std::coroutine_handle<> h) {
   ring_.Write(fd_, std::move(data_), offset_, len_, h);
 }
 
-void IOUring::Accept(int fileDescriptor, std::coroutine_handle<> coro) {
+void IOUring::Accept(int fileDescriptor, std::coroutine_handle<> coro, sockaddr *peer,
+                     socklen_t *peerLength) {
   if (fileDescriptor < 0) {
     throw std::runtime_error("Invalid file descriptor");
   }
   Entry entry;
   entry.type = IOUring::ACCEPT;
   entry.fd = fileDescriptor;
+  entry.peer = peer;
+  entry.peerLength = peerLength;
   entry.coro = coro;
-  queue_.push_back(entry);
+  Enqueue(std::move(entry));
   AddEntries();
 }
 
-AcceptAwaiter IOUring::AcceptAsync(int fileDescriptor) {
-  return AcceptAwaiter(*this, fileDescriptor);
+void IOUring::Connect(int fileDescriptor, const sockaddr *address, socklen_t length,
+                      std::coroutine_handle<> coro) {
+  if (fileDescriptor < 0) {
+    throw std::runtime_error("Invalid file descriptor");
+  }
+  Entry entry;
+  entry.type = IOUring::CONNECT;
+  entry.fd = fileDescriptor;
+  entry.address = address;
+  entry.addressLength = length;
+  entry.coro = coro;
+  Enqueue(std::move(entry));
+  AddEntries();
+}
+
+ConnectAwaiter IOUring::ConnectAsync(int fileDescriptor, const sockaddr *address,
+                                     socklen_t length) {
+  return ConnectAwaiter(*this, fileDescriptor, address, length);
+}
+
+void ConnectAwaiter::await_suspend(std::coroutine_handle<> h) {
+  coro_ = std::coroutine_handle<Promise>::from_address(h.address());
+  ring_.Connect(fd_, address_, length_, h);
+}
+
+void IOUring::Splice(int from, int to, size_t len, std::coroutine_handle<> coro) {
+  if (from < 0 || to < 0) {
+    throw std::runtime_error("Invalid file descriptor");
+  }
+  Entry entry;
+  entry.type = IOUring::SPLICE;
+  entry.fd = to;
+  entry.spliceFrom = from;
+  entry.writeLen = len;
+  entry.coro = coro;
+  Enqueue(std::move(entry));
+  AddEntries();
+}
+
+SpliceAwaiter IOUring::SpliceAsync(int from, int to, size_t len) {
+  return SpliceAwaiter(*this, from, to, len);
+}
+
+void SpliceAwaiter::await_suspend(std::coroutine_handle<> h) {
+  coro_ = std::coroutine_handle<Promise>::from_address(h.address());
+  ring_.Splice(from_, to_, len_, h);
+}
+
+void IOUring::PrepareFile(io_uring_sqe *sqEntry, const FileRequest &file) {
+  switch (file.op) {
+  case FileRequest::OPEN:
+    io_uring_prep_openat(sqEntry, AT_FDCWD, file.path, file.flags, file.mode);
+    break;
+  case FileRequest::READ:
+    if (file.bufferIndex >= 0) {
+      io_uring_prep_read_fixed(sqEntry, file.fd, file.buffer, file.length, file.offset,
+                               file.bufferIndex);
+    } else {
+      io_uring_prep_read(sqEntry, file.fd, file.buffer, file.length, file.offset);
+    }
+    break;
+  case FileRequest::WRITE:
+    if (file.bufferIndex >= 0) {
+      io_uring_prep_write_fixed(sqEntry, file.fd, file.buffer, file.length, file.offset,
+                                file.bufferIndex);
+    } else {
+      io_uring_prep_write(sqEntry, file.fd, file.buffer, file.length, file.offset);
+    }
+    break;
+  case FileRequest::FSYNC:
+    io_uring_prep_fsync(sqEntry, file.fd, static_cast<unsigned>(file.flags));
+    break;
+  case FileRequest::STATX:
+    io_uring_prep_statx(sqEntry, file.fd >= 0 ? file.fd : AT_FDCWD, file.path, file.flags,
+                        file.mode, static_cast<struct statx *>(file.buffer));
+    break;
+  case FileRequest::CLOSE:
+    io_uring_prep_close(sqEntry, file.fd);
+    break;
+  }
+}
+
+void IOUring::File(const FileRequest &request, std::coroutine_handle<> coro) {
+  Entry entry;
+  entry.type = IOUring::FILE;
+  entry.fd = request.fd;
+  entry.file = request;
+  entry.coro = coro;
+  Enqueue(std::move(entry));
+  AddEntries();
+}
+
+FileAwaiter IOUring::FileAsync(const FileRequest &request) { return FileAwaiter(*this, request); }
+
+void FileAwaiter::await_suspend(std::coroutine_handle<> h) {
+  coro_ = std::coroutine_handle<Promise>::from_address(h.address());
+  ring_.File(request_, h);
+}
+
+bool IOUring::RegisterBuffers(const std::vector<iovec> &buffers) {
+  return io_uring_register_buffers(&ring_, buffers.data(), buffers.size()) == 0;
+}
+
+void IOUring::UnregisterBuffers() { io_uring_unregister_buffers(&ring_); }
+
+void IOUring::Cancel(int fileDescriptor) {
+  if (fileDescriptor < 0) {
+    throw std::runtime_error("Invalid file descriptor");
+  }
+  Entry entry;
+  entry.type = IOUring::CANCEL;
+  entry.fd = fileDescriptor;
+  Enqueue(std::move(entry));
+  AddEntries();
+}
+
+void IOUring::CancelAll() {
+  Entry entry;
+  entry.type = IOUring::CANCEL;
+  entry.fd = -1;
+  Enqueue(std::move(entry));
+  AddEntries();
+}
+
+bool IOUring::Idle() const {
+  return inProcess_ + (queue_.size() - queueHead_) == (wakeArmed_ ? 1u : 0u) && expectedPosts_ == 0;
+}
+
+void IOUring::ExpectPost() { expectedPosts_++; }
+
+void IOUring::Post(std::coroutine_handle<> coro) {
+  {
+    std::lock_guard lock(postedMutex_);
+    posted_.push_back(coro);
+  }
+  hasPosted_.store(true, std::memory_order_release);
+  std::uint64_t one = 1;
+  (void)write(wakeFD_, &one, sizeof(one));
+}
+
+void IOUring::Post(std::function<void()> task) {
+  {
+    std::lock_guard lock(postedMutex_);
+    postedTasks_.push_back(std::move(task));
+  }
+  hasPosted_.store(true, std::memory_order_release);
+  std::uint64_t one = 1;
+  (void)write(wakeFD_, &one, sizeof(one));
+}
+
+IOUring *IOUring::Current() { return current_; }
+
+void IOUring::ResumePosted() {
+  std::vector<std::coroutine_handle<>> ready;
+  std::vector<std::function<void()>> tasks;
+  {
+    std::lock_guard lock(postedMutex_);
+    ready.swap(posted_);
+    tasks.swap(postedTasks_);
+    hasPosted_.store(false, std::memory_order_relaxed);
+  }
+  for (auto &task : tasks) {
+    task();
+  }
+  for (auto coro : ready) {
+    expectedPosts_--;
+    if (coro && !coro.done()) {
+      coro.resume();
+    }
+  }
+}
+
+void IOUring::SetTracer(Tracer *tracer) { tracer_ = tracer; }
+
+void IOUring::TraceRequest(std::uint32_t request) { traceRequest_ = request; }
+
+void IOUring::TrackQueueDelay(bool enabled) {
+  trackQueueDelay_ = enabled;
+  lastEmpty_ = std::chrono::steady_clock::now();
+}
+
+bool IOUring::EnableBusyPoll(std::chrono::microseconds timeout, bool prefer) {
+#if defined(LIBURING_VERSION_MAJOR) &&                                                          \
+    (LIBURING_VERSION_MAJOR > 2 || (LIBURING_VERSION_MAJOR == 2 && LIBURING_VERSION_MINOR >= 6))
+  io_uring_napi napi{};
+  napi.busy_poll_to = static_cast<__u32>(timeout.count());
+  napi.prefer_busy_poll = prefer ? 1 : 0;
+  return io_uring_register_napi(&ring_, &napi) == 0;
+#else
+  (void)timeout;
+  (void)prefer;
+  return false;
+#endif
+}
+
+std::chrono::steady_clock::duration
+IOUring::QueueDelay(std::chrono::steady_clock::time_point now) const {
+  if (!trackQueueDelay_) {
+    return {};
+  }
+  return now - lastEmpty_;
+}
+
+AcceptAwaiter IOUring::AcceptAsync(int fileDescriptor, sockaddr_storage *peer) {
+  return AcceptAwaiter(*this, fileDescriptor, peer);
 }
 
 WriteAwaiter IOUring::WriteAsync(int fileDescriptor, std::shared_ptr<std::string> data,
@@ -148,10 +449,15 @@ WriteAwaiter IOUring::WriteAsync(int fileDescriptor, std::shared_ptr<std::string
 void IOUring::ProcessCalls() {
   io_uring_cqe *cqEntry;
   struct __kernel_timespec ts = {.tv_sec = 0, .tv_nsec = 1000000};
-  
+  if (io_uring_cq_ready(&ring_) == 0) {
+    syscalls_++;
+  }
   int ret = io_uring_wait_cqe_timeout(&ring_, &cqEntry, &ts);
   
   if (ret == -ETIME || ret < 0 || !cqEntry) {
+    if (trackQueueDelay_) {
+      lastEmpty_ = std::chrono::steady_clock::now();
+    }
     return;
   }
   
@@ -167,13 +473,29 @@ void IOUring::ProcessCalls() {
   OpType opType = sqeData->opType;
   int result = cqEntry->res;
   std::coroutine_handle<> coroToResume = sqeData->coro;
+  std::uint32_t traceRequest = sqeData->traceRequest;
+  if (traceRequest != 0) [[unlikely]] {
+    tracer_->Record(traceRequest, TRACE_COMPLETE, Tracer::Now(), sqeData->traceSequence,
+                    opType);
+  }
   
-  delete sqeData;
+  ReleaseSqe(sqeData);
   io_uring_cqe_seen(&ring_, cqEntry);
+  if (trackQueueDelay_ && io_uring_cq_ready(&ring_) == 0) {
+    lastEmpty_ = std::chrono::steady_clock::now();
+  }
+
+  if (opType == IOUring::CANCEL) {
+    return;
+  }
+  if (opType == IOUring::WAKE) {
+    wakeArmed_ = false;
+    return;
+  }
   
   if (result < 0) {
     if (coroToResume && !coroToResume.done()) {
-      if (opType == IOUring::ACCEPT) {
+      if (opType == IOUring::ACCEPT || opType == IOUring::CONNECT || opType == IOUring::FILE) {
         auto promise = std::coroutine_handle<Promise>::from_address(coroToResume.address());
         promise.promise().acceptResult_ = result;
       } else if (opType == IOUring::READ) {
@@ -183,14 +505,16 @@ void IOUring::ProcessCalls() {
         auto promise = std::coroutine_handle<Promise>::from_address(coroToResume.address());
         promise.promise().writeResult_ = 0;
       }
+      traceRequest_ = traceRequest;
       try {
         coroToResume.resume();
       } catch (...) {}
+      traceRequest_ = 0;
     }
     return;
   }
   
-  if (opType == IOUring::ACCEPT) {
+  if (opType == IOUring::ACCEPT || opType == IOUring::CONNECT || opType == IOUring::FILE) {
     auto promise = std::coroutine_handle<Promise>::from_address(coroToResume.address());
     promise.promise().acceptResult_ = result;
   } else if (opType == IOUring::READ) {
@@ -202,6 +526,7 @@ void IOUring::ProcessCalls() {
   }
   
   if (coroToResume && !coroToResume.done()) {
+    traceRequest_ = traceRequest;
     try {
       coroToResume.resume();
     } catch (const std::exception &e) {
@@ -209,6 +534,7 @@ void IOUring::ProcessCalls() {
     } catch (...) {
       std::cerr << "[ProcessCalls] Unknown exception during resume" << std::endl;
     }
+    traceRequest_ = 0;
   }
 }
 
@@ -1,14 +1,20 @@
 #pragma once
 #include "coroutine.h"
+#include "trace.h"
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <coroutine>
-#include <deque>
+#include <functional>
 #include <liburing.h>
 #include <liburing/io_uring.h>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
 #define QUEUE_DEPTH 1024
 namespace HTTP {
 struct Promise;
@@ -36,10 +42,12 @@ struct ReadAwaiter {
 struct AcceptAwaiter {
   IOUring &ring_;
   int fd_;
+  sockaddr_storage *peer_;
+  socklen_t peerLength_{sizeof(sockaddr_storage)};
   std::coroutine_handle<Promise> coro_;
   
-  AcceptAwaiter(IOUring &ring, int fd)
-    : ring_(ring), fd_(fd) {}
+  AcceptAwaiter(IOUring &ring, int fd, sockaddr_storage *peer)
+    : ring_(ring), fd_(fd), peer_(peer) {}
   
   bool await_ready() const noexcept { return false; }
   
@@ -72,21 +80,95 @@ struct WriteAwaiter {
   }
 };
 
+struct ConnectAwaiter {
+  IOUring &ring_;
+  int fd_;
+  const sockaddr *address_;
+  socklen_t length_;
+  std::coroutine_handle<Promise> coro_{};
+
+  ConnectAwaiter(IOUring &ring, int fd, const sockaddr *address, socklen_t length)
+      : ring_(ring), fd_(fd), address_(address), length_(length) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> h);
+
+  int await_resume() const noexcept { return coro_.promise().acceptResult_; }
+};
+
+struct SpliceAwaiter {
+  IOUring &ring_;
+  int from_;
+  int to_;
+  size_t len_;
+  std::coroutine_handle<Promise> coro_{};
+
+  SpliceAwaiter(IOUring &ring, int from, int to, size_t len)
+      : ring_(ring), from_(from), to_(to), len_(len) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> h);
+
+  size_t await_resume() const noexcept { return coro_.promise().writeResult_; }
+};
+
+// A file operation for IOUring::File. Paths and buffers must stay valid until
+// the operation completes; awaiting it in the same expression ensures that.
+struct FileRequest {
+  enum Op : std::uint8_t { OPEN, READ, WRITE, FSYNC, STATX, CLOSE };
+  Op op;
+  int fd{-1};
+  const char *path{nullptr};
+  void *buffer{nullptr};
+  unsigned length{0};
+  std::uint64_t offset{0};
+  int flags{0};
+  unsigned mode{0};
+  // Index of a buffer registered with IOUring::RegisterBuffers, or -1.
+  int bufferIndex{-1};
+};
+
+// Resumes with the operation's result: a descriptor, a byte count or 0 on
+// success, and a negative errno on failure.
+struct FileAwaiter {
+  IOUring &ring_;
+  FileRequest request_;
+  std::coroutine_handle<Promise> coro_{};
+
+  FileAwaiter(IOUring &ring, const FileRequest &request) : ring_(ring), request_(request) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> h);
+
+  int await_resume() const noexcept { return coro_.promise().acceptResult_; }
+};
+
 class IOUring {
   friend struct ReadAwaiter;
   friend struct AcceptAwaiter;
   friend struct WriteAwaiter;
 public:
-  enum OpType { ACCEPT, READ, WRITE };
+  enum OpType { ACCEPT, READ, WRITE, CANCEL, WAKE, CONNECT, SPLICE, FILE };
 private:
   struct Entry {
     OpType type;
     int fd;
     std::optional<char *> toRead;
+    sockaddr *peer{nullptr};
+    socklen_t *peerLength{nullptr};
+    const sockaddr *address{nullptr};
+    socklen_t addressLength{0};
+    int spliceFrom{-1};
+    FileRequest file{};
     std::coroutine_handle<> coro;
     std::shared_ptr<std::string> writeData;
     size_t writeOffset{0};
     size_t writeLen{0};
+    std::uint32_t traceRequest{0};
+    std::uint32_t traceSequence{0};
   };
   struct SqeData {
     int fd;
@@ -95,14 +177,37 @@ private:
     std::shared_ptr<std::string> writeData;
     size_t writeOffset{0};
     size_t writeLen{0};
+    std::uint32_t traceRequest{0};
+    std::uint32_t traceSequence{0};
   };
-  std::deque<Entry> queue_;
+  std::vector<Entry> queue_;
+  std::size_t queueHead_{0};
+  std::vector<SqeData *> freeSqes_;
   io_uring ring_;
   std::array<std::optional<int>, 1025> fdToAcceptResult_;
   std::atomic<bool> stopToken_ = false;
   std::uint64_t inProcess_ = 0;
+  bool trackQueueDelay_{false};
+  std::chrono::steady_clock::time_point lastEmpty_{};
+  int wakeFD_{-1};
+  std::uint64_t wakeValue_{0};
+  bool wakeArmed_{false};
+  std::uint64_t expectedPosts_{0};
+  std::mutex postedMutex_;
+  std::atomic<bool> hasPosted_{false};
+  std::vector<std::coroutine_handle<>> posted_;
+  std::vector<std::function<void()>> postedTasks_;
+  Tracer *tracer_{nullptr};
+  std::uint32_t traceRequest_{0};
+  std::uint64_t syscalls_{0};
+  static thread_local IOUring *current_;
   void ProcessCalls();
   void AddEntries();
+  void Enqueue(Entry &&entry);
+  SqeData *AcquireSqe(Entry &entry);
+  void ReleaseSqe(SqeData *sqeData);
+  void ResumePosted();
+  static void PrepareFile(io_uring_sqe *sqEntry, const FileRequest &file);
 
 public:
   void Poll();
@@ -115,8 +220,43 @@ public:
              std::coroutine_handle<> coro);
   WriteAwaiter WriteAsync(int fileDescriptor, std::shared_ptr<std::string> data, size_t offset,
                           size_t len);
-  void Accept(int fileDescriptor, std::coroutine_handle<> coro);
-  AcceptAwaiter AcceptAsync(int fileDescriptor);
+  void Accept(int fileDescriptor, std::coroutine_handle<> coro, sockaddr *peer = nullptr,
+              socklen_t *peerLength = nullptr);
+  AcceptAwaiter AcceptAsync(int fileDescriptor, sockaddr_storage *peer = nullptr);
+  void Connect(int fileDescriptor, const sockaddr *address, socklen_t length,
+               std::coroutine_handle<> coro);
+  ConnectAwaiter ConnectAsync(int fileDescriptor, const sockaddr *address, socklen_t length);
+  // Moves up to len bytes from one descriptor to another without copying
+  // through user space; one side must be a pipe.
+  void Splice(int from, int to, size_t len, std::coroutine_handle<> coro);
+  SpliceAwaiter SpliceAsync(int from, int to, size_t len);
+  // Regular-file operations, completed on this ring like socket I/O. A
+  // FileRequest::STATX request reads into buffer as a struct statx.
+  void File(const FileRequest &request, std::coroutine_handle<> coro);
+  FileAwaiter FileAsync(const FileRequest &request);
+  // Registers buffers for FileRequest::bufferIndex. Returns false if the
+  // kernel refuses them, e.g. over RLIMIT_MEMLOCK.
+  bool RegisterBuffers(const std::vector<iovec> &buffers);
+  void UnregisterBuffers();
   int GetAcceptResult(int fileDescriptor);
+  void Cancel(int fileDescriptor);
+  void CancelAll();
+  bool Idle() const;
+  void ExpectPost();
+  void Post(std::coroutine_handle<> coro);
+  void Post(std::function<void()> task);
+  static IOUring *Current();
+  void TrackQueueDelay(bool enabled);
+  // Registers NAPI busy polling for sockets served by this ring. Returns
+  // false when the kernel or liburing (before 2.6) does not support it.
+  bool EnableBusyPoll(std::chrono::microseconds timeout, bool prefer);
+  // Operations queued while a traced request is current are recorded in the
+  // tracer; the request is made current again while its completions resume.
+  void SetTracer(Tracer *tracer);
+  void TraceRequest(std::uint32_t request);
+  std::chrono::steady_clock::duration QueueDelay(std::chrono::steady_clock::time_point now) const;
+  // io_uring_enter calls made so far: submissions, and waits that found no
+  // completion ready.
+  std::uint64_t Syscalls() const { return syscalls_; }
 };
 }
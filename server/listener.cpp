@@ -0,0 +1,210 @@
+#include "listener.h"
+#include <arpa/inet.h>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace HTTP {
+
+namespace {
+static int parsePort(std::string_view text) {
+  int port = 0;
+  auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), port);
+  if (error != std::errc() || end != text.data() + text.size() || port < 0 || port > 65535) {
+    throw std::runtime_error("Invalid listener port");
+  }
+  return port;
+}
+
+static socklen_t unixAddress(const Listener &listener, sockaddr_un &address) {
+  address.sun_family = AF_UNIX;
+  bool abstract = listener.kind == ListenerKind::ABSTRACT;
+  std::size_t offset = abstract ? 1 : 0;
+  if (listener.address.empty() ||
+      listener.address.size() + offset >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Invalid UNIX socket path");
+  }
+  std::memcpy(address.sun_path + offset, listener.address.data(), listener.address.size());
+  // Abstract names are not NUL-terminated; the length says where they end.
+  return offsetof(sockaddr_un, sun_path) + offset + listener.address.size() + (abstract ? 0 : 1);
+}
+
+static void setOption(int fd, int level, int name, int value, const char *what) {
+  if (setsockopt(fd, level, name, &value, sizeof(value)) == -1) {
+    close(fd);
+    throw std::runtime_error(std::string("Could not set ") + what);
+  }
+}
+
+static void applyProfile(int fd, bool tcp, const SocketProfile &profile) {
+  if (profile.sendBuffer > 0) {
+    setOption(fd, SOL_SOCKET, SO_SNDBUF, profile.sendBuffer, "SO_SNDBUF");
+  }
+  if (profile.receiveBuffer > 0) {
+    setOption(fd, SOL_SOCKET, SO_RCVBUF, profile.receiveBuffer, "SO_RCVBUF");
+  }
+  if (!tcp) {
+    return;
+  }
+  if (profile.noDelay) {
+    setOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+  }
+  if (profile.deferAccept.count() > 0) {
+    setOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, static_cast<int>(profile.deferAccept.count()),
+              "TCP_DEFER_ACCEPT");
+  }
+  if (profile.fastOpenQueue > 0) {
+    setOption(fd, IPPROTO_TCP, TCP_FASTOPEN, profile.fastOpenQueue, "TCP_FASTOPEN");
+  }
+  if (profile.busyPoll.count() > 0) {
+    setOption(fd, SOL_SOCKET, SO_BUSY_POLL, static_cast<int>(profile.busyPoll.count()),
+              "SO_BUSY_POLL");
+  }
+  if (profile.preferBusyPoll) {
+    setOption(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, 1, "SO_PREFER_BUSY_POLL");
+  }
+}
+
+static int openTcp(const Listener &listener) {
+  sockaddr_storage storage{};
+  socklen_t length;
+  auto *v4 = reinterpret_cast<sockaddr_in *>(&storage);
+  auto *v6 = reinterpret_cast<sockaddr_in6 *>(&storage);
+  if (listener.address.empty()) {
+    v4->sin_family = AF_INET;
+    v4->sin_addr.s_addr = INADDR_ANY;
+    v4->sin_port = htons(listener.port);
+    length = sizeof(sockaddr_in);
+  } else if (inet_pton(AF_INET, listener.address.c_str(), &v4->sin_addr) == 1) {
+    v4->sin_family = AF_INET;
+    v4->sin_port = htons(listener.port);
+    length = sizeof(sockaddr_in);
+  } else if (inet_pton(AF_INET6, listener.address.c_str(), &v6->sin6_addr) == 1) {
+    v6->sin6_family = AF_INET6;
+    v6->sin6_port = htons(listener.port);
+    length = sizeof(sockaddr_in6);
+  } else {
+    throw std::runtime_error("Invalid listener address");
+  }
+  int fd = socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    throw std::runtime_error("Could not open socket");
+  }
+  int one = 1;
+  int v6Only = listener.options.v6Only ? 1 : 0;
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1 ||
+      (listener.options.reusePort &&
+       setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) == -1) ||
+      (storage.ss_family == AF_INET6 &&
+       setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6Only, sizeof(v6Only)) == -1)) {
+    close(fd);
+    throw std::runtime_error("Could not set socket options");
+  }
+  if (bind(fd, reinterpret_cast<sockaddr *>(&storage), length) == -1) {
+    close(fd);
+    throw std::runtime_error("Could not bind socket");
+  }
+  return fd;
+}
+
+static int openUnix(const Listener &listener) {
+  sockaddr_un address{};
+  socklen_t length = unixAddress(listener, address);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    throw std::runtime_error("Could not open socket");
+  }
+  if (listener.kind == ListenerKind::UNIX) {
+    // A socket file left behind by an earlier run would make bind fail.
+    struct stat status;
+    if (lstat(listener.address.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+      unlink(listener.address.c_str());
+    }
+  }
+  if (bind(fd, reinterpret_cast<sockaddr *>(&address), length) == -1) {
+    close(fd);
+    throw std::runtime_error("Could not bind socket");
+  }
+  if (listener.kind == ListenerKind::UNIX && listener.options.mode >= 0 &&
+      chmod(listener.address.c_str(), listener.options.mode) == -1) {
+    close(fd);
+    throw std::runtime_error("Could not set socket permissions");
+  }
+  return fd;
+}
+} // namespace
+
+Listener Listener::Tcp(std::string_view host, int port, ListenerOptions options) {
+  return Listener{ListenerKind::TCP, std::string(host), port, options};
+}
+
+Listener Listener::Unix(std::string_view path, ListenerOptions options) {
+  return Listener{ListenerKind::UNIX, std::string(path), 0, options};
+}
+
+Listener Listener::Abstract(std::string_view name, ListenerOptions options) {
+  return Listener{ListenerKind::ABSTRACT, std::string(name), 0, options};
+}
+
+Listener Listener::Parse(std::string_view spec, ListenerOptions options) {
+  if (spec.starts_with("unix:")) {
+    spec.remove_prefix(5);
+    if (spec.starts_with('@')) {
+      return Abstract(spec.substr(1), options);
+    }
+    return Unix(spec, options);
+  }
+  auto colon = spec.rfind(':');
+  if (colon == std::string_view::npos) {
+    throw std::runtime_error("Listener needs a port");
+  }
+  auto host = spec.substr(0, colon);
+  if (host.starts_with('[') && host.ends_with(']')) {
+    host = host.substr(1, host.size() - 2);
+  }
+  return Tcp(host, parsePort(spec.substr(colon + 1)), options);
+}
+
+int OpenListener(const Listener &listener, const SocketProfile &profile) {
+  bool tcp = listener.kind == ListenerKind::TCP;
+  int fd = tcp ? openTcp(listener) : openUnix(listener);
+  applyProfile(fd, tcp, profile);
+  int backlog = profile.backlog > 0 ? profile.backlog : listener.options.backlog;
+  if (listen(fd, backlog) == -1) {
+    close(fd);
+    throw std::runtime_error("Could not listen on socket");
+  }
+  return fd;
+}
+
+int ReserveListener(Listener &listener) {
+  if (listener.kind != ListenerKind::TCP) {
+    throw std::runtime_error("Only TCP listeners can be reserved");
+  }
+  listener.options.reusePort = true;
+  int fd = openTcp(listener);
+  sockaddr_storage storage{};
+  socklen_t length = sizeof(storage);
+  if (getsockname(fd, reinterpret_cast<sockaddr *>(&storage), &length) == -1) {
+    close(fd);
+    throw std::runtime_error("Could not read bound address");
+  }
+  listener.port = ntohs(storage.ss_family == AF_INET6
+                            ? reinterpret_cast<sockaddr_in6 *>(&storage)->sin6_port
+                            : reinterpret_cast<sockaddr_in *>(&storage)->sin_port);
+  return fd;
+}
+
+void RemoveListener(const Listener &listener) {
+  if (listener.kind == ListenerKind::UNIX) {
+    unlink(listener.address.c_str());
+  }
+}
+
+} // namespace HTTP
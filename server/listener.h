@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+namespace HTTP {
+enum class ListenerKind { TCP, UNIX, ABSTRACT };
+
+struct ListenerOptions {
+  int backlog{SOMAXCONN};
+  bool reusePort{false};
+  // For an IPv6 address: refuse IPv4-mapped connections.
+  bool v6Only{false};
+  // Permission bits for a UNIX socket file; -1 leaves them to the umask.
+  int mode{-1};
+};
+
+// One address to accept connections on. TCP hosts are numeric; an empty host
+// binds every IPv4 address. UNIX listeners take a filesystem path, abstract
+// ones a name in Linux's abstract namespace, which needs no file on disk.
+struct Listener {
+  ListenerKind kind{ListenerKind::TCP};
+  std::string address;
+  int port{0};
+  ListenerOptions options;
+
+  static Listener Tcp(std::string_view host, int port, ListenerOptions options = {});
+  static Listener Unix(std::string_view path, ListenerOptions options = {});
+  static Listener Abstract(std::string_view name, ListenerOptions options = {});
+  // Accepts "host:port", "[v6]:port", ":port", "unix:/path" and "unix:@name".
+  static Listener Parse(std::string_view spec, ListenerOptions options = {});
+};
+
+// Socket options for every listener the server binds. Linux copies them to
+// each connection accept() returns, so nothing extra runs per connection.
+// TCP options are skipped on UNIX listeners; zero leaves the kernel default.
+struct SocketProfile {
+  // On by default: static bodies over 16 KiB go out in a second write, which
+  // Nagle would hold until the client's delayed ACK, about 40 ms later.
+  bool noDelay{true};
+  // Wake an accept only once data has arrived, for up to this long.
+  std::chrono::seconds deferAccept{0};
+  int fastOpenQueue{0};
+  // Busy-poll budget for socket reads; raising it needs CAP_NET_ADMIN. With
+  // liburing 2.6 or newer the worker rings also register it for NAPI polling.
+  std::chrono::microseconds busyPoll{0};
+  bool preferBusyPoll{false};
+  int sendBuffer{0};
+  int receiveBuffer{0};
+  // Replaces each listener's own backlog when set.
+  int backlog{0};
+};
+
+// Creates, binds and listens; throws std::runtime_error on failure.
+int OpenListener(const Listener &listener, const SocketProfile &profile = {});
+// Binds a TCP listener with SO_REUSEPORT but does not listen, so the address
+// is held without taking connections while each prefork worker process
+// listens on its own socket. A zero port is replaced by the one bound.
+int ReserveListener(Listener &listener);
+// Removes the socket file of a UNIX listener, if there is one.
+void RemoveListener(const Listener &listener);
+} // namespace HTTP
@@ -0,0 +1,21 @@
+#include "load_shedder.h"
+#include <algorithm>
+namespace HTTP {
+LoadShedder::LoadShedder(Clock::duration target, Clock::duration interval)
+    : target_(target), interval_(interval) {}
+
+bool LoadShedder::Enabled() const { return target_.count() > 0; }
+
+bool LoadShedder::Admit(Clock::duration sojourn, Clock::time_point now) {
+  if (!Enabled()) {
+    return true;
+  }
+  minDelay_ = std::min(minDelay_, sojourn);
+  if (now >= intervalEnd_) {
+    overloaded_ = minDelay_ > target_;
+    minDelay_ = Clock::duration::max();
+    intervalEnd_ = now + interval_;
+  }
+  return sojourn <= (overloaded_ ? target_ : interval_);
+}
+} // namespace HTTP
@@ -0,0 +1,18 @@
+#pragma once
+#include <chrono>
+namespace HTTP {
+class LoadShedder {
+  using Clock = std::chrono::steady_clock;
+  Clock::duration target_{};
+  Clock::duration interval_{};
+  Clock::duration minDelay_{Clock::duration::max()};
+  Clock::time_point intervalEnd_{};
+  bool overloaded_{false};
+
+public:
+  LoadShedder() = default;
+  LoadShedder(Clock::duration target, Clock::duration interval);
+  bool Enabled() const;
+  bool Admit(Clock::duration sojourn, Clock::time_point now);
+};
+} // namespace HTTP
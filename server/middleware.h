@@ -0,0 +1,140 @@
+#pragma once
+#include "request_data.h"
+#include <cstddef>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+namespace HTTP {
+// A middleware is any copyable type with a Before and/or an After member:
+//
+//   std::optional<ResponseData> Before(const RequestData &) const;
+//   void After(const RequestData &, ResponseData &) const;
+//
+// Before may also return void. Returning a response from Before ends the
+// request there: later middleware and the handler are skipped, while the
+// After of every middleware already entered still runs, innermost first.
+// A middleware that needs per-request state declares `using State = ...;` and
+// takes a `State &` as the last argument of Before and After; the state lives
+// on the stack for the length of the request.
+//
+// Chains are plain templates, so the whole pipeline is inlined into the
+// route's handler: there are no virtual calls or std::function hops.
+namespace detail {
+struct NoState {};
+
+template <typename M> struct MiddlewareState {
+  using type = NoState;
+};
+template <typename M>
+  requires requires { typename M::State; }
+struct MiddlewareState<M> {
+  using type = typename M::State;
+};
+} // namespace detail
+
+template <typename... Middleware> class Chain {
+  std::tuple<Middleware...> middleware_;
+
+  template <std::size_t I>
+  using StateOf =
+      typename detail::MiddlewareState<std::tuple_element_t<I, std::tuple<Middleware...>>>::type;
+
+  // Each level returns the next level's response as a prvalue, or names a
+  // single local when it has an After, so the response is never moved.
+  template <std::size_t I, typename Next>
+  ResponseData Step(const RequestData &request, const Next &next) const {
+    if constexpr (I == sizeof...(Middleware)) {
+      return next();
+    } else {
+      const auto &middleware = std::get<I>(middleware_);
+      StateOf<I> state{};
+      constexpr bool stateful = !std::is_same_v<StateOf<I>, detail::NoState>;
+      constexpr bool before = stateful ? requires { middleware.Before(request, state); }
+                                       : requires { middleware.Before(request); };
+      constexpr bool after = stateful ? requires(ResponseData &response) {
+        middleware.After(request, response, state);
+      } : requires(ResponseData &response) { middleware.After(request, response); };
+      static_assert(before || after, "middleware needs a Before or an After member");
+
+      if constexpr (before) {
+        auto call = [&] {
+          if constexpr (stateful) {
+            return middleware.Before(request, state);
+          } else {
+            return middleware.Before(request);
+          }
+        };
+        if constexpr (std::is_void_v<decltype(call())>) {
+          call();
+        } else if (std::optional<ResponseData> early = call()) {
+          return std::move(*early);
+        }
+      }
+      if constexpr (after) {
+        return Finish<I>(request, next, state);
+      } else {
+        return Step<I + 1>(request, next);
+      }
+    }
+  }
+
+  template <std::size_t I, typename Next>
+  ResponseData Finish(const RequestData &request, const Next &next, StateOf<I> &state) const {
+    const auto &middleware = std::get<I>(middleware_);
+    ResponseData response = Step<I + 1>(request, next);
+    if constexpr (std::is_same_v<StateOf<I>, detail::NoState>) {
+      middleware.After(request, response);
+    } else {
+      middleware.After(request, response, state);
+    }
+    return response;
+  }
+
+public:
+  explicit Chain(Middleware... middleware) : middleware_(std::move(middleware)...) {}
+
+  // Returns a new chain with more middleware running inside this one.
+  template <typename... More> Chain<Middleware..., More...> With(More... more) const {
+    return std::apply(
+        [&](const auto &...current) {
+          return Chain<Middleware..., More...>(current..., std::move(more)...);
+        },
+        middleware_);
+  }
+
+  // Runs the chain around next, which produces the handler's response.
+  template <typename Next> ResponseData Run(const RequestData &request, const Next &next) const {
+    return Step<0>(request, next);
+  }
+
+  template <typename Handler> auto Wrap(Handler handler) const;
+};
+
+// A handler run inside a chain. It takes whatever the wrapped handler takes,
+// so it can be registered as a typed route as well as a plain one.
+template <typename Chain, typename Handler> struct Wrapped {
+  Chain chain;
+  Handler handler;
+
+  template <typename... Args>
+  ResponseData operator()(const RequestData &request, Args &&...args) const {
+    return chain.Run(request, [&]() -> ResponseData {
+      if constexpr (std::is_invocable_r_v<ResponseData, const Handler &, const RequestData &,
+                                          Args...>) {
+        return handler(request, std::forward<Args>(args)...);
+      } else {
+        static_assert(std::is_invocable_r_v<ResponseData, const Handler &, Args...>,
+                      "handler must accept the route's captures, optionally after the request");
+        return handler(std::forward<Args>(args)...);
+      }
+    });
+  }
+};
+
+template <typename... Middleware>
+template <typename Handler>
+auto Chain<Middleware...>::Wrap(Handler handler) const {
+  return Wrapped<Chain, Handler>{*this, std::move(handler)};
+}
+} // namespace HTTP
@@ -0,0 +1,55 @@
+#include "offload_pool.h"
+namespace HTTP {
+OffloadPool::OffloadPool(int numThreads) {
+  for (int i = 0; i < numThreads; ++i) {
+    threads_.emplace_back([this] { Run(); });
+  }
+}
+
+OffloadPool::~OffloadPool() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  ready_.notify_all();
+  for (auto &t : threads_) {
+    t.join();
+  }
+}
+
+void OffloadPool::Submit(std::function<void()> task) {
+  {
+    std::lock_guard lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  ready_.notify_one();
+}
+
+void OffloadPool::Run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock(mutex_);
+      ready_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+void OffloadAwaiter::await_suspend(std::coroutine_handle<> h) {
+  ring_.ExpectPost();
+  pool_.Submit([this, h] {
+    try {
+      task_();
+    } catch (...) {
+      exception_ = std::current_exception();
+    }
+    ring_.Post(h);
+  });
+}
+} // namespace HTTP
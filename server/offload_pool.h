@@ -0,0 +1,46 @@
+#pragma once
+#include "io_uring.h"
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+namespace HTTP {
+class OffloadPool {
+  std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<std::function<void()>> tasks_;
+  std::vector<std::thread> threads_;
+  bool stop_{false};
+
+  void Run();
+
+public:
+  explicit OffloadPool(int numThreads);
+  ~OffloadPool();
+  void Submit(std::function<void()> task);
+};
+
+struct OffloadAwaiter {
+  OffloadPool &pool_;
+  IOUring &ring_;
+  std::function<void()> task_;
+  std::exception_ptr exception_;
+
+  OffloadAwaiter(OffloadPool &pool, IOUring &ring, std::function<void()> task)
+      : pool_(pool), ring_(ring), task_(std::move(task)) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> h);
+
+  void await_resume() {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+  }
+};
+} // namespace HTTP
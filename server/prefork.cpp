@@ -0,0 +1,70 @@
+#include "prefork.h"
+#include <new>
+#include <stdexcept>
+#include <sys/mman.h>
+namespace HTTP {
+namespace {
+// Every counter in Stats; a new counter must be added here to be summed.
+constexpr std::atomic<std::uint64_t> Stats::*kCounters[] = {
+    &Stats::shedConnections,   &Stats::shedRequests,          &Stats::rateLimited,
+    &Stats::droppedLogRecords, &Stats::droppedCaptureRecords, &Stats::coalescedRequests,
+    &Stats::processRestarts,
+};
+} // namespace
+
+// Lock-free atomics work across processes on shared memory.
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+static_assert(std::atomic<std::int64_t>::is_always_lock_free);
+static_assert(std::atomic<pid_t>::is_always_lock_free);
+
+struct ProcessSlot {
+  Stats stats;
+  std::atomic<pid_t> pid{-1};
+};
+
+// Followed in the mapping by one ProcessSlot per worker process.
+struct SharedStats::Segment {
+  std::atomic<std::int64_t> deadline{0};
+  std::atomic<int> listening{0};
+  Stats total;
+  Stats supervisor;
+
+  ProcessSlot *Processes() { return reinterpret_cast<ProcessSlot *>(this + 1); }
+};
+static_assert(sizeof(SharedStats::Segment) % alignof(ProcessSlot) == 0);
+
+SharedStats::SharedStats(int processes)
+    : size_(sizeof(Segment) + processes * sizeof(ProcessSlot)), processes_(processes) {
+  void *memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    throw std::runtime_error("Could not map shared stats");
+  }
+  segment_ = new (memory) Segment;
+  for (int i = 0; i < processes_; ++i) {
+    new (&segment_->Processes()[i]) ProcessSlot;
+  }
+}
+
+SharedStats::~SharedStats() { munmap(segment_, size_); }
+
+Stats &SharedStats::Process(int index) { return segment_->Processes()[index].stats; }
+
+Stats &SharedStats::Supervisor() { return segment_->supervisor; }
+
+const Stats &SharedStats::Total() {
+  for (auto counter : kCounters) {
+    std::uint64_t sum = (segment_->supervisor.*counter).load(std::memory_order_relaxed);
+    for (int i = 0; i < processes_; ++i) {
+      sum += (segment_->Processes()[i].stats.*counter).load(std::memory_order_relaxed);
+    }
+    (segment_->total.*counter).store(sum, std::memory_order_relaxed);
+  }
+  return segment_->total;
+}
+
+std::atomic<std::int64_t> &SharedStats::Deadline() { return segment_->deadline; }
+
+std::atomic<int> &SharedStats::Listening() { return segment_->listening; }
+
+std::atomic<pid_t> &SharedStats::Pid(int index) { return segment_->Processes()[index].pid; }
+} // namespace HTTP
@@ -0,0 +1,48 @@
+#pragma once
+#include "stats.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+namespace HTTP {
+struct PreforkOptions {
+  // Worker processes to fork; each runs SetThreads worker threads. One keeps
+  // the server in a single process.
+  int processes{1};
+  // Wait before replacing a worker process that exited.
+  std::chrono::milliseconds restartDelay{100};
+};
+
+// Counters of the supervisor and of each worker process, mapped shared and
+// anonymous before the first fork so that every process increments its own
+// slot in place and the process that called Start sums them without asking
+// anyone.
+class SharedStats {
+public:
+  struct Segment;
+
+private:
+  Segment *segment_;
+  std::size_t size_;
+  int processes_;
+
+public:
+  explicit SharedStats(int processes);
+  ~SharedStats();
+  SharedStats(const SharedStats &) = delete;
+  SharedStats &operator=(const SharedStats &) = delete;
+  Stats &Process(int index);
+  Stats &Supervisor();
+  // Sums every slot into one; not atomic across counters.
+  const Stats &Total();
+  // The shutdown deadline, in steady_clock ticks, for the worker processes.
+  // CLOCK_MONOTONIC is system-wide, so the ticks mean the same in each.
+  std::atomic<std::int64_t> &Deadline();
+  // Worker processes that have opened their listeners, restarts included.
+  std::atomic<int> &Listening();
+  // The worker process in a slot, as the supervisor process forked it; -1
+  // while it is being replaced.
+  std::atomic<pid_t> &Pid(int index);
+};
+} // namespace HTTP
@@ -0,0 +1,602 @@
+#include "proxy.h"
+#include "http_error.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cctype>
+#include <charconv>
+#include <fcntl.h>
+#include <limits>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace HTTP {
+
+namespace {
+constexpr std::size_t kSpliceChunk = 64 * 1024;
+constexpr std::size_t kMaxResponseHead = 64 * 1024;
+
+static const std::shared_ptr<std::string> continueResponse =
+    std::make_shared<std::string>("HTTP/1.1 100 Continue\r\n\r\n");
+
+static bool iequals(std::string_view a, std::string_view b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) !=
+        std::tolower(static_cast<unsigned char>(b[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool hasToken(std::string_view value, std::string_view token) {
+  for (size_t i = 0; i + token.size() <= value.size(); ++i) {
+    if (iequals(value.substr(i, token.size()), token)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+bool hopByHop(std::string_view name) {
+  return iequals(name, "connection") || iequals(name, "keep-alive") ||
+         iequals(name, "proxy-connection") || iequals(name, "te") || iequals(name, "trailer") ||
+         iequals(name, "transfer-encoding") || iequals(name, "upgrade") ||
+         iequals(name, "expect");
+}
+
+// Tracks chunked framing so the relay knows where the message ends; the
+// bytes themselves are forwarded unchanged.
+class ChunkScanner {
+  enum State { SIZE, EXTENSION, SIZE_LF, DATA, DATA_CR, DATA_LF, TRAILER, TRAILER_LINE, FINAL_LF, DONE, FAILED };
+  State state_{SIZE};
+  std::uint64_t remaining_{0};
+  bool digits_{false};
+
+  void EndSize() {
+    state_ = !digits_ ? FAILED : remaining_ == 0 ? TRAILER : DATA;
+    digits_ = false;
+  }
+
+public:
+  bool Done() const { return state_ == DONE; }
+  bool Failed() const { return state_ == FAILED; }
+
+  // Returns how many bytes of data belong to the message.
+  std::size_t Feed(std::string_view data) {
+    std::size_t i = 0;
+    while (i < data.size() && state_ != DONE && state_ != FAILED) {
+      char c = data[i];
+      if (state_ == DATA) {
+        auto take = std::min<std::uint64_t>(remaining_, data.size() - i);
+        i += take;
+        remaining_ -= take;
+        if (remaining_ == 0) {
+          state_ = DATA_CR;
+        }
+        continue;
+      }
+      ++i;
+      switch (state_) {
+      case SIZE:
+        if (std::isxdigit(static_cast<unsigned char>(c))) {
+          if (remaining_ >> 59) {
+            state_ = FAILED;
+            break;
+          }
+          remaining_ = remaining_ * 16 +
+                       (std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : (c | 0x20) - 'a' + 10);
+          digits_ = true;
+        } else if (c == ';' || c == ' ' || c == '\t') {
+          state_ = EXTENSION;
+        } else if (c == '\r') {
+          state_ = SIZE_LF;
+        } else if (c == '\n') {
+          EndSize();
+        } else {
+          state_ = FAILED;
+        }
+        break;
+      case EXTENSION:
+        if (c == '\r') {
+          state_ = SIZE_LF;
+        } else if (c == '\n') {
+          EndSize();
+        }
+        break;
+      case SIZE_LF:
+        if (c == '\n') {
+          EndSize();
+        } else {
+          state_ = FAILED;
+        }
+        break;
+      case DATA_CR:
+        state_ = c == '\r' ? DATA_LF : c == '\n' ? SIZE : FAILED;
+        break;
+      case DATA_LF:
+        state_ = c == '\n' ? SIZE : FAILED;
+        break;
+      case TRAILER:
+        state_ = c == '\r' ? FINAL_LF : c == '\n' ? DONE : TRAILER_LINE;
+        break;
+      case TRAILER_LINE:
+        if (c == '\n') {
+          state_ = TRAILER;
+        }
+        break;
+      case FINAL_LF:
+        state_ = c == '\n' ? DONE : FAILED;
+        break;
+      default:
+        break;
+      }
+    }
+    return i;
+  }
+};
+
+struct ResponseHead {
+  enum Framing { NONE, LENGTH, CHUNKED, CLOSE };
+  unsigned short status{0};
+  Framing framing{CLOSE};
+  std::uint64_t length{0};
+  bool close{false};
+  std::string forward;
+};
+
+// Rewrites the upstream head for the client without its connection-level
+// headers and works out how the body is delimited.
+bool parseResponseHead(std::string_view head, ResponseHead &out) {
+  auto lineEnd = head.find('\n');
+  auto statusLine = trim(head.substr(0, lineEnd));
+  if (!statusLine.starts_with("HTTP/1.") || statusLine.size() < 12) {
+    return false;
+  }
+  unsigned short status = 0;
+  auto [end, error] = std::from_chars(statusLine.data() + 9, statusLine.data() + 12, status);
+  if (error != std::errc() || status < 100 || status == 101 || status > 999) {
+    return false;
+  }
+  bool http10 = statusLine.starts_with("HTTP/1.0");
+  bool closeHeader = false;
+  bool keepAliveHeader = false;
+  bool chunked = false;
+  bool hasLength = false;
+  out.status = status;
+  out.forward.assign(statusLine);
+  out.forward += "\r\n";
+  auto rest = head.substr(lineEnd + 1);
+  while (!rest.empty()) {
+    auto next = rest.find('\n');
+    auto line = trim(rest.substr(0, next));
+    rest = next == std::string_view::npos ? std::string_view{} : rest.substr(next + 1);
+    if (line.empty()) {
+      break;
+    }
+    auto colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      return false;
+    }
+    auto name = line.substr(0, colon);
+    auto value = trim(line.substr(colon + 1));
+    if (iequals(name, "connection")) {
+      closeHeader = closeHeader || hasToken(value, "close");
+      keepAliveHeader = keepAliveHeader || hasToken(value, "keep-alive");
+      continue;
+    }
+    if (iequals(name, "keep-alive") || iequals(name, "proxy-connection")) {
+      continue;
+    }
+    if (iequals(name, "transfer-encoding")) {
+      chunked = hasToken(value, "chunked");
+    } else if (iequals(name, "content-length")) {
+      auto [last, invalid] =
+          std::from_chars(value.data(), value.data() + value.size(), out.length);
+      if (invalid != std::errc() || last != value.data() + value.size()) {
+        return false;
+      }
+      hasLength = true;
+    }
+    out.forward += line;
+    out.forward += "\r\n";
+  }
+  if (status < 200 || status == 204 || status == 304) {
+    out.framing = ResponseHead::NONE;
+  } else if (chunked) {
+    out.framing = ResponseHead::CHUNKED;
+  } else if (hasLength) {
+    out.framing = ResponseHead::LENGTH;
+  } else {
+    out.framing = ResponseHead::CLOSE;
+  }
+  out.close = closeHeader || (http10 && !keepAliveHeader) || out.framing == ResponseHead::CLOSE;
+  return true;
+}
+
+Coroutine writeAll(IOUring &ring, int fd, std::shared_ptr<std::string> data, bool &ok) {
+  ok = false;
+  size_t sent = 0;
+  while (sent < data->size()) {
+    size_t wrote = co_await ring.WriteAsync(fd, data, sent, data->size() - sent);
+    if (wrote == 0) {
+      co_return;
+    }
+    sent += wrote;
+  }
+  ok = true;
+  co_return;
+}
+
+enum class SpliceStatus { DONE, SOURCE_CLOSED, SINK_FAILED };
+
+// Moves length bytes (or everything up to EOF) between two sockets through
+// the upstream connection's pipe.
+Coroutine spliceThrough(IOUring &ring, int from, int to, const int (&pipe)[2],
+                        std::uint64_t length, std::size_t &moved, SpliceStatus &status) {
+  while (length > 0) {
+    size_t in = co_await ring.SpliceAsync(from, pipe[1], std::min<std::uint64_t>(length, kSpliceChunk));
+    if (in == 0) {
+      status = SpliceStatus::SOURCE_CLOSED;
+      co_return;
+    }
+    size_t out = 0;
+    while (out < in) {
+      size_t wrote = co_await ring.SpliceAsync(pipe[0], to, in - out);
+      if (wrote == 0) {
+        status = SpliceStatus::SINK_FAILED;
+        co_return;
+      }
+      out += wrote;
+    }
+    moved += in;
+    length -= in;
+  }
+  status = SpliceStatus::DONE;
+  co_return;
+}
+} // namespace
+
+Proxy::Proxy(const std::vector<Upstream> &upstreams, ProxyOptions options) : options(options) {
+  if (upstreams.empty()) {
+    throw std::runtime_error("Proxy needs at least one upstream");
+  }
+  for (const auto &upstream : upstreams) {
+    Address address{};
+    auto *v4 = reinterpret_cast<sockaddr_in *>(&address.storage);
+    auto *v6 = reinterpret_cast<sockaddr_in6 *>(&address.storage);
+    if (inet_pton(AF_INET, upstream.host.c_str(), &v4->sin_addr) == 1) {
+      v4->sin_family = AF_INET;
+      v4->sin_port = htons(upstream.port);
+      address.length = sizeof(sockaddr_in);
+    } else if (inet_pton(AF_INET6, upstream.host.c_str(), &v6->sin6_addr) == 1) {
+      v6->sin6_family = AF_INET6;
+      v6->sin6_port = htons(upstream.port);
+      address.length = sizeof(sockaddr_in6);
+    } else {
+      throw std::runtime_error("Invalid upstream address");
+    }
+    this->upstreams.push_back(address);
+  }
+}
+
+ProxyPool::ProxyPool(std::shared_ptr<const Proxy> proxy)
+    : proxy_(std::move(proxy)), upstreams_(proxy_->upstreams.size()) {}
+
+ProxyPool::~ProxyPool() {
+  for (auto &upstream : upstreams_) {
+    for (auto &connection : upstream.idle) {
+      Close(connection);
+    }
+  }
+}
+
+void ProxyPool::Close(Connection &connection) {
+  for (int fd : {connection.fd, connection.pipe[0], connection.pipe[1]}) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+  connection = Connection{};
+}
+
+// Ejected upstreams are skipped; if every untried upstream is ejected they
+// are tried anyway rather than failing outright.
+std::size_t ProxyPool::Pick(Clock::time_point now, const std::vector<bool> &tried) {
+  std::size_t count = upstreams_.size();
+  for (int pass = 0; pass < 2; ++pass) {
+    std::size_t best = count;
+    for (std::size_t i = 0; i < count; ++i) {
+      std::size_t index = (next_ + i) % count;
+      if (tried[index] || (pass == 0 && upstreams_[index].ejectedUntil > now)) {
+        continue;
+      }
+      if (proxy_->options.balance == Balance::ROUND_ROBIN) {
+        best = index;
+        break;
+      }
+      if (best == count || upstreams_[index].outstanding < upstreams_[best].outstanding) {
+        best = index;
+      }
+    }
+    if (best != count) {
+      next_ = best + 1;
+      return best;
+    }
+  }
+  return count;
+}
+
+Coroutine ProxyPool::Acquire(IOUring &ring, std::size_t index, Connection &connection,
+                             bool &reused) {
+  auto &state = upstreams_[index];
+  if (!state.idle.empty()) {
+    connection = state.idle.back();
+    state.idle.pop_back();
+    reused = true;
+    co_return;
+  }
+  reused = false;
+  const auto &address = proxy_->upstreams[index];
+  int fd = socket(address.storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    co_return;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  int result = co_await ring.ConnectAsync(fd, reinterpret_cast<const sockaddr *>(&address.storage),
+                                          address.length);
+  if (result < 0 || pipe2(connection.pipe, O_CLOEXEC) < 0) {
+    close(fd);
+    connection = Connection{};
+    co_return;
+  }
+  connection.fd = fd;
+  co_return;
+}
+
+void ProxyPool::Release(std::size_t index, Connection &connection, bool reusable) {
+  auto &state = upstreams_[index];
+  if (reusable && state.idle.size() < proxy_->options.maxIdlePerUpstream) {
+    state.idle.push_back(connection);
+    connection = Connection{};
+    return;
+  }
+  Close(connection);
+}
+
+void ProxyPool::Succeeded(std::size_t index) { upstreams_[index].failures = 0; }
+
+void ProxyPool::Failed(std::size_t index, Clock::time_point now) {
+  auto &state = upstreams_[index];
+  if (++state.failures >= proxy_->options.failuresToEject) {
+    state.ejectedUntil = now + proxy_->options.ejectFor;
+    state.failures = 0;
+  }
+}
+
+Coroutine ProxyPool::Forward(IOUring &ring, ReadIterator &client, int clientFD,
+                             const RequestData &request, std::string_view peer, bool keepAlive,
+                             ProxyResult &result) {
+  if (request.Header(TRANSFER_ENCODING)) {
+    throw HTTPError(411, "Length Required");
+  }
+  std::uint64_t bodyLength = 0;
+  if (auto length = request.Header(CONTENT_LENGTH)) {
+    auto [end, error] = std::from_chars(length->data(), length->data() + length->size(), bodyLength);
+    if (error != std::errc() || end != length->data() + length->size()) {
+      throw HTTPError(400, "Invalid Content-Length");
+    }
+  }
+  if (client.Available() > 0 && *client == '\n') {
+    client.Advance(1);
+  }
+
+  auto head = std::make_shared<std::string>();
+  head->append(MethodName(request.method));
+  *head += ' ';
+  *head += request.path;
+  if (!request.query.empty()) {
+    *head += '?';
+    *head += request.query;
+  }
+  *head += " HTTP/1.1\r\n";
+  bool forwarded = false;
+  for (const auto &[name, value] : request.headers) {
+    if (hopByHop(name)) {
+      continue;
+    }
+    *head += name;
+    *head += ": ";
+    *head += trim(value);
+    if (iequals(name, "x-forwarded-for")) {
+      *head += ", ";
+      *head += peer;
+      forwarded = true;
+    }
+    *head += "\r\n";
+  }
+  if (!forwarded) {
+    *head += "X-Forwarded-For: ";
+    *head += peer;
+    *head += "\r\n";
+  }
+  *head += "Connection: keep-alive\r\n\r\n";
+  auto buffered = std::min<std::uint64_t>(client.Available(), bodyLength);
+  if (buffered > 0) {
+    head->append(client.CurrentPtr(), buffered);
+    client.Advance(buffered);
+  }
+  std::uint64_t toSplice = bodyLength - buffered;
+  bool ok = false;
+  if (toSplice > 0 && request.Header(EXPECT)) {
+    co_await writeAll(ring, clientFD, continueResponse, ok);
+    if (!ok) {
+      result.keepAlive = false;
+      co_return;
+    }
+  }
+
+  std::vector<bool> tried(upstreams_.size());
+  while (true) {
+    std::size_t index = Pick(Clock::now(), tried);
+    if (index == upstreams_.size()) {
+      throw HTTPError(502, "Bad Gateway");
+    }
+    Connection connection;
+    bool reused = false;
+    co_await Acquire(ring, index, connection, reused);
+    if (connection.fd < 0) {
+      Failed(index, Clock::now());
+      tried[index] = true;
+      continue;
+    }
+    auto &state = upstreams_[index];
+    state.outstanding++;
+    co_await writeAll(ring, connection.fd, head, ok);
+    if (!ok) {
+      state.outstanding--;
+      Close(connection);
+      if (!reused) {
+        Failed(index, Clock::now());
+        tried[index] = true;
+      }
+      continue;
+    }
+    if (toSplice > 0) {
+      std::size_t moved = 0;
+      SpliceStatus status;
+      co_await spliceThrough(ring, clientFD, connection.fd, connection.pipe, toSplice, moved,
+                             status);
+      if (status != SpliceStatus::DONE) {
+        state.outstanding--;
+        Close(connection);
+        if (status == SpliceStatus::SOURCE_CLOSED) {
+          result.keepAlive = false;
+          co_return;
+        }
+        Failed(index, Clock::now());
+        throw HTTPError(502, "Bad Gateway");
+      }
+    }
+
+    ReadIterator upstream(ring, connection.fd);
+    ResponseHead response;
+    bool parsed = false;
+    bool received = false;
+    std::string raw;
+    while (true) {
+      raw.clear();
+      bool complete = false;
+      while (!complete && raw.size() <= kMaxResponseHead) {
+        co_await upstream.Ensure();
+        std::size_t available = upstream.Available();
+        if (available == 0) {
+          break;
+        }
+        received = true;
+        const char *data = upstream.CurrentPtr();
+        std::size_t take = 0;
+        while (take < available && !complete) {
+          raw.push_back(data[take++]);
+          complete = raw.ends_with("\r\n\r\n") || raw.ends_with("\n\n");
+        }
+        upstream.Advance(take);
+      }
+      response = ResponseHead{};
+      parsed = complete && parseResponseHead(raw, response);
+      if (!parsed || response.status >= 200) {
+        break;
+      }
+    }
+    if (!parsed) {
+      state.outstanding--;
+      Close(connection);
+      if (!received && reused && toSplice == 0) {
+        continue;
+      }
+      Failed(index, Clock::now());
+      throw HTTPError(502, "Bad Gateway");
+    }
+
+    result.status = response.status;
+    result.keepAlive = keepAlive && response.framing != ResponseHead::CLOSE;
+    auto out = std::make_shared<std::string>(std::move(response.forward));
+    *out += result.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    std::size_t headSize = out->size();
+    std::uint64_t remaining = 0;
+    ChunkScanner chunks;
+    std::size_t available = upstream.Available();
+    std::size_t take = 0;
+    if (response.framing == ResponseHead::LENGTH) {
+      take = std::min<std::uint64_t>(available, response.length);
+      remaining = response.length - take;
+    } else if (response.framing == ResponseHead::CLOSE) {
+      take = available;
+      remaining = std::numeric_limits<std::uint64_t>::max();
+    } else if (response.framing == ResponseHead::CHUNKED && available > 0) {
+      take = chunks.Feed({upstream.CurrentPtr(), available});
+    }
+    if (take > 0) {
+      out->append(upstream.CurrentPtr(), take);
+      upstream.Advance(take);
+    }
+    result.bytes = out->size() - headSize;
+    co_await writeAll(ring, clientFD, out, ok);
+    bool clean = ok;
+    if (ok && remaining > 0) {
+      std::size_t moved = 0;
+      SpliceStatus status;
+      co_await spliceThrough(ring, connection.fd, clientFD, connection.pipe, remaining, moved,
+                             status);
+      result.bytes += moved;
+      if (response.framing == ResponseHead::CLOSE) {
+        clean = status == SpliceStatus::SOURCE_CLOSED;
+      } else {
+        clean = status == SpliceStatus::DONE;
+      }
+    } else if (ok && response.framing == ResponseHead::CHUNKED) {
+      while (ok && !chunks.Done() && !chunks.Failed()) {
+        co_await upstream.Ensure();
+        available = upstream.Available();
+        if (available == 0) {
+          break;
+        }
+        take = chunks.Feed({upstream.CurrentPtr(), available});
+        auto piece = std::make_shared<std::string>(upstream.CurrentPtr(), take);
+        upstream.Advance(take);
+        co_await writeAll(ring, clientFD, piece, ok);
+        result.bytes += take;
+      }
+      clean = ok && chunks.Done();
+    }
+    state.outstanding--;
+    if (!clean) {
+      result.keepAlive = false;
+    }
+    if (clean || !ok) {
+      Succeeded(index);
+    } else {
+      Failed(index, Clock::now());
+    }
+    Release(index, connection,
+            clean && response.framing != ResponseHead::CLOSE && !response.close &&
+                upstream.Available() == 0);
+    co_return;
+  }
+}
+} // namespace HTTP
@@ -0,0 +1,86 @@
+#pragma once
+#include "coroutine.h"
+#include "io_uring.h"
+#include "read_iterator.h"
+#include "request_data.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <vector>
+namespace HTTP {
+struct Upstream {
+  std::string host; // numeric IPv4 or IPv6 address
+  int port;
+};
+
+enum class Balance { ROUND_ROBIN, LEAST_OUTSTANDING };
+
+struct ProxyOptions {
+  Balance balance{Balance::ROUND_ROBIN};
+  std::size_t maxIdlePerUpstream{32};
+  unsigned failuresToEject{3};
+  std::chrono::milliseconds ejectFor{10000};
+};
+
+// Upstream addresses and options, shared read-only by every worker.
+struct Proxy {
+  struct Address {
+    sockaddr_storage storage;
+    socklen_t length;
+  };
+  std::vector<Address> upstreams;
+  ProxyOptions options;
+
+  Proxy(const std::vector<Upstream> &upstreams, ProxyOptions options);
+};
+
+struct ProxyResult {
+  unsigned short status{502};
+  std::size_t bytes{0};
+  bool keepAlive{false};
+};
+
+// One worker's keep-alive connections and health state for a Proxy. It is
+// only touched from the worker that owns it, so nothing here is synchronized;
+// ejection is likewise decided per worker.
+class ProxyPool {
+  using Clock = std::chrono::steady_clock;
+  struct Connection {
+    int fd{-1};
+    int pipe[2]{-1, -1};
+  };
+  struct UpstreamState {
+    std::vector<Connection> idle;
+    std::size_t outstanding{0};
+    unsigned failures{0};
+    Clock::time_point ejectedUntil{};
+  };
+  std::shared_ptr<const Proxy> proxy_;
+  std::vector<UpstreamState> upstreams_;
+  std::size_t next_{0};
+
+  std::size_t Pick(Clock::time_point now, const std::vector<bool> &tried);
+  Coroutine Acquire(IOUring &ring, std::size_t index, Connection &connection, bool &reused);
+  void Release(std::size_t index, Connection &connection, bool reusable);
+  void Succeeded(std::size_t index);
+  void Failed(std::size_t index, Clock::time_point now);
+  static void Close(Connection &connection);
+
+public:
+  // The pool shares ownership of the Proxy, so it stays valid after the
+  // route table that held it is replaced.
+  explicit ProxyPool(std::shared_ptr<const Proxy> proxy);
+  // True once no route table refers to the Proxy any more.
+  bool Orphaned() const { return proxy_.use_count() == 1; }
+  ProxyPool(const ProxyPool &) = delete;
+  ProxyPool &operator=(const ProxyPool &) = delete;
+  ~ProxyPool();
+  // Forwards a request whose headers have been parsed and streams the
+  // response back to the client. Throws HTTPError only while nothing has
+  // been written to the client yet.
+  Coroutine Forward(IOUring &ring, ReadIterator &client, int clientFD, const RequestData &request,
+                    std::string_view peer, bool keepAlive, ProxyResult &result);
+};
+} // namespace HTTP
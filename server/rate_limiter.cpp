@@ -0,0 +1,166 @@
+#include "rate_limiter.h"
+#include <algorithm>
+#include <cstring>
+#include <netinet/in.h>
+
+namespace HTTP {
+
+namespace {
+constexpr std::uint64_t kValid = 1ull << 63;
+constexpr std::uint64_t kTickMask = (1ull << 31) - 1;
+constexpr std::uint64_t kTokensMask = (1ull << 32) - 1;
+constexpr std::uint64_t kOne = 1024;
+// The state of a slot changing hands. Whoever swaps a valid state for it
+// owns the slot until it stores 0, so no Allow can spend from the bucket
+// meanwhile.
+constexpr std::uint64_t kEvicting = 1;
+
+static std::uint64_t mix(std::uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  x ^= x >> 33;
+  return x;
+}
+
+static std::uint64_t pack(std::uint64_t tokens, std::uint64_t tick) {
+  return kValid | ((tick & kTickMask) << 32) | tokens;
+}
+} // namespace
+
+RateLimiter::RateLimiter(RateLimit limit, std::size_t capacity)
+    : slots_(std::make_unique<Slot[]>(std::max(capacity, kShards))),
+      shardSize_(std::max(capacity, kShards) / kShards),
+      rate_(limit.rate),
+      burst_(std::min<std::uint64_t>(limit.burst * kOne, kTokensMask)),
+      epoch_(Clock::now()) {}
+
+std::uint64_t RateLimiter::Key(const sockaddr_storage &peer) {
+  if (peer.ss_family == AF_INET) {
+    auto *address = reinterpret_cast<const sockaddr_in *>(&peer);
+    return (1ull << 32) | address->sin_addr.s_addr;
+  }
+  if (peer.ss_family == AF_INET6) {
+    auto *address = reinterpret_cast<const sockaddr_in6 *>(&peer);
+    if (IN6_IS_ADDR_V4MAPPED(&address->sin6_addr)) {
+      std::uint32_t v4;
+      std::memcpy(&v4, address->sin6_addr.s6_addr + 12, sizeof(v4));
+      return (1ull << 32) | v4;
+    }
+    std::uint64_t prefix;
+    std::memcpy(&prefix, address->sin6_addr.s6_addr, sizeof(prefix));
+    return mix(prefix) | kValid;
+  }
+  return 0;
+}
+
+std::uint64_t RateLimiter::Tick(Clock::time_point now) const {
+  using Ticks = std::chrono::duration<std::int64_t, std::ratio<1, kOne>>;
+  return std::chrono::duration_cast<Ticks>(now - epoch_).count() & kTickMask;
+}
+
+std::uint64_t RateLimiter::Refill(std::uint64_t state, std::uint64_t tick) const {
+  if (!(state & kValid)) {
+    return burst_;
+  }
+  std::uint64_t tokens = state & kTokensMask;
+  std::uint64_t elapsed = (tick - (state >> 32)) & kTickMask;
+  return std::min<std::uint64_t>(burst_, tokens + elapsed * rate_);
+}
+
+// With every slot in the key's probe window taken, the fullest bucket is
+// handed over to the key: its client is the one the limit holds back least.
+// Ordering by last use would pick throttled clients, whose denied requests
+// leave the state untouched.
+RateLimiter::Slot *RateLimiter::Find(std::uint64_t key, std::uint64_t tick) {
+  std::uint64_t hash = mix(key);
+  Slot *shard = &slots_[(hash % kShards) * shardSize_];
+  std::size_t start = (hash / kShards) % shardSize_;
+  Slot *fullest = nullptr;
+  std::uint64_t most = 0;
+  for (std::size_t probe = 0; probe < kProbes && probe < shardSize_; ++probe) {
+    Slot &slot = shard[(start + probe) % shardSize_];
+    std::uint64_t current = slot.key.load(std::memory_order_acquire);
+    if (current == key) {
+      return &slot;
+    }
+    if (current == 0 &&
+        slot.key.compare_exchange_strong(current, key, std::memory_order_acq_rel)) {
+      return &slot;
+    }
+    if (current == key) {
+      return &slot;
+    }
+    std::uint64_t state = slot.state.load(std::memory_order_relaxed);
+    if ((state & kValid) && (fullest == nullptr || Refill(state, tick) > most)) {
+      fullest = &slot;
+      most = Refill(state, tick);
+    }
+  }
+  if (fullest == nullptr) {
+    return nullptr;
+  }
+  std::uint64_t state = fullest->state.load(std::memory_order_relaxed);
+  if (!(state & kValid) ||
+      !fullest->state.compare_exchange_strong(state, kEvicting, std::memory_order_acq_rel)) {
+    return nullptr;
+  }
+  fullest->key.store(key, std::memory_order_release);
+  fullest->state.store(0, std::memory_order_release);
+  return fullest;
+}
+
+bool RateLimiter::Allow(std::uint64_t key, Clock::time_point now) {
+  if (key == 0) {
+    return true;
+  }
+  std::uint64_t tick = Tick(now);
+  Slot *slot = Find(key, tick);
+  while (slot != nullptr) {
+    std::uint64_t state = slot->state.load(std::memory_order_acquire);
+    // The slot was evicted or handed over since Find returned it.
+    if (state == kEvicting || slot->key.load(std::memory_order_acquire) != key) {
+      slot = Find(key, tick);
+      continue;
+    }
+    std::uint64_t tokens = Refill(state, tick);
+    bool allowed = tokens >= kOne;
+    // A refill too small to add a unit keeps the old tick, so the fraction
+    // still counts next time; a full bucket restarts from now, or the next
+    // request would refill it from the stale tick past burst.
+    std::uint64_t last =
+        tokens == (state & kTokensMask) && tokens < burst_ && (state & kValid) ? state >> 32
+                                                                                : tick;
+    std::uint64_t next = pack(allowed ? tokens - kOne : tokens, last);
+    if (slot->state.compare_exchange_weak(state, next, std::memory_order_acq_rel)) {
+      return allowed;
+    }
+  }
+  // Another request won the handover of the fullest slot; failing closed
+  // keeps a flood of fresh keys from getting past the limit.
+  return false;
+}
+
+void RateLimiter::Evict(Clock::time_point now) {
+  std::uint64_t tick = Tick(now);
+  for (std::size_t i = 0; i < kShards * shardSize_; ++i) {
+    Slot &slot = slots_[i];
+    if (slot.key.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    std::uint64_t state = slot.state.load(std::memory_order_relaxed);
+    if (!(state & kValid) || Refill(state, tick) < burst_) {
+      continue;
+    }
+    // The key is released only while the state holds kEvicting, so an Allow
+    // that found the slot earlier sees the change instead of spending from
+    // a bucket that now belongs to no one.
+    if (slot.state.compare_exchange_strong(state, kEvicting, std::memory_order_acq_rel)) {
+      slot.key.store(0, std::memory_order_release);
+      slot.state.store(0, std::memory_order_release);
+    }
+  }
+}
+
+} // namespace HTTP
@@ -0,0 +1,36 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <sys/socket.h>
+namespace HTTP {
+struct RateLimit {
+  double rate;
+  double burst;
+};
+class RateLimiter {
+  using Clock = std::chrono::steady_clock;
+  struct alignas(16) Slot {
+    std::atomic<std::uint64_t> key{0};
+    std::atomic<std::uint64_t> state{0};
+  };
+  static constexpr std::size_t kShards = 64;
+  static constexpr std::size_t kProbes = 8;
+  std::unique_ptr<Slot[]> slots_;
+  std::size_t shardSize_;
+  double rate_;
+  std::uint64_t burst_;
+  Clock::time_point epoch_;
+
+  Slot *Find(std::uint64_t key, std::uint64_t tick);
+  std::uint64_t Tick(Clock::time_point now) const;
+  std::uint64_t Refill(std::uint64_t state, std::uint64_t tick) const;
+
+public:
+  explicit RateLimiter(RateLimit limit, std::size_t capacity = 1 << 16);
+  static std::uint64_t Key(const sockaddr_storage &peer);
+  bool Allow(std::uint64_t key, Clock::time_point now);
+  void Evict(Clock::time_point now);
+};
+} // namespace HTTP
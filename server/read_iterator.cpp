@@ -1,19 +1,109 @@
 #include "read_iterator.h"
-#include "http_error.h"
+#include "form.h"
 #include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <optional>
 #include <string>
 namespace HTTP {
-ReadIterator::ReadIterator(IOUring &ring, int fd_) : ring_(ring), fd_(fd_), length_(0), position_(0) {
+namespace {
+std::string_view trim(std::string_view s) {
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) {
+    s.remove_prefix(1);
+  }
+  while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+    s.remove_suffix(1);
+  }
+  return s;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(a[i])) !=
+        std::tolower(static_cast<unsigned char>(b[i]))) {
+      return false;
+    }
+  }
+  return true;
 }
 
+int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// Longest chunk-size line (with extensions) and trailer section accepted.
+constexpr size_t kMaxChunkLine = 4096;
+constexpr size_t kMaxTrailers = 8192;
+} // namespace
+
+ReadIterator::ReadIterator(IOUring &ring, int fd_) : ring_(&ring), fd_(fd_), length_(0), position_(0) {
+}
+
+ReadIterator::ReadIterator(std::string_view source) : ring_(nullptr), fd_(-1), source_(source) {}
+
 Coroutine ReadIterator::Ensure() {
   if (position_ >= length_) {
-    length_ = co_await ring_.ReadAsync(fd_, buffer_);
+    if (capture_ != nullptr) {
+      CopyCaptured(length_);
+    }
+    if (ring_ != nullptr) [[likely]] {
+      length_ = co_await ring_->ReadAsync(fd_, buffer_);
+    } else {
+      length_ = std::min(source_.size(), buffer_.size());
+      std::copy_n(source_.data(), length_, buffer_.data());
+      source_.remove_prefix(length_);
+    }
+    received_ += length_;
     position_ = 0;
+    captureFrom_ = 0;
   }
   co_return;
 }
 
+void ReadIterator::CopyCaptured(size_t end) {
+  end = std::min(end, length_);
+  if (end <= captureFrom_) {
+    return;
+  }
+  size_t take = std::min(end - captureFrom_, captureLimit_ - capture_->size());
+  captureTruncated_ = captureTruncated_ || take < end - captureFrom_;
+  capture_->append(buffer_.data() + captureFrom_, take);
+  captureFrom_ = end;
+}
+
+void ReadIterator::StartCapture(std::string &out, size_t limit) {
+  out.clear();
+  capture_ = &out;
+  captureFrom_ = std::min(position_, length_);
+  captureLimit_ = limit;
+  captureTruncated_ = false;
+}
+
+bool ReadIterator::StopCapture() {
+  if (capture_ == nullptr) {
+    return true;
+  }
+  CopyCaptured(position_);
+  // ParseHeaders leaves the blank line's final newline unread; it belongs to
+  // this request, not to the start of the next one.
+  if (position_ < length_ && buffer_[position_] == '\n' && !capture_->empty() &&
+      capture_->back() == '\r' && capture_->size() < captureLimit_) {
+    capture_->push_back('\n');
+  }
+  capture_ = nullptr;
+  return !captureTruncated_;
+}
+
 size_t ReadIterator::Available() const {
   if (position_ >= length_) return 0;
   return length_ - position_;
@@ -44,15 +134,17 @@ char ReadIterator::operator*() {
   return buffer_.at(position_);
 }
 
-Coroutine ReadIterator::ParseMethod(RequestData &data) {
+Coroutine ReadIterator::ParseMethod(RequestData &data, Status &status) {
   co_await Ensure();
   if (length_ == 0) {
-    throw HTTPError(400, "Invalid request");
+    status = {400, "Invalid request"};
+    co_return;
   }
   while (true) {
     co_await Ensure();
     if (!*this) {
-      throw HTTPError(400, "Invalid request");
+      status = {400, "Invalid request"};
+      co_return;
     }
     if (**this != '\r' && **this != '\n') {
       break;
@@ -61,10 +153,11 @@ Coroutine ReadIterator::ParseMethod(RequestData &data) {
   }
   std::string methodString;
   int count{0};
-  while (count < 5) {
+  while (count < 6) {
     co_await Ensure();
     if (!*this) {
-      throw HTTPError(400, "Invalid request");
+      status = {400, "Invalid request"};
+      co_return;
     }
     if (**this == ' ') {
       break;
@@ -93,17 +186,18 @@ Coroutine ReadIterator::ParseMethod(RequestData &data) {
     data.method = GET;
     co_return;
   }
-  throw HTTPError(400, "Invalid request");
+  status = {400, "Invalid request"};
 }
 
-Coroutine ReadIterator::ParseVariables(RequestData &data) {
+Coroutine ReadIterator::ParseVariables(RequestData &data, Status &status) {
   co_await Ensure();
   if (**this != '?' && **this != ' ') {
-    throw HTTPError(400, "Invalid request");
+    status = {400, "Invalid request"};
+    co_return;
   }
   enum { Name, Value } current = Name;
-  std::string name;
-  std::string *value;
+  std::pmr::string name(data.get_allocator());
+  std::pmr::string *value;
   if (**this != '?') {
     co_return;
   }
@@ -111,25 +205,33 @@ Coroutine ReadIterator::ParseVariables(RequestData &data) {
   while (true) {
     co_await Ensure();
     if (!*this) {
-      throw HTTPError(400, "Empty parameter name");
+      status = {400, "Empty parameter name"};
+      co_return;
     }
     if (**this == ' ') {
+      if (current == Value) {
+        PercentDecode(*value, false);
+      }
       break;
     }
+    data.query.push_back(**this);
     if (current == Name) {
       if (**this == '=') {
-        if (name == "") {
-          throw HTTPError(400, "Empty parameter name");
+        if (name.empty()) {
+          status = {400, "Empty parameter name"};
+          co_return;
         }
         current = Value;
-        data.params[name] = "";
+        PercentDecode(name, false);
         value = &data.params[name];
+        value->clear();
       } else {
         name.push_back(**this);
       }
     } else {
       if (**this == '&') {
-        name = "";
+        PercentDecode(*value, false);
+        name.clear();
         value = nullptr;
         current = Name;
       } else {
@@ -141,15 +243,23 @@ Coroutine ReadIterator::ParseVariables(RequestData &data) {
   co_return;
 }
 
-Coroutine ReadIterator::ParseHeaders(RequestData &data) {
+Coroutine ReadIterator::ParseHeaders(RequestData &data, Status &status, size_t maxBytes) {
   enum { Name, Value } current = Name;
-  std::string name;
-  std::string *value;
-  char last = 'a';
+  std::pmr::string name(data.get_allocator());
+  std::pmr::string *value;
+  size_t valueStart = 0;
+  std::optional<KnownHeader> known;
+  char last = '\n';
+  size_t consumed = 0;
   while (true) {
     co_await Ensure();
     if (!*this) {
-      throw HTTPError(400, "Invalid message");
+      status = {400, "Invalid message"};
+      co_return;
+    }
+    if (++consumed > maxBytes) {
+      status = {431, "Request headers too large"};
+      co_return;
     }
     if (**this == '\r') {
       co_await ++*this;
@@ -160,18 +270,42 @@ Coroutine ReadIterator::ParseHeaders(RequestData &data) {
     }
     if (current == Name) {
       if (**this == ':') {
-        if (name == "") {
-          throw HTTPError(400, "Empty header name");
+        if (name.empty()) {
+          status = {400, "Empty header name"};
+          co_return;
         }
         current = Value;
-        data.headers[name] = "";
-        value = &data.headers[name];
+        // A repeated field is joined to the earlier one as a list rather
+        // than replacing it.
+        auto [header, inserted] = data.headers.try_emplace(name);
+        value = &header->second;
+        if (!inserted) {
+          value->append(", ");
+        }
+        valueStart = value->size();
+        known = LookupHeader(name);
       } else {
         name.push_back(**this);
       }
     } else {
       if (**this == '\n') {
-        name = "";
+        if (known) {
+          auto text = trim(std::string_view(*value).substr(valueStart));
+          auto &slot = data.knownHeaders[*known];
+          if (!slot) {
+            slot.emplace(text, data.get_allocator());
+          } else if (*known == CONTENT_LENGTH) {
+            // Two lengths leave the end of the body ambiguous (RFC 9112,
+            // section 6.3), so no guess is made.
+            status = {400, "Duplicate Content-Length"};
+            co_return;
+          } else {
+            slot->append(*known == COOKIE ? "; " : ", ");
+            slot->append(text);
+          }
+          known.reset();
+        }
+        name.clear();
         value = nullptr;
         current = Name;
       } else {
@@ -181,42 +315,140 @@ Coroutine ReadIterator::ParseHeaders(RequestData &data) {
     last = **this;
     co_await ++*this;
   }
+  // Framing the body both ways is how requests are smuggled past proxies.
+  if (data.knownHeaders[CONTENT_LENGTH] && data.knownHeaders[TRANSFER_ENCODING]) {
+    status = {400, "Content-Length with Transfer-Encoding"};
+  }
   co_return;
 }
 
-Coroutine ReadIterator::ParseBody(RequestData &data) {
-  auto it = data.headers.find("Content-Length");
-  if (it != data.headers.end()) {
-    try {
-      size_t length = std::stoul(it->second);
-      data.body.clear();
-      data.body.reserve(length);
+Coroutine ReadIterator::ParseChunked(RequestData &data, Status &status, size_t maxBytes) {
+  data.body.clear();
+  while (true) {
+    size_t size = 0;
+    size_t digits = 0;
+    while (true) {
       co_await Ensure();
-      if (*this && (**this == '\n' || **this == '\r')) {
-        co_await ++*this;
-        co_await Ensure();
-        if (*this && (**this == '\n' || **this == '\r')) {
-          co_await ++*this;
-        }
+      int digit = Available() > 0 ? hex_digit(**this) : -1;
+      if (digit < 0) {
+        break;
       }
-      size_t remaining = length;
-      while (remaining > 0) {
-        co_await Ensure();
-        if (!*this) break;
-        size_t avail = Available();
-        if (avail == 0) continue;
-        size_t take = std::min(avail, remaining);
-        data.body.append(CurrentPtr(), take);
-        Advance(take);
-        remaining -= take;
+      if (size > (maxBytes >> 4)) {
+        status = {413, "Request body too large"};
+        co_return;
       }
-    } catch (...) {
+      size = size * 16 + digit;
+      ++digits;
+      co_await ++*this;
+    }
+    // Skip chunk extensions up to the end of the line.
+    size_t lineBytes = digits;
+    while (Available() > 0 && **this != '\n' && ++lineBytes <= kMaxChunkLine) {
+      co_await ++*this;
+      co_await Ensure();
+    }
+    if (digits == 0 || Available() == 0 || **this != '\n') {
+      status = {400, "Invalid chunked body"};
+      co_return;
+    }
+    co_await ++*this;
+    if (size > maxBytes - data.body.size()) {
+      status = {413, "Request body too large"};
+      co_return;
+    }
+    if (size == 0) {
+      break;
+    }
+    while (size > 0) {
+      co_await Ensure();
+      size_t take = std::min(Available(), size);
+      if (take == 0) {
+        status = {400, "Invalid chunked body"};
+        co_return;
+      }
+      data.body.append(CurrentPtr(), take);
+      Advance(take);
+      size -= take;
+    }
+    co_await Ensure();
+    if (Available() > 0 && **this == '\r') {
+      co_await ++*this;
+      co_await Ensure();
+    }
+    if (Available() == 0 || **this != '\n') {
+      status = {400, "Invalid chunked body"};
+      co_return;
+    }
+    co_await ++*this;
+  }
+  // Trailer fields are read and dropped; an empty line ends the message.
+  size_t trailerBytes = 0;
+  size_t lineBytes = 0;
+  while (true) {
+    co_await Ensure();
+    if (Available() == 0 || ++trailerBytes > kMaxTrailers) {
+      status = {400, "Invalid chunked body"};
+      co_return;
+    }
+    char c = **this;
+    co_await ++*this;
+    if (c == '\n') {
+      if (lineBytes == 0) {
+        break;
+      }
+      lineBytes = 0;
+    } else if (c != '\r') {
+      ++lineBytes;
+    }
+  }
+  co_return;
+}
+
+Coroutine ReadIterator::ParseBody(RequestData &data, Status &status, size_t maxBytes) {
+  auto contentLength = data.Header(CONTENT_LENGTH);
+  if (contentLength) {
+    size_t length = 0;
+    auto [end, error] =
+        std::from_chars(contentLength->data(), contentLength->data() + contentLength->size(), length);
+    if (error != std::errc() || end != contentLength->data() + contentLength->size()) {
+      status = {400, "Invalid Content-Length"};
+      co_return;
+    }
+    if (length > maxBytes) {
+      status = {413, "Request body too large"};
+      co_return;
+    }
+    data.body.clear();
+    data.body.reserve(length);
+    // ParseHeaders stops before the blank line's final newline.
+    if (Available() > 0 && **this == '\n') {
+      co_await ++*this;
+    }
+    size_t remaining = length;
+    while (remaining > 0) {
+      co_await Ensure();
+      size_t avail = Available();
+      if (avail == 0) break;
+      size_t take = std::min(avail, remaining);
+      data.body.append(CurrentPtr(), take);
+      Advance(take);
+      remaining -= take;
     }
     co_return;
   }
 
-  auto it2 = data.headers.find("Transfer-Encoding");
-  if (it2 != data.headers.end() && it2->second == "chunked") {
+  auto transferEncoding = data.Header(TRANSFER_ENCODING);
+  if (transferEncoding) {
+    // Only chunked framing is decoded; with any other coding the end of the
+    // body is unknown, so the connection cannot stay in step.
+    if (!iequals(*transferEncoding, "chunked")) {
+      status = {501, "Transfer-Encoding not supported"};
+      co_return;
+    }
+    if (Available() > 0 && **this == '\n') {
+      co_await ++*this;
+    }
+    co_await ParseChunked(data, status, maxBytes);
     co_return;
   }
 
@@ -236,6 +468,10 @@ Coroutine ReadIterator::ParseBody(RequestData &data) {
   while (true) {
     co_await Ensure();
     if (!*this) break;
+    if (data.body.size() == maxBytes) {
+      status = {413, "Request body too large"};
+      co_return;
+    }
     data.body.push_back(**this);
     co_await ++*this;
   }
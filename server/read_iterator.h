@@ -1,27 +1,50 @@
 #pragma once
 #include "coroutine.h"
+#include "http_error.h"
 #include "io_uring.h"
 #include "request_data.h"
+#include <string>
+#include <string_view>
 namespace HTTP {
 class ReadIterator {
-  IOUring &ring_;
+  IOUring *ring_;
   std::array<char, 256> buffer_;
   size_t length_{0};
   size_t position_{0};
   int fd_;
+  std::string *capture_{nullptr};
+  size_t captureFrom_{0};
+  size_t captureLimit_{0};
+  bool captureTruncated_{false};
+  std::string_view source_;
+  std::uint64_t received_{0};
+
+  void CopyCaptured(size_t end);
+  Coroutine ParseChunked(RequestData &data, Status &status, size_t maxBytes);
 
 public:
   ReadIterator(IOUring &ring, int fd_);
+  // Reads from memory instead of a socket, for benchmarks; Ensure never
+  // suspends.
+  explicit ReadIterator(std::string_view source);
   Coroutine Ensure();
   size_t Available() const;
   const char *CurrentPtr() const;
   void Advance(size_t n);
+  // Bytes read from the socket over the connection's lifetime.
+  std::uint64_t Received() const { return received_; }
   Coroutine operator++();
   char operator*();
   operator bool();
-  Coroutine ParseVariables(RequestData &data);
-  Coroutine ParseHeaders(RequestData &data);
-  Coroutine ParseMethod(RequestData &data);
-  Coroutine ParseBody(RequestData &data);
+  // Copies every byte consumed from now on into out, up to limit bytes.
+  void StartCapture(std::string &out, size_t limit);
+  // Stops copying. Returns false if bytes beyond the limit were left out.
+  bool StopCapture();
+  // The Parse steps leave status untouched on success and set it to the
+  // error response's status otherwise.
+  Coroutine ParseVariables(RequestData &data, Status &status);
+  Coroutine ParseHeaders(RequestData &data, Status &status, size_t maxBytes);
+  Coroutine ParseMethod(RequestData &data, Status &status);
+  Coroutine ParseBody(RequestData &data, Status &status, size_t maxBytes);
 };
 }; // namespace HTTP
@@ -1,19 +1,85 @@
 #pragma once
+#include "header_table.h"
+#include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 namespace HTTP {
 enum Method { GET, PUT, POST, PATCH, DELETE };
+constexpr std::string_view MethodName(Method method) {
+  constexpr std::string_view names[] = {"GET", "PUT", "POST", "PATCH", "DELETE"};
+  return names[method];
+}
+constexpr std::size_t kMaxCaptures = 16;
+// Requests and responses allocate from a polymorphic allocator so the server
+// can back them with the per-connection arena; handlers reach the same arena
+// through get_allocator(). Copies fall back to the default resource.
 struct RequestData {
-  std::unordered_map<std::string, std::string> headers;
-  std::unordered_map<std::string, std::string> params;
-  std::vector<std::string> urlVariables;
-  Method method;
-  std::string body;
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  std::pmr::unordered_map<std::pmr::string, std::pmr::string> headers;
+  std::array<std::optional<std::pmr::string>, KNOWN_HEADER_COUNT> knownHeaders;
+  std::pmr::string path;
+  std::pmr::string query;
+  std::pmr::unordered_map<std::pmr::string, std::pmr::string> params;
+  std::pmr::vector<std::pmr::string> urlVariables;
+  std::pmr::string captureText;
+  std::array<std::uint32_t, kMaxCaptures> captureStarts{};
+  std::size_t captureCount{0};
+  Method method{GET};
+  std::pmr::string body;
+
+  RequestData() = default;
+  explicit RequestData(allocator_type allocator)
+      : headers(allocator), path(allocator), query(allocator), params(allocator),
+        urlVariables(allocator), captureText(allocator), body(allocator) {}
+
+  allocator_type get_allocator() const { return body.get_allocator(); }
+
+  std::optional<std::string_view> Header(KnownHeader header) const {
+    if (!knownHeaders[header]) {
+      return std::nullopt;
+    }
+    return *knownHeaders[header];
+  }
+
+  bool BeginCapture() {
+    if (captureCount == kMaxCaptures) {
+      return false;
+    }
+    captureStarts[captureCount++] = static_cast<std::uint32_t>(captureText.size());
+    return true;
+  }
+
+  std::string_view Capture(std::size_t index) const {
+    if (index >= captureCount) {
+      return {};
+    }
+    std::size_t end = index + 1 < captureCount ? captureStarts[index + 1] : captureText.size();
+    return std::string_view(captureText).substr(captureStarts[index], end - captureStarts[index]);
+  }
+
+  void MaterializeCaptures() {
+    urlVariables.clear();
+    for (std::size_t i = 0; i < captureCount; ++i) {
+      urlVariables.emplace_back(Capture(i));
+    }
+  }
 };
 struct ResponseData {
-  std::unordered_map<std::string, std::string> headers;
-  std::string body;
-  unsigned short status;
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  std::pmr::unordered_map<std::pmr::string, std::pmr::string> headers;
+  std::pmr::string body;
+  unsigned short status{200};
+
+  ResponseData() = default;
+  explicit ResponseData(allocator_type allocator) : headers(allocator), body(allocator) {}
+
+  allocator_type get_allocator() const { return body.get_allocator(); }
 };
 } // namespace HTTP
@@ -0,0 +1,63 @@
+#pragma once
+#include "coalesce.h"
+#include "compression.h"
+#include "file_io.h"
+#include "form.h"
+#include "proxy.h"
+#include "rate_limiter.h"
+#include "request_data.h"
+#include "websocket.h"
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+namespace HTTP {
+using RespondType = std::function<ResponseData(const RequestData &)>;
+// A handler that may suspend, e.g. on HandlerContext::files, and fills in
+// response before it returns.
+using AsyncHandler =
+    std::function<Coroutine(HandlerContext &, const RequestData &, ResponseData &)>;
+struct RouteOptions {
+  std::optional<RateLimit> rateLimit;
+  std::optional<CompressionOptions> compression;
+  // Tag 200 responses with a strong ETag hashed from the body and answer a
+  // matching If-None-Match with a body-less 304.
+  bool etag{false};
+  // For GET handler routes: identical requests in flight at once, on any
+  // worker, share one handler run and its serialized response. Requests are
+  // identical when their path and query match, and, where the route
+  // compresses or tags, their negotiated encoding and If-None-Match. Only
+  // for handlers whose response depends on nothing else in the request.
+  bool coalesce{false};
+};
+struct CachedResponse {
+  ResponseData responses[ENCODING_COUNT];
+  std::shared_ptr<std::string> bodies[ENCODING_COUNT];
+  // With RouteOptions::etag, the tag of each encoded body and the 304 sent
+  // in place of responses[i] when it matches.
+  std::string etags[ENCODING_COUNT];
+  ResponseData notModified[ENCODING_COUNT];
+};
+using TypedRespond = ResponseData (*)(const void *, const RequestData &);
+using TypedMatch = bool (*)(const RequestData &);
+struct Route {
+  RespondType respond;
+  TypedRespond typed{nullptr};
+  // For typed routes: whether the captures convert to their declared types.
+  TypedMatch matches{nullptr};
+  std::shared_ptr<const void> handler;
+  std::shared_ptr<RateLimiter> rateLimiter;
+  std::optional<CompressionOptions> compression;
+  bool etag{false};
+  std::shared_ptr<Coalescer> coalescer;
+  std::shared_ptr<const CachedResponse> cached;
+  std::shared_ptr<const WebSocketHandler> webSocket;
+  std::shared_ptr<const Proxy> proxy;
+  std::shared_ptr<const FormRoute> form;
+  AsyncHandler async;
+
+  ResponseData Respond(const RequestData &request) const {
+    return typed ? typed(handler.get(), request) : respond(request);
+  }
+};
+} // namespace HTTP
@@ -0,0 +1,98 @@
+#include "route_table.h"
+#include <algorithm>
+namespace HTTP {
+RouteTables::Pin::Pin(Pin &&rhs) noexcept
+    : reader_(std::exchange(rhs.reader_, nullptr)), version_(std::exchange(rhs.version_, nullptr)) {}
+
+RouteTables::Pin &RouteTables::Pin::operator=(Pin &&rhs) noexcept {
+  if (this != &rhs) {
+    if (reader_ != nullptr) {
+      reader_->Release(version_->number);
+    }
+    reader_ = std::exchange(rhs.reader_, nullptr);
+    version_ = std::exchange(rhs.version_, nullptr);
+  }
+  return *this;
+}
+
+RouteTables::Pin::~Pin() {
+  if (reader_ != nullptr) {
+    reader_->Release(version_->number);
+  }
+}
+
+RouteTables::Reader::Reader(RouteTables &tables) : tables_(tables) {
+  std::lock_guard lock(tables_.mutex_);
+  tables_.readers_.push_back(this);
+}
+
+RouteTables::Reader::~Reader() {
+  std::lock_guard lock(tables_.mutex_);
+  tables_.readers_.erase(std::find(tables_.readers_.begin(), tables_.readers_.end(), this));
+}
+
+RouteTables::Pin RouteTables::Reader::Acquire() {
+  if (pins_.empty()) {
+    // Announce before loading: a publisher either sees the announcement and
+    // keeps the version, or published first and this load sees the new one.
+    oldest_.store(tables_.number_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+  }
+  const Version *version = tables_.current_.load(std::memory_order_seq_cst);
+  if (pins_.empty() || pins_.back().first != version->number) {
+    pins_.emplace_back(version->number, 0);
+  }
+  ++pins_.back().second;
+  return Pin(this, version);
+}
+
+void RouteTables::Reader::Release(std::uint64_t number) {
+  for (auto &[pinned, count] : pins_) {
+    if (pinned == number) {
+      --count;
+      break;
+    }
+  }
+  if (pins_.front().second != 0) {
+    return;
+  }
+  auto live = std::find_if(pins_.begin(), pins_.end(),
+                           [](const auto &entry) { return entry.second != 0; });
+  pins_.erase(pins_.begin(), live);
+  oldest_.store(pins_.empty() ? kQuiescent : pins_.front().first, std::memory_order_seq_cst);
+  if (tables_.retiredCount_.load(std::memory_order_relaxed) > 0) {
+    tables_.Reclaim();
+  }
+}
+
+RouteTables::RouteTables(std::unique_ptr<const RouteTable> initial)
+    : live_(std::make_unique<Version>(Version{std::move(initial), 1})) {
+  current_.store(live_.get());
+}
+
+void RouteTables::Publish(std::unique_ptr<const RouteTable> table) {
+  std::lock_guard lock(mutex_);
+  std::uint64_t number = live_->number + 1;
+  retired_.push_back(std::move(live_));
+  live_ = std::make_unique<Version>(Version{std::move(table), number});
+  current_.store(live_.get(), std::memory_order_seq_cst);
+  number_.store(number, std::memory_order_seq_cst);
+  retiredCount_.store(retired_.size(), std::memory_order_relaxed);
+  ReclaimLocked();
+}
+
+void RouteTables::Reclaim() {
+  std::unique_lock lock(mutex_, std::try_to_lock);
+  if (lock.owns_lock()) {
+    ReclaimLocked();
+  }
+}
+
+void RouteTables::ReclaimLocked() {
+  std::uint64_t oldest = kQuiescent;
+  for (const Reader *reader : readers_) {
+    oldest = std::min(oldest, reader->oldest_.load(std::memory_order_seq_cst));
+  }
+  std::erase_if(retired_, [oldest](const auto &version) { return version->number < oldest; });
+  retiredCount_.store(retired_.size(), std::memory_order_relaxed);
+}
+} // namespace HTTP
@@ -0,0 +1,88 @@
+#pragma once
+#include "rate_limiter.h"
+#include "trie.h"
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+namespace HTTP {
+// An immutable set of routes. ServerBuilder::BuildRoutes makes one, and
+// Server::PublishRoutes swaps it in while the server runs.
+struct RouteTable {
+  Trie trie;
+  // The per-route limiters, swept by the server's eviction thread.
+  std::vector<std::shared_ptr<RateLimiter>> rateLimiters;
+};
+
+// Publishes route tables to worker threads RCU style. A reader loads the
+// current table with one atomic read and pins its version while it uses it.
+// A replaced table is destroyed once no reader still pins that version or an
+// older one. Publishers never wait for readers, and readers never lock.
+class RouteTables {
+  struct Version {
+    std::unique_ptr<const RouteTable> table;
+    std::uint64_t number;
+  };
+  static constexpr std::uint64_t kQuiescent = std::numeric_limits<std::uint64_t>::max();
+
+public:
+  class Reader;
+  // Keeps one version alive until destroyed.
+  class Pin {
+    Reader *reader_{nullptr};
+    const Version *version_{nullptr};
+    friend class Reader;
+    Pin(Reader *reader, const Version *version) : reader_(reader), version_(version) {}
+
+  public:
+    Pin() = default;
+    Pin(Pin &&rhs) noexcept;
+    Pin &operator=(Pin &&rhs) noexcept;
+    ~Pin();
+    const RouteTable &operator*() const { return *version_->table; }
+    const RouteTable *operator->() const { return version_->table.get(); }
+    std::uint64_t Number() const { return version_->number; }
+  };
+
+  // One per thread that looks up routes; a Reader is not thread-safe.
+  class Reader {
+    RouteTables &tables_;
+    // The oldest version this reader may still use, or kQuiescent.
+    std::atomic<std::uint64_t> oldest_{kQuiescent};
+    // Live pins per version, oldest first.
+    std::vector<std::pair<std::uint64_t, std::size_t>> pins_;
+    friend class Pin;
+    friend class RouteTables;
+    void Release(std::uint64_t number);
+
+  public:
+    explicit Reader(RouteTables &tables);
+    Reader(const Reader &) = delete;
+    Reader &operator=(const Reader &) = delete;
+    ~Reader();
+    Pin Acquire();
+  };
+
+  explicit RouteTables(std::unique_ptr<const RouteTable> initial);
+  RouteTables(const RouteTables &) = delete;
+  RouteTables &operator=(const RouteTables &) = delete;
+  void Publish(std::unique_ptr<const RouteTable> table);
+  // Destroys the replaced tables no reader can reach any more. Returns at
+  // once if another thread holds the lock.
+  void Reclaim();
+
+private:
+  std::atomic<const Version *> current_;
+  std::atomic<std::uint64_t> number_{1};
+  std::atomic<std::size_t> retiredCount_{0};
+  std::mutex mutex_;
+  std::unique_ptr<Version> live_;
+  std::vector<std::unique_ptr<Version>> retired_;
+  std::vector<Reader *> readers_;
+
+  void ReclaimLocked();
+};
+} // namespace HTTP
@@ -1,26 +1,42 @@
 #include "server.h"
 #include "coroutine.h"
+#include "etag.h"
+#include "handoff.h"
+#include "http2.h"
 #include "http_error.h"
 #include "read_iterator.h"
 #include "request_data.h"
 #include "trie.h"
 #include <algorithm>
+#include <arpa/inet.h>
 #include <cctype>
+#include <charconv>
+#include <cstdio>
 #include <csignal>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <netinet/in.h>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
+#include <sys/prctl.h>
 #include <sys/socket.h>
+#include <sys/wait.h>
 #include <thread>
 #include <unistd.h>
+#include <utility>
 #include <vector>
 
 namespace HTTP {
 
 namespace {
+// Connections shed at accept, per worker, that are still read to the end
+// before closing; past this they are closed at once.
+constexpr std::size_t kMaxLingering = 256;
+constexpr std::size_t kMaxLingerBytes = 64 * 1024;
+constexpr auto kLingerTime = std::chrono::seconds(1);
+
 static bool iequals(std::string_view a, std::string_view b) {
   if (a.size() != b.size())
     return false;
@@ -33,67 +49,481 @@ static bool iequals(std::string_view a, std::string_view b) {
   return true;
 }
 
-static std::string trim_copy(std::string_view s) {
-  size_t start = 0;
-  while (start < s.size() &&
-         std::isspace(static_cast<unsigned char>(s[start]))) {
-    ++start;
+static const std::shared_ptr<std::string> switchingToHttp2 =
+    std::make_shared<std::string>("HTTP/1.1 101 Switching Protocols\r\n"
+                                  "Connection: Upgrade\r\n"
+                                  "Upgrade: h2c\r\n\r\n");
+
+static const std::shared_ptr<std::string> continueResponse =
+    std::make_shared<std::string>("HTTP/1.1 100 Continue\r\n\r\n");
+
+static bool wants_close(const RequestData &request) {
+  auto v = request.Header(CONNECTION);
+  if (!v)
+    return false;
+  constexpr std::string_view token = "close";
+  for (size_t i = 0; i + token.size() <= v->size(); ++i) {
+    if (iequals(v->substr(i, token.size()), token)) {
+      return true;
+    }
   }
-  size_t end = s.size();
-  while (end > start && std::isspace(static_cast<unsigned char>(s[end - 1]))) {
-    --end;
+  return false;
+}
+
+// Whether a GET carries an If-None-Match that matches etag. Other methods
+// would need 412 Precondition Failed instead, which is left to handlers.
+static bool NotModified(const RequestData &request, std::string_view etag) {
+  if (request.method != GET || etag.empty()) {
+    return false;
   }
-  return std::string(s.substr(start, end - start));
+  auto ifNoneMatch = request.Header(IF_NONE_MATCH);
+  return ifNoneMatch && ETagMatches(*ifNoneMatch, etag);
 }
 
-static std::optional<std::string_view>
-find_header_ci(const std::unordered_map<std::string, std::string> &headers,
-               std::string_view key) {
-  for (const auto &[k, v] : headers) {
-    if (iequals(k, key))
-      return v;
+// Tags a 200 response with the hash of its (possibly compressed) body, unless
+// the handler set its own ETag, and turns it into a 304 when the client has
+// that representation already.
+static void ApplyETag(const RequestData &request, ResponseData &response) {
+  if (response.status != 200) {
+    return;
+  }
+  auto existing = response.headers.find("ETag");
+  if (existing == response.headers.end()) {
+    existing = response.headers.emplace("ETag", View(MakeETag(HashBody(response.body)))).first;
+  }
+  if (NotModified(request, existing->second)) {
+    MakeNotModified(response);
   }
-  return std::nullopt;
 }
 
-static bool wants_close(const RequestData &request) {
-  auto v = find_header_ci(request.headers, "Connection");
-  if (!v)
-    return false;
-  std::string value = trim_copy(*v);
-  for (auto &ch : value)
-    ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
-  return value.find("close") != std::string::npos;
+// The handler for the request's method on the trie node its path ended at,
+// or nullptr with status set to 404 or 405. A typed route whose captures do
+// not convert is not found.
+template <typename Node>
+static const Route *pick_handler(const Node *node, RequestData &data, Status &status) {
+  if (node == nullptr || node->allow.empty()) {
+    status = {404, "Not found"};
+    return nullptr;
+  }
+  if (!node->handlers[data.method]) {
+    status = {405, "Method not allowed", node->allow, &*node->notAllowed};
+    return nullptr;
+  }
+  const Route *route = &*node->handlers[data.method];
+  if (route->typed && !route->matches(data)) {
+    status = {404, "Not found"};
+    return nullptr;
+  }
+  if (!route->typed) {
+    data.MaterializeCaptures();
+  }
+  return route;
+}
+
+// Common Log Format followed by the service time in microseconds.
+static void log_request(AccessLog &log, const DateHeader &date, std::string_view peer,
+                        const RequestData &request, unsigned status, std::size_t bytes,
+                        std::chrono::steady_clock::time_point start,
+                        std::chrono::steady_clock::time_point end) {
+  char record[1024];
+  auto micros = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+  std::string_view when = date.Date();
+  std::string_view path = request.path.empty() ? std::string_view("-") : request.path;
+  std::string_view method = MethodName(request.method);
+  int length = std::snprintf(record, sizeof(record), "%.*s - - [%.*s] \"%.*s %.*s HTTP/1.1\" %u %zu %lld\n",
+                             static_cast<int>(peer.size()), peer.data(),
+                             static_cast<int>(when.size()), when.data(),
+                             static_cast<int>(method.size()), method.data(),
+                             static_cast<int>(path.size()),
+                             path.data(), status, bytes, static_cast<long long>(micros));
+  if (length <= 0) {
+    return;
+  }
+  if (static_cast<std::size_t>(length) >= sizeof(record)) {
+    length = sizeof(record) - 1;
+    record[length - 1] = '\n';
+  }
+  log.Append({record, static_cast<std::size_t>(length)}, end);
+}
+
+static void format_peer(const sockaddr_storage &peer, char *text, socklen_t size) {
+  const void *address = nullptr;
+  if (peer.ss_family == AF_INET) {
+    address = &reinterpret_cast<const sockaddr_in &>(peer).sin_addr;
+  } else if (peer.ss_family == AF_INET6) {
+    address = &reinterpret_cast<const sockaddr_in6 &>(peer).sin6_addr;
+  }
+  if (address == nullptr || inet_ntop(peer.ss_family, address, text, size) == nullptr) {
+    std::snprintf(text, size, "-");
+  }
+}
+
+static void append_number(std::string &text, std::size_t value) {
+  char digits[24];
+  auto end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+  text.append(digits, end);
+}
+
+// Records the bytes one request consumed when it goes out of scope, however
+// the request ends. A null log disables it.
+class RequestCapture {
+  AccessLog *log_;
+  ReadIterator &iterator_;
+  std::string &bytes_;
+  std::string &record_;
+  CaptureHeader header_;
+
+public:
+  RequestCapture(AccessLog *log, ReadIterator &iterator, std::string &bytes, std::string &record,
+                 std::uint64_t connection, std::size_t limit)
+      : log_(log), iterator_(iterator), bytes_(bytes), record_(record) {
+    if (log_ != nullptr) {
+      header_.connection = connection;
+      iterator_.StartCapture(bytes_, limit);
+    }
+  }
+  RequestCapture(const RequestCapture &) = delete;
+  RequestCapture &operator=(const RequestCapture &) = delete;
+  ~RequestCapture() {
+    if (log_ == nullptr) {
+      return;
+    }
+    if (!iterator_.StopCapture()) {
+      header_.flags |= CAPTURE_TRUNCATED;
+    }
+    if (bytes_.empty()) {
+      return;
+    }
+    record_.clear();
+    AppendCapture(record_, header_, bytes_);
+    log_->Append(record_, std::chrono::steady_clock::now());
+  }
+  void Arrived() {
+    if (log_ != nullptr) {
+      header_.arrival = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+    }
+  }
+  // For connections that leave HTTP/1.1 requests behind: HTTP/2 and
+  // WebSockets are not captured.
+  void Discard() {
+    if (log_ != nullptr) {
+      iterator_.StopCapture();
+      log_ = nullptr;
+    }
+  }
+};
+
+// Publishes when a synchronous handler started, for reports about a worker
+// too busy in it to sweep its own connections. A null clock disables it.
+class HandlerClock {
+  std::atomic<std::int64_t> *since_;
+
+public:
+  explicit HandlerClock(std::atomic<std::int64_t> *since) : since_(since) {
+    if (since_ != nullptr) {
+      since_->store(std::chrono::steady_clock::now().time_since_epoch().count(),
+                    std::memory_order_relaxed);
+    }
+  }
+  HandlerClock(const HandlerClock &) = delete;
+  HandlerClock &operator=(const HandlerClock &) = delete;
+  ~HandlerClock() {
+    if (since_ != nullptr) {
+      since_->store(0, std::memory_order_relaxed);
+    }
+  }
+};
+
+// Points the connection's probe at the request from its first byte until the
+// request goes out of scope, so a sweep never sees a destroyed request.
+class ProbeScope {
+  RequestProbe &probe_;
+
+public:
+  explicit ProbeScope(RequestProbe &probe) : probe_(probe) {}
+  ProbeScope(const ProbeScope &) = delete;
+  ProbeScope &operator=(const ProbeScope &) = delete;
+  ~ProbeScope() { End(); }
+  void Begin(const RequestData &request, const ReadIterator &iterator, bool timed) {
+    probe_.await = AWAIT_READ;
+    probe_.request = &request;
+    probe_.iterator = &iterator;
+    probe_.readBase = iterator.Received() - iterator.Available();
+    probe_.written = 0;
+    if (timed) {
+      probe_.started = std::chrono::steady_clock::now();
+    }
+  }
+  // For connections that leave HTTP/1.1 requests behind.
+  void End() {
+    probe_.request = nullptr;
+    probe_.await = AWAIT_IDLE;
+  }
+};
+
+// The supervisor process that SIGHUP and SIGUSR1 are passed on to, from the
+// process that called Start in prefork mode.
+std::atomic<pid_t> forward_to{-1};
+static_assert(std::atomic<pid_t>::is_always_lock_free);
+
+void forward_signal(int signal) {
+  pid_t supervisor = forward_to.load();
+  if (supervisor > 0) {
+    kill(supervisor, signal);
+  }
+}
+
+// What the supervisor process waits for: stop requests, signals for the
+// workers, and the exit of a worker.
+sigset_t supervisor_signals() {
+  sigset_t signals;
+  sigemptyset(&signals);
+  for (int signal : {SIGTERM, SIGINT, SIGHUP, SIGUSR1, SIGCHLD}) {
+    sigaddset(&signals, signal);
+  }
+  return signals;
 }
 } // namespace
 
 Server::Server(Server &&rhs) {
-  trie_ = std::move(rhs.trie_);
-  socketFD_ = rhs.socketFD_;
+  routes_ = std::move(rhs.routes_);
+  listeners_ = std::move(rhs.listeners_);
+  listenerFDs_ = std::move(rhs.listenerFDs_);
+  handedOff_ = rhs.handedOff_;
+  socketProfile_ = rhs.socketProfile_;
   port_ = rhs.port_;
   numThreads_ = rhs.numThreads_;
+  inheritPath_ = std::move(rhs.inheritPath_);
+  maxConnections_ = rhs.maxConnections_;
+  maxInFlight_ = rhs.maxInFlight_;
+  shedTarget_ = rhs.shedTarget_;
+  shedInterval_ = rhs.shedInterval_;
+  stats_ = std::move(rhs.stats_);
+  rateLimiter_ = std::move(rhs.rateLimiter_);
+  evictionThread_ = std::move(rhs.evictionThread_);
+  maxWebSocketMessage_ = rhs.maxWebSocketMessage_;
+  maxHeaderSize_ = rhs.maxHeaderSize_;
+  maxBodySize_ = rhs.maxBodySize_;
+  arenaSize_ = rhs.arenaSize_;
+  traceRate_ = rhs.traceRate_;
+  traceCapacity_ = rhs.traceCapacity_;
+  accessLog_ = std::move(rhs.accessLog_);
+  capture_ = std::move(rhs.capture_);
+  fileIO_ = rhs.fileIO_;
+  slowRequests_ = std::move(rhs.slowRequests_);
+  slowDumpThread_ = std::move(rhs.slowDumpThread_);
+  offloadThreads_ = rhs.offloadThreads_;
+  evictOnStart_ = rhs.evictOnStart_;
+  offload_ = std::move(rhs.offload_);
+  deadline_ = rhs.deadline_;
   stopFlag_.store(rhs.stopFlag_.load());
   pendingAccepts_.store(rhs.pendingAccepts_.load());
   workerThreads_ = std::move(rhs.workerThreads_);
-  rhs.socketFD_ = -1;
+  prefork_ = rhs.prefork_;
+  sharedStats_ = std::move(rhs.sharedStats_);
+  reservedFDs_ = std::move(rhs.reservedFDs_);
+  processSlot_ = rhs.processSlot_;
+  supervisor_ = std::exchange(rhs.supervisor_, -1);
+  rhs.listeners_.clear();
+  rhs.listenerFDs_.clear();
+  rhs.reservedFDs_.clear();
 }
 
-Server::~Server() {
-  stopFlag_ = true;
-  if (socketFD_ != -1) {
-    shutdown(socketFD_, SHUT_RDWR);
-    close(socketFD_);
-    socketFD_ = -1;
+Server::~Server() { Shutdown(std::chrono::steady_clock::now()); }
+
+void Server::Shutdown(std::chrono::steady_clock::time_point deadline) {
+  if (!stopFlag_.load()) {
+    deadline_ = deadline;
+    stopFlag_.store(true, std::memory_order_release);
+  }
+  if (supervisor_ > 0) {
+    forward_to.store(-1);
+    sharedStats_->Deadline().store(deadline.time_since_epoch().count(),
+                                   std::memory_order_relaxed);
+    kill(supervisor_, SIGTERM);
+    waitpid(supervisor_, nullptr, 0);
+    supervisor_ = -1;
   }
   for (auto &t : workerThreads_) {
     if (t.joinable()) {
       t.join();
     }
   }
+  workerThreads_.clear();
+  {
+    std::lock_guard lock(evictionMutex_);
+    if (evictionThread_.joinable()) {
+      evictionThread_.join();
+    }
+  }
+  if (slowDumpThread_.joinable()) {
+    slowDumpThread_.join();
+  }
+  for (int fd : listenerFDs_) {
+    close(fd);
+  }
+  listenerFDs_.clear();
+  for (int fd : reservedFDs_) {
+    close(fd);
+  }
+  reservedFDs_.clear();
+  // A successor that took over the listeners also took over their paths, and
+  // worker processes share theirs with the supervisor.
+  if (!handedOff_ && processSlot_ < 0) {
+    for (const auto &listener : listeners_) {
+      RemoveListener(listener);
+    }
+  }
+  listeners_.clear();
+}
+
+void Server::HandOff(std::string_view path) {
+  handedOff_ = true;
+  SendListeners(path, listenerFDs_);
+}
+
+void Server::ReopenAccessLog() { AccessLog::RequestReopen(); }
+
+const Stats &Server::GetStats() const {
+  if (sharedStats_ && processSlot_ < 0) {
+    return sharedStats_->Total();
+  }
+  return *stats_;
+}
+
+std::vector<pid_t> Server::WorkerProcesses() {
+  std::vector<pid_t> processes;
+  for (int slot = 0; sharedStats_ && slot < prefork_.processes; ++slot) {
+    processes.push_back(sharedStats_->Pid(slot).load(std::memory_order_relaxed));
+  }
+  return processes;
+}
+
+// Each worker snapshots its own ring buffer on its thread; workers that do not
+// answer within a second (e.g. while shutting down) are left out.
+void Server::DumpTrace(std::ostream &out) {
+  std::vector<std::future<Tracer::Snapshot>> pending;
+  {
+    std::lock_guard lock(workersMutex_);
+    for (auto *worker : workers_) {
+      auto promise = std::make_shared<std::promise<Tracer::Snapshot>>();
+      pending.push_back(promise->get_future());
+      worker->ring.Post([worker, promise] { promise->set_value(worker->tracer.Take()); });
+    }
+  }
+  std::vector<Tracer::Snapshot> snapshots;
+  for (auto &future : pending) {
+    if (future.wait_for(std::chrono::seconds(1)) != std::future_status::ready) {
+      continue;
+    }
+    try {
+      snapshots.push_back(future.get());
+    } catch (const std::future_error &) {
+    }
+  }
+  WriteChromeTrace(out, snapshots);
+}
+
+void Server::DumpSlowRequests(std::ostream &out) {
+  if (slowRequests_) {
+    slowRequests_->Report(out);
+  }
+}
+
+void Server::SweepSlowRequests(Worker &worker, std::chrono::steady_clock::time_point now,
+                               std::vector<SlowRequest> &out) {
+  for (const Connection &connection : worker.connections) {
+    const RequestProbe &probe = connection.probe;
+    if (probe.request == nullptr || now - probe.started < slowRequests_->Options().threshold) {
+      continue;
+    }
+    out.push_back({worker.index, connection.fd, probe.request->method,
+                   std::string(probe.request->path), probe.await, now - probe.started,
+                   probe.iterator->Received() - probe.readBase, probe.written});
+  }
+}
+
+// SIGUSR1 only bumps a counter; this thread notices it and writes the report,
+// which waits on the workers and so cannot run in the handler.
+void Server::SlowDumpLoop() {
+  unsigned seen = SlowRequestMonitor::DumpGeneration();
+  while (!stopFlag_.load()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    unsigned generation = SlowRequestMonitor::DumpGeneration();
+    if (generation != seen) {
+      seen = generation;
+      slowRequests_->Report(std::cerr);
+    }
+  }
+}
+
+void Server::PublishRoutes(std::unique_ptr<RouteTable> routes) {
+  if (supervisor_ > 0) {
+    throw std::runtime_error("Routes cannot be published to running worker processes");
+  }
+  bool limited = !routes->rateLimiters.empty();
+  routes_->Publish(std::move(routes));
+  if (limited && !workerThreads_.empty()) {
+    StartEviction();
+  }
+}
+
+bool Server::Overloaded(Worker &worker) {
+  if (worker.inFlight > maxInFlight_) {
+    return true;
+  }
+  if (!worker.shedder.Enabled()) {
+    return false;
+  }
+  auto now = std::chrono::steady_clock::now();
+  return !worker.shedder.Admit(worker.ring.QueueDelay(now), now);
+}
+
+bool Server::RateLimited(const Route &route, const Connection &connection) {
+  if (!rateLimiter_ && !route.rateLimiter) {
+    return false;
+  }
+  auto now = std::chrono::steady_clock::now();
+  // The route's bucket goes first: a request it denies must not spend the
+  // client's server-wide budget as well.
+  if (route.rateLimiter && !route.rateLimiter->Allow(connection.peerKey, now)) {
+    return true;
+  }
+  return rateLimiter_ && !rateLimiter_->Allow(connection.peerKey, now);
+}
+
+void Server::StartEviction() {
+  std::lock_guard lock(evictionMutex_);
+  if (!evictionThread_.joinable() && !stopFlag_.load()) {
+    evictionThread_ = std::thread([this] { EvictLoop(); });
+  }
+}
+
+void Server::EvictLoop() {
+  RouteTables::Reader reader(*routes_);
+  auto next = std::chrono::steady_clock::now();
+  while (!stopFlag_.load()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto now = std::chrono::steady_clock::now();
+    if (now < next) {
+      continue;
+    }
+    if (rateLimiter_) {
+      rateLimiter_->Evict(now);
+    }
+    auto routes = reader.Acquire();
+    for (auto &limiter : routes->rateLimiters) {
+      limiter->Evict(now);
+    }
+    next = now + std::chrono::seconds(1);
+  }
 }
 
-Coroutine Server::AcceptAndProcess(IOUring &ring) {
-  static thread_local std::vector<Coroutine> processCoros;
+Coroutine Server::AcceptAndProcess(Worker &worker, int listenerFD) {
+  IOUring &ring = worker.ring;
+  auto &processCoros = worker.processCoros;
 
   while (!stopFlag_.load()) {
     processCoros.erase(
@@ -101,7 +531,8 @@ Coroutine Server::AcceptAndProcess(IOUring &ring) {
                        [](const Coroutine &c) { return !c || c.done(); }),
         processCoros.end());
 
-    int connectionFD = co_await ring.AcceptAsync(socketFD_);
+    sockaddr_storage peer{};
+    int connectionFD = co_await ring.AcceptAsync(listenerFD, &peer);
 
     if (connectionFD < 0) {
       if (stopFlag_.load()) {
@@ -110,26 +541,80 @@ Coroutine Server::AcceptAndProcess(IOUring &ring) {
       continue;
     }
 
-    Coroutine proc = Process(ring, connectionFD);
+    if (worker.connections.size() >= maxConnections_) {
+      stats_->shedConnections.fetch_add(1, std::memory_order_relaxed);
+      const auto &text = CannedError(503)->Get(false);
+      (void)send(connectionFD, text->data(), text->size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (worker.lingering.size() < kMaxLingering) {
+        Coroutine linger = Linger(worker, connectionFD);
+        linger.resume();
+        processCoros.push_back(std::move(linger));
+      } else {
+        close(connectionFD);
+      }
+      continue;
+    }
+
+    Coroutine proc = Process(worker, connectionFD, peer);
     proc.resume();
+    ring.TraceRequest(0);
     processCoros.push_back(std::move(proc));
   }
   co_return;
 }
 
-void Server::WorkerLoop(IOUring &ring) {
+// Closing a socket with unread input resets the connection, and the client
+// may drop the 503 along with it. The request is read and discarded until
+// the client closes its side, or for at most kLingerTime.
+Coroutine Server::Linger(Worker &worker, int connectionFD) {
+  (void)shutdown(connectionFD, SHUT_WR);
+  auto entry = worker.lingering.insert(
+      worker.lingering.end(), {connectionFD, std::chrono::steady_clock::now() + kLingerTime});
+  std::array<char, 256> buffer;
+  std::size_t drained = 0;
+  while (drained < kMaxLingerBytes) {
+    std::size_t got = co_await worker.ring.ReadAsync(connectionFD, buffer);
+    if (got == 0) {
+      break;
+    }
+    drained += got;
+  }
+  worker.lingering.erase(entry);
+  close(connectionFD);
+  co_return;
+}
+
+void Server::WorkerLoop(Worker &worker) {
   try {
-    Coroutine acceptCoro = AcceptAndProcess(ring);
-    acceptCoro.resume();
+    std::vector<Coroutine> acceptCoros;
+    for (int fd : listenerFDs_) {
+      acceptCoros.push_back(AcceptAndProcess(worker, fd));
+      acceptCoros.back().resume();
+    }
 
-    while (!stopFlag_.load()) {
-      ring.Poll();
+    while (!stopFlag_.load(std::memory_order_acquire)) {
+      worker.ring.Poll();
+      worker.date.Refresh();
+      if (worker.log.Enabled()) {
+        worker.log.Flush(std::chrono::steady_clock::now());
+      }
+      if (worker.capture.Enabled()) {
+        worker.capture.Flush(std::chrono::steady_clock::now());
+      }
+      if (!worker.lingering.empty()) {
+        ExpireLingering(worker, std::chrono::steady_clock::now());
+      }
 
-      if (acceptCoro.done()) {
-        acceptCoro = AcceptAndProcess(ring);
-        acceptCoro.resume();
+      for (std::size_t i = 0; i < acceptCoros.size(); ++i) {
+        if (acceptCoros[i].done()) {
+          acceptCoros[i] = AcceptAndProcess(worker, listenerFDs_[i]);
+          acceptCoros[i].resume();
+        }
       }
     }
+    Drain(worker);
+    worker.log.Close();
+    worker.capture.Close();
   } catch (const std::exception &e) {
     std::cerr << "[WorkerLoop] Exception: " << e.what() << std::endl;
   } catch (...) {
@@ -137,195 +622,1341 @@ void Server::WorkerLoop(IOUring &ring) {
   }
 }
 
-Coroutine Server::WriteResponse(IOUring &ring, int connectionFD,
-                                const ResponseData &data, bool keepAlive) {
-  std::stringstream text;
-  text << "HTTP/1.1 " << data.status << ' '
-       << (data.status / 100 == 2 ? "OK" : "ERROR") << "\r\n";
-  auto headers = data.headers;
-  if (!headers.contains("Content-Length")) {
-    headers["Content-Length"] = std::to_string(data.body.size());
+void Server::ExpireLingering(Worker &worker, std::chrono::steady_clock::time_point now) {
+  // Shutting down the read side ends the pending read, and Linger closes.
+  for (auto &entry : worker.lingering) {
+    if (entry.deadline > now) {
+      break;
+    }
+    if (!entry.expired) {
+      (void)shutdown(entry.fd, SHUT_RD);
+      entry.expired = true;
+    }
+  }
+}
+
+void Server::Drain(Worker &worker) {
+  IOUring &ring = worker.ring;
+  for (int fd : listenerFDs_) {
+    ring.Cancel(fd);
+  }
+  ExpireLingering(worker, std::chrono::steady_clock::time_point::max());
+  // WebSockets get a Close frame (1001, going away); their handlers see the
+  // client's reply and return, which ends the connection before the deadline.
+  // HTTP/2 sessions get GOAWAY and end once their running streams finish.
+  for (const auto &connection : worker.connections) {
+    if (connection.http2 != nullptr) {
+      connection.http2->Shutdown();
+    } else if (connection.idle) {
+      ring.Cancel(connection.fd);
+    } else if (connection.webSocket != nullptr) {
+      connection.webSocket->Close(1001);
+    }
+  }
+  while (!worker.connections.empty() &&
+         std::chrono::steady_clock::now() < deadline_) {
+    ring.Poll();
+  }
+  ring.CancelAll();
+  auto grace = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+  while (!ring.Idle() && std::chrono::steady_clock::now() < grace) {
+    ring.Poll();
+  }
+  Coalescer::Abandon();
+}
+
+Coroutine Server::CompressResponse(Worker &worker, const CompressionOptions &options,
+                                   const RequestData &request, ResponseData &response) {
+  if (response.body.size() < options.minSize ||
+      std::any_of(response.headers.begin(), response.headers.end(),
+                  [](const auto &header) { return iequals(header.first, "Content-Encoding"); })) {
+    co_return;
+  }
+  response.headers["Vary"] = "Accept-Encoding";
+  auto accept = request.Header(ACCEPT_ENCODING);
+  if (!accept) {
+    co_return;
+  }
+  Encoding encoding = NegotiateEncoding(*accept, options);
+  if (encoding == IDENTITY) {
+    co_return;
+  }
+  auto compress = [&] { response.body = Compress(encoding, options.level, response.body); };
+  if (offload_ && response.body.size() >= options.offloadSize) {
+    co_await OffloadAwaiter(*offload_, worker.ring, compress);
+  } else {
+    compress();
+  }
+  response.headers["Content-Encoding"] = EncodingName(encoding);
+  co_return;
+}
+
+// Serializes into the connection's output buffer, which keeps its capacity
+// across keep-alive requests once the previous write has released it.
+void SerializeResponse(std::string &text, const ResponseData &data, std::size_t bodySize,
+                       bool keepAlive, std::string_view dateBlock) {
+  text += "HTTP/1.1 ";
+  append_number(text, data.status);
+  if (data.status == 304) {
+    text += " Not Modified\r\n";
+  } else {
+    text += data.status / 100 == 2 ? " OK\r\n" : " ERROR\r\n";
+  }
+  bool hasLength = false;
+  bool hasDate = false;
+  bool hasServer = false;
+  for (const auto &[name, value] : data.headers) {
+    hasLength = hasLength || iequals(name, "Content-Length");
+    hasDate = hasDate || iequals(name, "Date");
+    hasServer = hasServer || iequals(name, "Server");
+  }
+  if (data.status != 304 && !hasLength) {
+    text += "Content-Length: ";
+    append_number(text, bodySize);
+    text += "\r\n";
   }
-  headers["Connection"] = keepAlive ? "keep-alive" : "close";
-  for (const auto &[name, value] : headers) {
-    text << name << ": " << value << "\r\n";
+  text += keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+  // dateBlock is the Date line followed by the Server line; a handler's own
+  // value replaces only its line.
+  std::size_t serverLine = dateBlock.find('\n') + 1;
+  if (!hasDate) {
+    text += dateBlock.substr(0, serverLine);
   }
-  text << "\r\n";
-  text << data.body;
-  auto final = std::make_shared<std::string>(text.str());
+  if (!hasServer) {
+    text += dateBlock.substr(serverLine);
+  }
+  for (const auto &[name, value] : data.headers) {
+    if (iequals(name, "Connection")) {
+      continue;
+    }
+    text += name;
+    text += ": ";
+    text += value;
+    text += "\r\n";
+  }
+  text += "\r\n";
+  text += data.body;
+}
+
+Coroutine Server::WriteResponse(Worker &worker, Connection &connection,
+                                const ResponseData &data, bool keepAlive,
+                                std::shared_ptr<std::string> body) {
+  if (!connection.output || connection.output.use_count() > 1) {
+    connection.output = std::make_shared<std::string>();
+  }
+  auto final = connection.output;
+  std::string &text = *final;
+  text.clear();
+  SerializeResponse(text, data, body ? body->size() : data.body.size(), keepAlive,
+                    worker.date.Block());
+  if (body && body->size() <= 16 * 1024) {
+    text += *body;
+    body.reset();
+  }
+  for (auto *part : {&final, &body}) {
+    size_t sent = 0;
+    while (*part && sent < (*part)->size()) {
+      size_t wrote = co_await worker.ring.WriteAsync(connection.fd, *part, sent,
+                                                     (*part)->size() - sent);
+      if (wrote == 0) {
+        co_return;
+      }
+      sent += wrote;
+      connection.probe.written += wrote;
+    }
+  }
+  co_return;
+}
+
+// Serializes a coalesced route's response once for every request sharing
+// it. The body moves out of response.
+static std::shared_ptr<const SharedResponse> share_response(ResponseData &response,
+                                                            std::string_view dateBlock) {
+  auto shared = std::make_shared<SharedResponse>();
+  shared->status = response.status;
+  shared->bodySize = response.body.size();
+  std::pmr::string body = std::move(response.body);
+  response.body.clear();
+  shared->keepAlive = std::make_shared<std::string>();
+  shared->close = std::make_shared<std::string>();
+  SerializeResponse(*shared->keepAlive, response, shared->bodySize, true, dateBlock);
+  SerializeResponse(*shared->close, response, shared->bodySize, false, dateBlock);
+  if (shared->bodySize > 16 * 1024) {
+    shared->body = std::make_shared<std::string>(body);
+  } else {
+    *shared->keepAlive += body;
+    *shared->close += body;
+  }
+  return shared;
+}
+
+// The requests a coalesced route may answer with one response.
+static void coalesce_key(const Route &route, const RequestData &request, std::pmr::string &key) {
+  key = request.path;
+  key += '?';
+  key += request.query;
+  if (route.compression) {
+    auto accept = request.Header(ACCEPT_ENCODING);
+    key += '\0';
+    key += static_cast<char>('0' + (accept ? NegotiateEncoding(*accept, *route.compression)
+                                          : IDENTITY));
+  }
+  if (route.etag) {
+    if (auto ifNoneMatch = request.Header(IF_NONE_MATCH)) {
+      key += '\0';
+      key += *ifNoneMatch;
+    }
+  }
+}
+
+Coroutine Server::WriteShared(Worker &worker, Connection &connection,
+                              const SharedResponse &shared, bool keepAlive) {
+  for (const auto *part : {keepAlive ? &shared.keepAlive : &shared.close, &shared.body}) {
+    size_t sent = 0;
+    while (*part && sent < (*part)->size()) {
+      size_t wrote = co_await worker.ring.WriteAsync(connection.fd, *part, sent,
+                                                     (*part)->size() - sent);
+      if (wrote == 0) {
+        co_return;
+      }
+      sent += wrote;
+      connection.probe.written += wrote;
+    }
+  }
+}
+
+Coroutine Server::ServeWebSocket(Worker &worker, Connection &connection, ReadIterator &iterator,
+                                 const RequestData &request,
+                                 std::shared_ptr<const WebSocketHandler> handler) {
+  IOUring &ring = worker.ring;
+  int connectionFD = connection.fd;
+  auto upgrade = request.Header(UPGRADE);
+  auto key = request.Header(SEC_WEBSOCKET_KEY);
+  auto version = request.Header(SEC_WEBSOCKET_VERSION);
+  if (!upgrade || !iequals(*upgrade, "websocket") || !key || !version || *version != "13") {
+    ResponseData response;
+    response.status = 400;
+    response.body = "Expected a WebSocket upgrade";
+    co_await WriteResponse(worker, connection, response, false);
+    co_return;
+  }
+  auto handshake = std::make_shared<std::string>(
+      "HTTP/1.1 101 Switching Protocols\r\n"
+      "Upgrade: websocket\r\n"
+      "Connection: Upgrade\r\n"
+      "Sec-WebSocket-Accept: " +
+      WebSocketAccept(*key) + "\r\n\r\n");
   size_t sent = 0;
-  while (sent < final->size()) {
-    size_t wrote = co_await ring.WriteAsync(connectionFD, final, sent,
-                                            final->size() - sent);
+  while (sent < handshake->size()) {
+    size_t wrote = co_await ring.WriteAsync(connectionFD, handshake, sent,
+                                            handshake->size() - sent);
     if (wrote == 0) {
-      break;
+      co_return;
     }
     sent += wrote;
   }
+  if (iterator.Available() > 0 && *iterator == '\n') {
+    iterator.Advance(1);
+  }
+  WebSocket socket(ring, iterator, connectionFD, maxWebSocketMessage_);
+  connection.webSocket = &socket;
+  Coroutine writer = socket.Writer();
+  writer.resume();
+  // Upgraded after Drain closed the others.
+  if (stopFlag_.load()) {
+    socket.Close(1001);
+  }
+  try {
+    co_await (*handler)(socket, request);
+  } catch (...) {
+    socket.Close(1011);
+  }
+  socket.Close(1000);
+  co_await socket.Join(writer);
+  connection.webSocket = nullptr;
+  co_return;
+}
+
+Coroutine Server::ServeForm(Worker &worker, Connection &connection, ReadIterator &iterator,
+                            const RequestData &request, ResponseData &response,
+                            const FormRoute &form, Status &status) {
+  auto contentLength = request.Header(CONTENT_LENGTH);
+  if (!contentLength) {
+    status = {411, "Content-Length required"};
+    co_return;
+  }
+  size_t length = 0;
+  auto [end, error] = std::from_chars(contentLength->data(),
+                                      contentLength->data() + contentLength->size(), length);
+  if (error != std::errc() || end != contentLength->data() + contentLength->size()) {
+    status = {400, "Invalid Content-Length"};
+    co_return;
+  }
+  auto contentType = request.Header(CONTENT_TYPE);
+  FormReader reader(iterator, worker.files, contentType ? *contentType : std::string_view{},
+                    length, form.options);
+  if (reader.Status() != 0) {
+    status.code = reader.Status();
+    co_return;
+  }
+  if (request.Header(EXPECT)) {
+    co_await worker.ring.WriteAsync(connection.fd, continueResponse, 0,
+                                    continueResponse->size());
+  }
+  // ParseHeaders stops before the blank line's final newline.
+  if (iterator.Available() > 0 && *iterator == '\n') {
+    iterator.Advance(1);
+  }
+  co_await form.handler(reader, request, response);
+  co_await reader.Skip();
+  if (reader.Status() != 0) {
+    status.code = reader.Status();
+  }
   co_return;
 }
 
-Coroutine Server::Process(IOUring &ring, int connectionFD) {
+Coroutine Server::Process(Worker &worker, int connectionFD,
+                          const sockaddr_storage &peer) {
+  IOUring &ring = worker.ring;
   ReadIterator iterator(ring, connectionFD);
+  auto connection = worker.connections.insert(
+      worker.connections.end(), Connection{connectionFD, RateLimiter::Key(peer)});
+  Arena arena(arenaSize_);
+  Tracer &tracer = worker.tracer;
+  std::uint64_t acceptedAt = tracer.Enabled() ? Tracer::Now() : 0;
+  char peerText[INET6_ADDRSTRLEN] = "-";
+  format_peer(peer, peerText, sizeof(peerText));
+  std::string captured;
+  AccessLog *capture = nullptr;
+  std::uint64_t captureConnection = 0;
+  if (worker.capture.Enabled() && worker.capture.Sample()) {
+    capture = &worker.capture;
+    captureConnection =
+        (static_cast<std::uint64_t>(worker.index) << 40) | ++worker.capturedConnections;
+  }
+  // A connection that switches protocols is served after the loop, once the
+  // arena is released: WebSocket and HTTP/2 never allocate from it. Neither
+  // pins the route table, which would keep every table published meanwhile
+  // alive for the life of the socket.
+  bool http2 = false;
+  std::string upgradeSettings;
+  std::optional<Http2Response> upgraded;
+  std::optional<RequestData> webSocketRequest;
+  std::shared_ptr<const WebSocketHandler> webSocketHandler;
 
   while (true) {
-    ResponseData response;
+    arena.Reset();
+    std::uint32_t trace = tracer.Sample();
+    ring.TraceRequest(trace);
+    if (acceptedAt != 0) {
+      tracer.Record(trace, TRACE_ACCEPT, acceptedAt);
+      acceptedAt = 0;
+    }
+    tracer.Record(trace, TRACE_REQUEST_BEGIN);
+    RequestData request(arena.Allocator());
+    ResponseData response(arena.Allocator());
+    bool logged = worker.log.Enabled() && worker.log.Sample();
+    std::chrono::steady_clock::time_point started;
+    const ResponseData *cached = nullptr;
+    std::shared_ptr<std::string> cachedBody;
+    Coalescer::Flight flight;
     bool keepAlive = true;
     bool mustClose = false;
+    std::optional<std::string> h2Settings;
+    std::shared_ptr<const void> upgradeOwner;
+    RouteTables::Pin routes;
+    while (iterator.Available() > 0 && (*iterator == '\r' || *iterator == '\n')) {
+      iterator.Advance(1);
+    }
+    connection->idle = iterator.Available() == 0;
+    RequestCapture requestCapture(capture, iterator, captured, worker.captureRecord,
+                                  captureConnection,
+                                  capture != nullptr ? capture_->maxRequestBytes : 0);
+    RequestProbe &probe = connection->probe;
+    ProbeScope probeScope(probe);
 
     try {
-      RequestData request;
       co_await iterator.Ensure();
+      requestCapture.Arrived();
+      connection->idle = false;
+      tracer.Record(trace, TRACE_FIRST_BYTE);
+      if (logged) {
+        started = std::chrono::steady_clock::now();
+      }
+      if (Http2Preface({iterator.CurrentPtr(), iterator.Available()})) {
+        requestCapture.Discard();
+        http2 = true;
+        break;
+      }
+      probeScope.Begin(request, iterator, slowRequests_ != nullptr);
+      worker.inFlight++;
       if (!iterator) {
-        mustClose = true;
-        keepAlive = false;
-        throw HTTPError(400, "");
-      }
-      co_await iterator.ParseMethod(request);
-      RespondType handler;
-      co_await GetHandler(request, iterator, handler);
-      co_await iterator.ParseVariables(request);
-      co_await ++iterator;
-      std::string protocol;
-      while (true) {
-        co_await iterator.Ensure();
-        if (!iterator) {
-          throw HTTPError(400, "Invalid request");
+        tracer.Record(trace, TRACE_RESPONSE_DONE);
+        worker.inFlight--;
+        break;
+      }
+      routes = worker.routes.Acquire();
+      if (routes.Number() != worker.routesSeen) {
+        worker.routesSeen = routes.Number();
+        std::erase_if(worker.proxies, [](const auto &pool) { return pool.second->Orphaned(); });
+      }
+      Status status;
+      const Route *route = nullptr;
+      co_await ParseRequestLine(routes->trie, request, iterator, route, status);
+      if (route != nullptr && Overloaded(worker)) {
+        stats_->shedRequests.fetch_add(1, std::memory_order_relaxed);
+        status = {503, "Service Unavailable"};
+      } else if (route != nullptr && RateLimited(*route, *connection)) {
+        stats_->rateLimited.fetch_add(1, std::memory_order_relaxed);
+        status = {429, "Too Many Requests"};
+      }
+      if (status.Ok() || status.Recoverable()) {
+        co_await iterator.ParseHeaders(request, status, maxHeaderSize_);
+      }
+      if (status.Ok() && route->webSocket) {
+        requestCapture.Discard();
+        probeScope.End();
+        worker.inFlight--;
+        // Copies allocate from the default resource.
+        webSocketRequest.emplace(request);
+        webSocketHandler = route->webSocket;
+        break;
+      }
+      if (status.Ok() && route->proxy) {
+        tracer.Record(trace, TRACE_PARSE_DONE);
+        keepAlive = !wants_close(request) && !stopFlag_.load();
+        tracer.Record(trace, TRACE_HANDLER_START);
+        // The proxy outlives the pin: an upstream response can take as long
+        // as it likes without holding replaced tables. Holding it also keeps
+        // the pool from being dropped as orphaned meanwhile.
+        std::shared_ptr<const Proxy> proxy = route->proxy;
+        auto &pool = worker.proxies[proxy.get()];
+        if (!pool) {
+          pool = std::make_unique<ProxyPool>(proxy);
         }
-        char c = *iterator;
-        if (c == '\n') {
+        routes = RouteTables::Pin();
+        ProxyResult result;
+        probe.await = AWAIT_UPSTREAM;
+        co_await pool->Forward(ring, iterator, connectionFD, request, peerText, keepAlive,
+                               result);
+        tracer.Record(trace, TRACE_HANDLER_END);
+        if (logged) {
+          log_request(worker.log, worker.date, peerText, request, result.status, result.bytes,
+                      started, std::chrono::steady_clock::now());
+        }
+        tracer.Record(trace, TRACE_RESPONSE_DONE);
+        worker.inFlight--;
+        if (!result.keepAlive || stopFlag_.load()) {
           break;
         }
-        if (c != '\r') {
-          protocol += c;
+        continue;
+      }
+      if (status.Ok() && route->form) {
+        tracer.Record(trace, TRACE_HANDLER_START);
+        probe.await = AWAIT_HANDLER;
+        co_await ServeForm(worker, *connection, iterator, request, response, *route->form,
+                           status);
+        tracer.Record(trace, TRACE_HANDLER_END);
+      } else if (status.Ok() || status.Recoverable()) {
+        co_await iterator.ParseBody(request, status, maxBodySize_);
+      }
+      tracer.Record(trace, TRACE_PARSE_DONE);
+      if (!status.Ok()) {
+        // Malformed, unroutable and shed requests get a pre-serialized
+        // response; after a 404, 405, 429 or 503 the connection is still in
+        // step and stays open.
+        keepAlive = status.Recoverable() && !wants_close(request) && !stopFlag_.load();
+        const CannedResponse *canned = status.canned ? status.canned : CannedError(status.code);
+        const auto &text = canned->Get(keepAlive);
+        co_await ring.WriteAsync(connectionFD, text, 0, text->size());
+        if (logged) {
+          log_request(worker.log, worker.date, peerText, request, status.code,
+                      canned->bodySize, started, std::chrono::steady_clock::now());
+        }
+        tracer.Record(trace, TRACE_RESPONSE_DONE);
+        worker.inFlight--;
+        if (!keepAlive) {
+          break;
         }
-        co_await ++iterator;
+        continue;
       }
-      if (protocol != "HTTP/1.1") {
-        throw HTTPError(400, "Invalid request");
+      keepAlive = !wants_close(request) && !stopFlag_.load();
+      auto upgrade = request.Header(UPGRADE);
+      auto settings = request.Header(HTTP2_SETTINGS);
+      if (upgrade && settings && iequals(*upgrade, "h2c") && keepAlive) {
+        h2Settings = std::string(*settings);
       }
-      co_await ++iterator;
-      co_await iterator.ParseHeaders(request);
-      co_await iterator.ParseBody(request);
-      keepAlive = !wants_close(request);
-      response = handler(request);
+      tracer.Record(trace, TRACE_HANDLER_START);
+      if (route->cached) {
+        Encoding encoding = IDENTITY;
+        auto accept = request.Header(ACCEPT_ENCODING);
+        if (route->compression && accept) {
+          encoding = NegotiateEncoding(*accept, *route->compression);
+        }
+        if (!route->cached->bodies[encoding]) {
+          encoding = IDENTITY;
+        }
+        cached = &route->cached->responses[encoding];
+        cachedBody = route->cached->bodies[encoding];
+        if (h2Settings) {
+          upgradeOwner = route->cached;
+        }
+        if (route->etag && NotModified(request, route->cached->etags[encoding])) {
+          cached = &route->cached->notModified[encoding];
+          cachedBody.reset();
+        }
+      } else {
+        if (route->coalescer && request.method == GET && !h2Settings) {
+          std::pmr::string key(arena.Allocator());
+          coalesce_key(*route, request, key);
+          probe.await = AWAIT_HANDLER;
+          co_await route->coalescer->Join(ring, key, flight);
+          if (flight.Shared()) {
+            stats_->coalescedRequests.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+        if (!flight.Shared()) {
+          if (route->async) {
+            probe.await = AWAIT_HANDLER;
+            HandlerContext context{worker.files};
+            co_await route->async(context, request, response);
+          } else if (!route->form) {
+            probe.await = AWAIT_HANDLER;
+            HandlerClock clock(slowRequests_ ? &worker.slow.handlerSince : nullptr);
+            response = route->Respond(request);
+          }
+          if (route->compression) {
+            probe.await = AWAIT_OFFLOAD;
+            co_await CompressResponse(worker, *route->compression, request, response);
+          }
+          if (route->etag) {
+            ApplyETag(request, response);
+          }
+        }
+      }
+      tracer.Record(trace, TRACE_HANDLER_END);
     } catch (HTTPError &error) {
+      cached = nullptr;
+      cachedBody.reset();
       response.status = error.status;
       response.body = error.message;
       mustClose = true;
       keepAlive = false;
     } catch (std::runtime_error &error) {
+      cached = nullptr;
+      cachedBody.reset();
       response.status = 500;
       response.body = error.what();
       mustClose = true;
       keepAlive = false;
     } catch (...) {
+      cached = nullptr;
+      cachedBody.reset();
       response.status = 500;
       response.body = "Internal server error";
       mustClose = true;
       keepAlive = false;
     }
 
-    if (!mustClose || response.status != 400 || !response.body.empty()) {
-      co_await WriteResponse(ring, connectionFD, response, keepAlive);
+    // Failures are not shared: when the leader does not publish, the Flight
+    // releases its followers to run the handler themselves.
+    if (flight.Leading() && !mustClose && response.status < 500) {
+      flight.Publish(share_response(response, worker.date.Block()));
     }
-    if (!keepAlive || mustClose) {
-      (void)shutdown(connectionFD, SHUT_WR);
-      close(connectionFD);
+    if (h2Settings && !mustClose) {
+      requestCapture.Discard();
+      probeScope.End();
+      worker.inFlight--;
+      size_t sent = 0;
+      while (sent < switchingToHttp2->size()) {
+        size_t wrote = co_await ring.WriteAsync(connectionFD, switchingToHttp2, sent,
+                                                switchingToHttp2->size() - sent);
+        if (wrote == 0) {
+          break;
+        }
+        sent += wrote;
+      }
+      if (sent < switchingToHttp2->size()) {
+        break;
+      }
+      while (iterator.Available() > 0 && (*iterator == '\r' || *iterator == '\n')) {
+        iterator.Advance(1);
+      }
+      upgraded = Http2Response{ResponseData(response), cached, std::move(upgradeOwner),
+                               std::move(cachedBody)};
+      upgradeSettings = std::move(*h2Settings);
+      http2 = true;
       break;
     }
+
+    const ResponseData &sent = cached ? *cached : response;
+    const SharedResponse *shared = flight.Shared();
+    std::size_t bytes = shared ? shared->bodySize
+                               : sent.body.size() + (cachedBody ? cachedBody->size() : 0);
+    probe.await = AWAIT_WRITE;
+    if (shared) {
+      co_await WriteShared(worker, *connection, *shared, keepAlive);
+    } else {
+      co_await WriteResponse(worker, *connection, sent, keepAlive, std::move(cachedBody));
+    }
+    if (logged) {
+      log_request(worker.log, worker.date, peerText, request, shared ? shared->status : sent.status,
+                  bytes, started, std::chrono::steady_clock::now());
+    }
+    tracer.Record(trace, TRACE_RESPONSE_DONE);
+    worker.inFlight--;
+    if (!keepAlive || mustClose || stopFlag_.load()) {
+      break;
+    }
+  }
+  arena.Release();
+  if (http2) {
+    ring.TraceRequest(0);
+    co_await ServeHttp2(worker, connectionFD, iterator, *connection, upgradeSettings,
+                        upgraded ? &*upgraded : nullptr);
+  } else if (webSocketHandler) {
+    ring.TraceRequest(0);
+    co_await ServeWebSocket(worker, *connection, iterator, *webSocketRequest,
+                            std::move(webSocketHandler));
+  }
+  (void)shutdown(connectionFD, SHUT_WR);
+  close(connectionFD);
+  worker.connections.erase(connection);
+  co_return;
+}
+
+Coroutine Server::ServeStream(Worker &worker, Connection &connection, RequestData &request,
+                              std::string_view target, Http2Response &result) {
+  worker.inFlight++;
+  RouteTables::Pin routes = worker.routes.Acquire();
+  try {
+    Status status;
+    const Route *found = FindRoute(routes->trie, request, target, status);
+    if (found != nullptr && found->webSocket) {
+      status = {400, "WebSocket routes require HTTP/1.1"};
+    } else if (found != nullptr && found->proxy) {
+      status = {400, "Proxy routes require HTTP/1.1"};
+    } else if (found != nullptr && found->form) {
+      status = {400, "Form routes require HTTP/1.1"};
+    }
+    if (!status.Ok()) {
+      result.response.status = status.code;
+      result.response.body = status.message;
+      if (!status.allow.empty()) {
+        result.response.headers["Allow"] = status.allow;
+      }
+      worker.inFlight--;
+      co_return;
+    }
+    const Route &route = *found;
+    if (Overloaded(worker)) {
+      stats_->shedRequests.fetch_add(1, std::memory_order_relaxed);
+      result.response.status = 503;
+      result.response.headers["Retry-After"] = "1";
+    } else if (RateLimited(route, connection)) {
+      stats_->rateLimited.fetch_add(1, std::memory_order_relaxed);
+      result.response.status = 429;
+      result.response.headers["Retry-After"] = "1";
+    } else if (route.cached) {
+      Encoding encoding = IDENTITY;
+      auto accept = request.Header(ACCEPT_ENCODING);
+      if (route.compression && accept) {
+        encoding = NegotiateEncoding(*accept, *route.compression);
+      }
+      if (!route.cached->bodies[encoding]) {
+        encoding = IDENTITY;
+      }
+      result.cached = &route.cached->responses[encoding];
+      result.owner = route.cached;
+      result.body = route.cached->bodies[encoding];
+      if (route.etag && NotModified(request, route.cached->etags[encoding])) {
+        result.cached = &route.cached->notModified[encoding];
+        result.body.reset();
+      }
+    } else {
+      if (route.async) {
+        HandlerContext context{worker.files};
+        co_await route.async(context, request, result.response);
+      } else {
+        result.response = route.Respond(request);
+      }
+      if (route.compression) {
+        co_await CompressResponse(worker, *route.compression, request, result.response);
+      }
+      if (route.etag) {
+        ApplyETag(request, result.response);
+      }
+    }
+  } catch (HTTPError &error) {
+    result = Http2Response{};
+    result.response.status = error.status;
+    result.response.body = error.message;
+  } catch (std::runtime_error &error) {
+    result = Http2Response{};
+    result.response.status = 500;
+    result.response.body = error.what();
+  } catch (...) {
+    result = Http2Response{};
+    result.response.status = 500;
+    result.response.body = "Internal server error";
   }
+  worker.inFlight--;
   co_return;
 }
 
-Coroutine Server::GetHandler(RequestData &data, ReadIterator &iter,
-                             RespondType &handler) {
+Coroutine Server::ServeHttp2(Worker &worker, int connectionFD, ReadIterator &iterator,
+                             Connection &connection, std::string_view settings,
+                             Http2Response *upgraded) {
+  Http2Connection session(
+      worker.ring, iterator, connectionFD, connection.idle, stopFlag_, worker.date, maxBodySize_,
+      [this, &worker, &connection](RequestData &request, std::string_view target,
+                                   Http2Response &result) {
+        return ServeStream(worker, connection, request, target, result);
+      });
+  connection.http2 = &session;
+  co_await session.Serve(settings, upgraded);
+  connection.http2 = nullptr;
+  co_return;
+}
+
+const Route *Server::FindRoute(const Trie &trie, RequestData &data, std::string_view target,
+                               Status &status) {
+  if (target.empty() || target[0] != '/') {
+    status = {400, "Invalid request"};
+    return nullptr;
+  }
+  auto query = target.find('?');
+  auto path = target.substr(0, query);
+  data.path.assign(path);
+  auto current = &trie.GetRoot();
+  bool inVariable = false;
+  for (char c : path) {
+    auto child = current->Child(c);
+    if (child == nullptr && current->any) {
+      if (!inVariable) {
+        inVariable = true;
+        if (!data.BeginCapture()) {
+          status = {414, "Too many path parameters"};
+          return nullptr;
+        }
+      }
+      data.captureText.push_back(c);
+      continue;
+    }
+    inVariable = false;
+    current = child;
+    if (current == nullptr) {
+      break;
+    }
+  }
+  if (query != std::string_view::npos) {
+    auto rest = target.substr(query + 1);
+    data.query.assign(rest);
+    while (!rest.empty()) {
+      auto end = rest.find('&');
+      auto pair = rest.substr(0, end);
+      rest = end == std::string_view::npos ? std::string_view{} : rest.substr(end + 1);
+      auto equals = pair.find('=');
+      if (equals == std::string_view::npos) {
+        continue;
+      }
+      if (equals == 0) {
+        status = {400, "Empty parameter name"};
+        return nullptr;
+      }
+      std::pmr::string name(pair.substr(0, equals), data.get_allocator());
+      PercentDecode(name, false);
+      auto &value = data.params[name];
+      value = pair.substr(equals + 1);
+      PercentDecode(value, false);
+    }
+  }
+  return pick_handler(current, data, status);
+}
+
+Coroutine Server::GetHandler(const Trie &trie, RequestData &data, ReadIterator &iter,
+                             const Route *&route, Status &status) {
   co_await iter.Ensure();
   if (*iter != ' ') {
-    throw HTTPError(400, "Invalid request");
+    status = {400, "Invalid request"};
+    co_return;
   }
   co_await ++iter;
   co_await iter.Ensure();
   if (*iter != '/') {
-    throw HTTPError(400, "Invalid request");
+    status = {400, "Invalid request"};
+    co_return;
   }
-  auto current = &trie_.GetRoot();
+  auto current = &trie.GetRoot();
   bool inVariable = false;
   while (true) {
     co_await iter.Ensure();
     if (!iter) {
-      throw HTTPError(400, "Invalid request");
+      status = {400, "Invalid request"};
+      co_return;
     }
     char c = *iter;
     if (c == ' ' || c == '?') {
       break;
     }
-    if (!current->children.contains(c) && current->any) {
+    data.path.push_back(c);
+    if (current == nullptr) {
+      co_await ++iter;
+      continue;
+    }
+    auto child = current->Child(c);
+    if (child == nullptr && current->any) {
       if (!inVariable) {
         inVariable = true;
-        data.urlVariables.push_back("");
+        if (!data.BeginCapture()) {
+          status = {414, "Too many path parameters"};
+          co_return;
+        }
       }
-      data.urlVariables.back().push_back(c);
+      data.captureText.push_back(c);
       co_await ++iter;
       continue;
     }
     inVariable = false;
-    current = &current->Move(c);
+    current = child;
     co_await ++iter;
   }
-  if (!current->handlers[data.method]) {
-    throw HTTPError(404, "Not found");
-  }
-  handler = *current->handlers[data.method];
+  route = pick_handler(current, data, status);
   co_return;
 }
 
+// Reads the request line up to the first header. A 404 or 405 still reads the
+// rest of the line, so the caller can answer it and keep the connection.
+Coroutine Server::ParseRequestLine(const Trie &trie, RequestData &data, ReadIterator &iter,
+                                   const Route *&route, Status &status) {
+  co_await iter.ParseMethod(data, status);
+  if (!status.Ok()) {
+    co_return;
+  }
+  co_await GetHandler(trie, data, iter, route, status);
+  if (!status.Ok() && !status.Recoverable()) {
+    co_return;
+  }
+  co_await iter.ParseVariables(data, status);
+  if (!status.Ok() && !status.Recoverable()) {
+    co_return;
+  }
+  co_await ++iter;
+  char protocol[8];
+  std::size_t length = 0;
+  while (true) {
+    co_await iter.Ensure();
+    if (!iter) {
+      status = {400, "Invalid request"};
+      co_return;
+    }
+    char c = *iter;
+    if (c == '\n') {
+      break;
+    }
+    if (c != '\r') {
+      if (length == sizeof(protocol)) {
+        status = {400, "Invalid request"};
+        co_return;
+      }
+      protocol[length++] = c;
+    }
+    co_await ++iter;
+  }
+  if (std::string_view(protocol, length) != "HTTP/1.1") {
+    status = {400, "Invalid request"};
+    co_return;
+  }
+  co_await ++iter;
+}
+
 void ServerBuilder::SetPort(int port) { server_.port_ = port; }
 
+void ServerBuilder::AddListener(Listener listener) {
+  server_.listeners_.push_back(std::move(listener));
+}
+
+void ServerBuilder::SetSocketProfile(SocketProfile profile) { server_.socketProfile_ = profile; }
+
 void ServerBuilder::SetThreads(int numThreads) {
   server_.numThreads_ = numThreads;
 }
 
+void ServerBuilder::SetPrefork(PreforkOptions options) { server_.prefork_ = options; }
+
+void ServerBuilder::InheritListener(std::string_view path) {
+  server_.inheritPath_ = path;
+}
+
+void ServerBuilder::SetMaxConnections(std::size_t perWorker) {
+  server_.maxConnections_ = perWorker;
+}
+
+void ServerBuilder::SetMaxInFlight(std::size_t perWorker) {
+  server_.maxInFlight_ = perWorker;
+}
+
+void ServerBuilder::SetShedding(std::chrono::steady_clock::duration target,
+                                std::chrono::steady_clock::duration interval) {
+  server_.shedTarget_ = target;
+  server_.shedInterval_ = interval;
+}
+
+void ServerBuilder::SetRateLimit(RateLimit limit) {
+  server_.rateLimiter_ = std::make_shared<RateLimiter>(limit);
+}
+
+void ServerBuilder::SetOffloadThreads(int numThreads) {
+  server_.offloadThreads_ = numThreads;
+}
+
+void ServerBuilder::SetMaxWebSocketMessage(std::size_t bytes) {
+  server_.maxWebSocketMessage_ = bytes;
+}
+
+void ServerBuilder::SetMaxHeaderSize(std::size_t bytes) { server_.maxHeaderSize_ = bytes; }
+
+void ServerBuilder::SetMaxBodySize(std::size_t bytes) { server_.maxBodySize_ = bytes; }
+
+void ServerBuilder::SetArenaSize(std::size_t bytes) { server_.arenaSize_ = bytes; }
+
+void ServerBuilder::SetAccessLog(AccessLogOptions options) {
+  server_.accessLog_ = std::move(options);
+}
+
+void ServerBuilder::SetCapture(CaptureOptions options) { server_.capture_ = std::move(options); }
+
+void ServerBuilder::SetSlowRequests(SlowRequestOptions options) {
+  server_.slowRequests_ = std::make_shared<SlowRequestMonitor>(options);
+}
+
+void ServerBuilder::AddSlowRequestReport(std::string_view path, RouteOptions options) {
+  if (!server_.slowRequests_) {
+    SetSlowRequests();
+  }
+  AddRequest(
+      GET, path,
+      [monitor = server_.slowRequests_](const RequestData &request) {
+        std::ostringstream out;
+        monitor->Report(out);
+        ResponseData response(request.get_allocator());
+        response.headers["Content-Type"] = "text/plain";
+        response.headers["Cache-Control"] = "no-store";
+        response.body = std::move(out).str();
+        return response;
+      },
+      options);
+}
+
+void ServerBuilder::SetTracing(double sampleRate, std::size_t eventsPerWorker) {
+  server_.traceRate_ = sampleRate;
+  server_.traceCapacity_ = eventsPerWorker;
+}
+
+void ServerBuilder::AddRoute(Method method, std::string_view path, HTTP::Route route,
+                             const RouteOptions &options) {
+  if (options.rateLimit) {
+    route.rateLimiter = std::make_shared<RateLimiter>(*options.rateLimit);
+    routes_->rateLimiters.push_back(route.rateLimiter);
+  }
+  route.compression = options.compression;
+  route.etag = options.etag;
+  if (options.coalesce && method == GET &&
+      (route.respond || route.typed || route.async)) {
+    route.coalescer = std::make_shared<Coalescer>();
+  }
+  routes_->trie.AddRequest(method, std::move(route), path);
+}
+
 void ServerBuilder::AddRequest(Method method, std::string_view path,
-                               RespondType respond) {
-  server_.trie_.AddRequest(method, respond, path);
+                               RespondType respond, RouteOptions options) {
+  AddRoute(method, path, HTTP::Route{std::move(respond)}, options);
+}
+
+void ServerBuilder::AddAsync(Method method, std::string_view path, AsyncHandler handler,
+                             RouteOptions options) {
+  HTTP::Route route;
+  route.async = std::move(handler);
+  AddRoute(method, path, std::move(route), options);
+}
+
+void ServerBuilder::SetFileIO(FileIOOptions options) { server_.fileIO_ = options; }
+
+void ServerBuilder::AddWebSocket(std::string_view path, WebSocketHandler handler,
+                                RouteOptions options) {
+  HTTP::Route route;
+  route.webSocket = std::make_shared<const WebSocketHandler>(std::move(handler));
+  AddRoute(GET, path, std::move(route), options);
+}
+
+void ServerBuilder::AddForm(Method method, std::string_view path, FormHandler handler,
+                            FormOptions formOptions, RouteOptions options) {
+  HTTP::Route route;
+  route.form = std::make_shared<const FormRoute>(FormRoute{std::move(handler), formOptions});
+  AddRoute(method, path, std::move(route), options);
+}
+
+void ServerBuilder::AddProxy(std::string_view prefix, std::vector<Upstream> upstreams,
+                             ProxyOptions options) {
+  HTTP::Route route;
+  route.proxy = std::make_shared<const Proxy>(upstreams, options);
+  std::string path(prefix);
+  path += '*';
+  for (Method method : {GET, PUT, POST, PATCH, DELETE}) {
+    AddRoute(method, path, route, {});
+  }
+}
+
+void ServerBuilder::AddStatic(std::string_view path, ResponseData response,
+                              RouteOptions options) {
+  auto cached = std::make_shared<CachedResponse>();
+  auto body = std::make_shared<std::string>(response.body);
+  response.body.clear();
+  for (int i = 0; i < ENCODING_COUNT; ++i) {
+    auto encoding = static_cast<Encoding>(i);
+    if (encoding != IDENTITY &&
+        (!options.compression || !EncodingSupported(encoding) ||
+         body->size() < options.compression->minSize)) {
+      continue;
+    }
+    cached->responses[i] = response;
+    if (options.compression && body->size() >= options.compression->minSize) {
+      cached->responses[i].headers["Vary"] = "Accept-Encoding";
+    }
+    if (encoding == IDENTITY) {
+      cached->bodies[i] = body;
+      continue;
+    }
+    cached->responses[i].headers["Content-Encoding"] = EncodingName(encoding);
+    cached->bodies[i] =
+        std::make_shared<std::string>(Compress(encoding, options.compression->level, *body));
+  }
+  if (options.etag && response.status == 200) {
+    for (int i = 0; i < ENCODING_COUNT; ++i) {
+      if (!cached->bodies[i]) {
+        continue;
+      }
+      auto existing = cached->responses[i].headers.find("ETag");
+      if (existing != cached->responses[i].headers.end()) {
+        cached->etags[i] = existing->second;
+      } else {
+        cached->etags[i] = View(MakeETag(HashBody(*cached->bodies[i])));
+        cached->responses[i].headers["ETag"] = cached->etags[i];
+      }
+      cached->notModified[i] = cached->responses[i];
+      MakeNotModified(cached->notModified[i]);
+    }
+  }
+  HTTP::Route route;
+  route.cached = std::move(cached);
+  AddRoute(GET, path, std::move(route), options);
+}
+
+std::unique_ptr<RouteTable> ServerBuilder::BuildRoutes() {
+  return std::exchange(routes_, std::make_unique<RouteTable>());
 }
 
 Server ServerBuilder::Build() {
   if (server_.numThreads_ < 1) {
     server_.numThreads_ = 1;
   }
+  server_.evictOnStart_ = server_.rateLimiter_ || !routes_->rateLimiters.empty();
+  server_.routes_ = std::make_unique<RouteTables>(BuildRoutes());
   return std::move(server_);
 }
 
 void Server::Start() {
   std::signal(SIGPIPE, SIG_IGN);
 
-  socketFD_ = socket(AF_INET, SOCK_STREAM, 0);
-  if (socketFD_ == -1) {
-    throw std::runtime_error("Could not open socket");
+  if (!inheritPath_.empty()) {
+    listenerFDs_ = ReceiveListeners(inheritPath_);
   }
-  int reuse = 1;
-  if (setsockopt(socketFD_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) ==
-      -1) {
-    throw std::runtime_error("Could not set socket options");
+  if (accessLog_) {
+    int fd = AccessLog::OpenFile(accessLog_->path);
+    if (fd < 0) {
+      throw std::runtime_error("Could not open access log");
+    }
+    close(fd);
+  }
+  if (capture_) {
+    int fd = AccessLog::OpenFile(capture_->path);
+    if (fd < 0) {
+      throw std::runtime_error("Could not open capture file");
+    }
+    close(fd);
+  }
+  if (prefork_.processes > 1) {
+    Prefork();
+    return;
   }
-  sockaddr_in address{};
-  address.sin_family = AF_INET;
-  address.sin_addr.s_addr = INADDR_ANY;
-  address.sin_port = htons(port_);
-  if (bind(socketFD_, (sockaddr *)&address, sizeof(address)) == -1) {
-    throw std::runtime_error("Could not bind socket");
+  if (listenerFDs_.empty()) {
+    Listen();
+  }
+  StartWorkers();
+}
+
+void Server::StartWorkers() {
+  if (offloadThreads_ > 0) {
+    offload_ = std::make_unique<OffloadPool>(offloadThreads_);
   }
-  if (listen(socketFD_, SOMAXCONN) == -1) {
-    throw std::runtime_error("Could not listen on socket");
+  if (accessLog_ || capture_) {
+    std::signal(SIGHUP, [](int) { AccessLog::RequestReopen(); });
+  }
+  if (slowRequests_ && slowRequests_->Options().dumpOnSignal) {
+    std::signal(SIGUSR1, [](int) { SlowRequestMonitor::RequestDump(); });
+    slowDumpThread_ = std::thread([this] { SlowDumpLoop(); });
   }
   for (int i = 0; i < numThreads_; ++i) {
-    workerThreads_.emplace_back([this] {
-      IOUring ring;
-      WorkerLoop(ring);
+    workerThreads_.emplace_back([this, i] {
+      Worker worker(*routes_);
+      worker.index = i;
+      worker.shedder = LoadShedder(shedTarget_, shedInterval_);
+      worker.ring.TrackQueueDelay(worker.shedder.Enabled());
+      worker.tracer.Configure(traceRate_, traceCapacity_);
+      worker.ring.SetTracer(&worker.tracer);
+      if (socketProfile_.busyPoll.count() > 0) {
+        worker.ring.EnableBusyPoll(socketProfile_.busyPoll, socketProfile_.preferBusyPoll);
+      }
+      if (accessLog_) {
+        worker.log.Open(worker.ring, *accessLog_, stats_->droppedLogRecords);
+      }
+      if (capture_) {
+        worker.capture.Open(worker.ring, CaptureLogOptions(*capture_),
+                            stats_->droppedCaptureRecords);
+      }
+      if (fileIO_.registeredBuffers > 0 && !worker.files.Configure(fileIO_)) {
+        std::cerr << "[FileIO] Could not register buffers; using them unregistered"
+                  << std::endl;
+      }
+      if (slowRequests_) {
+        worker.slow.index = i;
+        worker.slow.ring = &worker.ring;
+        worker.slow.sweep = [this, &worker](auto now, auto &out) {
+          SweepSlowRequests(worker, now, out);
+        };
+        slowRequests_->Register(worker.slow);
+      }
+      {
+        std::lock_guard lock(workersMutex_);
+        workers_.push_back(&worker);
+      }
+      WorkerLoop(worker);
+      if (slowRequests_) {
+        slowRequests_->Unregister(worker.slow);
+      }
+      std::lock_guard lock(workersMutex_);
+      workers_.erase(std::find(workers_.begin(), workers_.end(), &worker));
     });
   }
+  if (evictOnStart_) {
+    StartEviction();
+  }
+}
+
+// Without explicit listeners the server binds every IPv4 address on port_.
+void Server::Listen() {
+  if (listeners_.empty()) {
+    listeners_.push_back(Listener::Tcp("", port_));
+  }
+  try {
+    for (const auto &listener : listeners_) {
+      listenerFDs_.push_back(OpenListener(listener, socketProfile_));
+    }
+  } catch (...) {
+    for (int fd : listenerFDs_) {
+      close(fd);
+    }
+    listenerFDs_.clear();
+    throw;
+  }
+}
+
+// TCP addresses are bound here and listened on by each worker process
+// through SO_REUSEPORT, so the kernel spreads connections over their accept
+// queues. Other listeners, and inherited ones, are shared by all of them.
+void Server::Prefork() {
+  if (listeners_.empty()) {
+    listeners_.push_back(Listener::Tcp("", port_));
+  }
+  bool inherited = !listenerFDs_.empty();
+  try {
+    for (auto &listener : listeners_) {
+      if (inherited) {
+        break;
+      }
+      if (listener.kind == ListenerKind::TCP) {
+        reservedFDs_.push_back(ReserveListener(listener));
+      } else {
+        listenerFDs_.push_back(OpenListener(listener, socketProfile_));
+      }
+    }
+  } catch (...) {
+    for (int fd : reservedFDs_) {
+      close(fd);
+    }
+    for (int fd : listenerFDs_) {
+      close(fd);
+    }
+    reservedFDs_.clear();
+    listenerFDs_.clear();
+    throw;
+  }
+  sharedStats_ = std::make_shared<SharedStats>(prefork_.processes);
+  stats_ = std::shared_ptr<Stats>(sharedStats_, &sharedStats_->Supervisor());
+  // The supervisor takes these with sigtimedwait; blocking them before the
+  // fork keeps one sent early from being lost.
+  sigset_t signals = supervisor_signals();
+  sigset_t previous;
+  pthread_sigmask(SIG_BLOCK, &signals, &previous);
+  // Forked on the thread that called Start, before the server starts any
+  // thread of its own, so the supervisor is single-threaded and may fork and
+  // use the rest of the library freely, as may the workers it forks.
+  pid_t supervisor = fork();
+  if (supervisor == 0) {
+    Supervise();
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+  if (supervisor < 0) {
+    throw std::runtime_error("Could not fork the supervisor process");
+  }
+  supervisor_ = supervisor;
+  forward_to.store(supervisor);
+  if (accessLog_ || capture_) {
+    std::signal(SIGHUP, forward_signal);
+  }
+  if (slowRequests_ && slowRequests_->Options().dumpOnSignal) {
+    std::signal(SIGUSR1, forward_signal);
+  }
+  // Return once every process listens, as Start does with threads.
+  auto until = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (sharedStats_->Listening().load(std::memory_order_acquire) < prefork_.processes &&
+         std::chrono::steady_clock::now() < until && waitpid(supervisor, nullptr, WNOHANG) == 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+// The body of the supervisor process: forks every worker process and
+// replaces any that exits, crashed or not, until it receives SIGTERM. It
+// sleeps in sigtimedwait, which also takes the signals it passes on.
+void Server::Supervise() {
+  using Clock = std::chrono::steady_clock;
+  pid_t parent = getppid();
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+  if (getppid() != parent) {
+    _exit(0);
+  }
+  sigset_t signals = supervisor_signals();
+  std::vector<pid_t> processes(prefork_.processes, -1);
+  std::vector<Clock::time_point> restartAt(processes.size());
+  bool stopping = false;
+  while (true) {
+    auto now = Clock::now();
+    bool running = false;
+    for (std::size_t slot = 0; slot < processes.size(); ++slot) {
+      pid_t &pid = processes[slot];
+      if (pid > 0) {
+        int status;
+        if (waitpid(pid, &status, WNOHANG) != pid) {
+          running = true;
+          if (stopping && now > deadline_ + std::chrono::seconds(1)) {
+            kill(pid, SIGKILL);
+          }
+          continue;
+        }
+        if (!stopping) {
+          std::cerr << "[Prefork] Worker process " << pid;
+          if (WIFSIGNALED(status)) {
+            std::cerr << " was killed by signal " << WTERMSIG(status);
+          } else {
+            std::cerr << " exited with status " << WEXITSTATUS(status);
+          }
+          std::cerr << "; restarting it" << std::endl;
+          stats_->processRestarts.fetch_add(1, std::memory_order_relaxed);
+          restartAt[slot] = now + prefork_.restartDelay;
+        }
+        pid = -1;
+        sharedStats_->Pid(slot).store(-1, std::memory_order_relaxed);
+      }
+      if (stopping || now < restartAt[slot]) {
+        continue;
+      }
+      pid = fork();
+      if (pid == 0) {
+        RunProcess(static_cast<int>(slot));
+      }
+      if (pid < 0) {
+        restartAt[slot] = now + prefork_.restartDelay;
+      } else {
+        running = true;
+        sharedStats_->Pid(slot).store(pid, std::memory_order_relaxed);
+      }
+    }
+    if (stopping && !running) {
+      _exit(0);
+    }
+    timespec tick{0, 10'000'000};
+    int signal = sigtimedwait(&signals, nullptr, &tick);
+    if ((signal == SIGTERM || signal == SIGINT) && !stopping) {
+      stopping = true;
+      // Without a deadline the process that called Start died before
+      // Shutdown; the workers get the usual second.
+      auto ticks = sharedStats_->Deadline().load(std::memory_order_relaxed);
+      deadline_ = ticks != 0 ? Clock::time_point(Clock::duration(ticks)) : Clock::now();
+    }
+    bool forward = signal == SIGTERM || signal == SIGINT ||
+                   (signal == SIGHUP && (accessLog_ || capture_)) ||
+                   (signal == SIGUSR1 && slowRequests_ && slowRequests_->Options().dumpOnSignal);
+    for (pid_t pid : processes) {
+      if (forward && pid > 0) {
+        kill(pid, signal == SIGINT ? SIGTERM : signal);
+      }
+    }
+  }
+}
+
+// The body of a worker process; it exits instead of returning to the code
+// that called Start in the supervisor.
+void Server::RunProcess(int slot) {
+  pid_t supervisor = getppid();
+  prctl(PR_SET_PDEATHSIG, SIGTERM);
+  if (getppid() != supervisor) {
+    _exit(0);
+  }
+  // Only the main thread takes these, in sigwait below; the worker threads
+  // inherit the mask. The rest of the supervisor's mask is lifted.
+  sigset_t stop;
+  sigemptyset(&stop);
+  sigaddset(&stop, SIGTERM);
+  sigaddset(&stop, SIGINT);
+  std::signal(SIGTERM, SIG_DFL);
+  std::signal(SIGINT, SIG_DFL);
+  pthread_sigmask(SIG_SETMASK, &stop, nullptr);
+
+  processSlot_ = slot;
+  stats_ = std::shared_ptr<Stats>(sharedStats_, &sharedStats_->Process(slot));
+  // Without reservations the TCP listeners were inherited and are shared.
+  bool reserved = !reservedFDs_.empty();
+  for (int fd : reservedFDs_) {
+    close(fd);
+  }
+  reservedFDs_.clear();
+  try {
+    for (const auto &listener : listeners_) {
+      if (reserved && listener.kind == ListenerKind::TCP) {
+        listenerFDs_.push_back(OpenListener(listener, socketProfile_));
+      }
+    }
+    StartWorkers();
+  } catch (const std::exception &e) {
+    std::cerr << "[Prefork] Worker process could not start: " << e.what() << std::endl;
+    _exit(1);
+  }
+  sharedStats_->Listening().fetch_add(1, std::memory_order_release);
+  int signal;
+  sigwait(&stop, &signal);
+  Shutdown(std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(
+      sharedStats_->Deadline().load(std::memory_order_relaxed))));
+  _exit(0);
 }
 
 } // namespace HTTP
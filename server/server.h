@@ -1,45 +1,299 @@
 #pragma once
+#include "access_log.h"
+#include "arena.h"
+#include "capture.h"
 #include "coroutine.h"
+#include "date_header.h"
+#include "file_io.h"
+#include "http2.h"
 #include "io_uring.h"
+#include "listener.h"
+#include "load_shedder.h"
+#include "middleware.h"
+#include "offload_pool.h"
+#include "prefork.h"
+#include "proxy.h"
 #include "read_iterator.h"
 #include "request_data.h"
+#include "route_table.h"
+#include "slow_requests.h"
+#include "stats.h"
+#include "trace.h"
 #include "trie.h"
+#include "typed_route.h"
 #include <atomic>
+#include <chrono>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <sys/types.h>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 namespace HTTP {
 class Server {
 private:
-  int socketFD_{-1};
+  struct Connection {
+    int fd;
+    std::uint64_t peerKey{0};
+    bool idle{true};
+    std::shared_ptr<std::string> output;
+    RequestProbe probe;
+    // Set while the connection serves a WebSocket, which Drain closes.
+    WebSocket *webSocket{nullptr};
+    // Set while the connection speaks HTTP/2, which Drain shuts down.
+    Http2Connection *http2{nullptr};
+  };
+  // A connection shed at accept, waiting for the client to close it.
+  struct Lingering {
+    int fd;
+    std::chrono::steady_clock::time_point deadline;
+    bool expired{false};
+  };
+  struct Worker {
+    // Declared first so that it outlives the coroutines pinning its tables.
+    RouteTables::Reader routes;
+    std::uint64_t routesSeen{0};
+    IOUring ring;
+    std::vector<Coroutine> processCoros;
+    std::list<Connection> connections;
+    std::list<Lingering> lingering;
+    std::size_t inFlight{0};
+    LoadShedder shedder;
+    DateHeader date;
+    Tracer tracer;
+    AccessLog log;
+    // Capture records go through a second batched writer.
+    AccessLog capture;
+    std::string captureRecord;
+    std::uint64_t capturedConnections{0};
+    std::uint32_t index{0};
+    std::unordered_map<const Proxy *, std::unique_ptr<ProxyPool>> proxies;
+    SlowRequestMonitor::Worker slow;
+    FileIO files{ring};
+
+    explicit Worker(RouteTables &tables) : routes(tables) {}
+  };
+  std::vector<Listener> listeners_;
+  std::vector<int> listenerFDs_;
+  bool handedOff_{false};
+  SocketProfile socketProfile_;
   int port_{0};
   int numThreads_{1};
-  Trie trie_;
+  std::string inheritPath_;
+  std::size_t maxConnections_{std::numeric_limits<std::size_t>::max()};
+  std::size_t maxInFlight_{std::numeric_limits<std::size_t>::max()};
+  std::chrono::steady_clock::duration shedTarget_{};
+  std::chrono::steady_clock::duration shedInterval_{};
+  // Points into sharedStats_ in prefork mode.
+  std::shared_ptr<Stats> stats_ = std::make_shared<Stats>();
+  std::shared_ptr<RateLimiter> rateLimiter_;
+  bool evictOnStart_{false};
+  std::mutex evictionMutex_;
+  std::thread evictionThread_;
+  std::size_t maxWebSocketMessage_{16 * 1024 * 1024};
+  std::size_t maxHeaderSize_{64 * 1024};
+  std::size_t maxBodySize_{64 * 1024 * 1024};
+  std::size_t arenaSize_{16 * 1024};
+  double traceRate_{0};
+  std::size_t traceCapacity_{1 << 16};
+  std::optional<AccessLogOptions> accessLog_;
+  std::optional<CaptureOptions> capture_;
+  FileIOOptions fileIO_;
+  std::shared_ptr<SlowRequestMonitor> slowRequests_;
+  std::thread slowDumpThread_;
+  std::mutex workersMutex_;
+  std::vector<Worker *> workers_;
+  int offloadThreads_{0};
+  std::unique_ptr<OffloadPool> offload_;
+  std::unique_ptr<RouteTables> routes_;
   std::vector<std::thread> workerThreads_;
+  PreforkOptions prefork_;
+  std::shared_ptr<SharedStats> sharedStats_;
+  // TCP addresses the supervisor holds for the worker processes.
+  std::vector<int> reservedFDs_;
+  // This process's slot in prefork mode; -1 outside the worker processes.
+  int processSlot_{-1};
+  // The supervisor process, in the process that called Start.
+  pid_t supervisor_{-1};
   std::atomic_bool stopFlag_{false};
   std::atomic_int pendingAccepts_{0};
-  
-  void WorkerLoop(IOUring &ring);
-  Coroutine AcceptAndProcess(IOUring &ring);
-  Coroutine GetHandler(RequestData &data, ReadIterator &iter, RespondType &handler);
-  Coroutine WriteResponse(IOUring &ring, int connectionFD, const ResponseData &data,
-                          bool keepAlive);
-  Coroutine Process(IOUring &ring, int connectionFD);
+  std::chrono::steady_clock::time_point deadline_{};
+
+  void Listen();
+  void StartWorkers();
+  void Prefork();
+  [[noreturn]] void Supervise();
+  [[noreturn]] void RunProcess(int slot);
+  void WorkerLoop(Worker &worker);
+  void Drain(Worker &worker);
+  void ExpireLingering(Worker &worker, std::chrono::steady_clock::time_point now);
+  bool Overloaded(Worker &worker);
+  bool RateLimited(const Route &route, const Connection &connection);
+  void StartEviction();
+  void EvictLoop();
+  void SlowDumpLoop();
+  void SweepSlowRequests(Worker &worker, std::chrono::steady_clock::time_point now,
+                         std::vector<SlowRequest> &out);
+  Coroutine AcceptAndProcess(Worker &worker, int listenerFD);
+  Coroutine Linger(Worker &worker, int connectionFD);
+  Coroutine GetHandler(const Trie &trie, RequestData &data, ReadIterator &iter,
+                       const Route *&route, Status &status);
+  Coroutine ParseRequestLine(const Trie &trie, RequestData &data, ReadIterator &iter,
+                             const Route *&route, Status &status);
+  Coroutine CompressResponse(Worker &worker, const CompressionOptions &options,
+                             const RequestData &request, ResponseData &response);
+  Coroutine WriteResponse(Worker &worker, Connection &connection, const ResponseData &data,
+                          bool keepAlive, std::shared_ptr<std::string> body = nullptr);
+  Coroutine WriteShared(Worker &worker, Connection &connection, const SharedResponse &shared,
+                        bool keepAlive);
+  // Holds the handler itself rather than a pin on the route table, so a
+  // long-lived socket does not keep replaced tables alive.
+  Coroutine ServeWebSocket(Worker &worker, Connection &connection, ReadIterator &iterator,
+                           const RequestData &request,
+                           std::shared_ptr<const WebSocketHandler> handler);
+  Coroutine ServeForm(Worker &worker, Connection &connection, ReadIterator &iterator,
+                      const RequestData &request, ResponseData &response, const FormRoute &form,
+                      Status &status);
+  Coroutine ServeStream(Worker &worker, Connection &connection, RequestData &request,
+                        std::string_view target, Http2Response &result);
+  Coroutine ServeHttp2(Worker &worker, int connectionFD, ReadIterator &iterator,
+                       Connection &connection, std::string_view settings = {},
+                       Http2Response *upgraded = nullptr);
+  Coroutine Process(Worker &worker, int connectionFD, const sockaddr_storage &peer);
   friend class ServerBuilder;
 
 public:
+  // Routes an origin-form target, path and query, as HTTP/2 streams do.
+  static const Route *FindRoute(const Trie &trie, RequestData &data, std::string_view target,
+                                Status &status);
   Server() = default;
   ~Server();
   Server(Server &&rhs);
   void Start();
+  void Shutdown(std::chrono::steady_clock::time_point deadline);
+  void HandOff(std::string_view path);
+  // In prefork mode, the sums over every worker process.
+  const Stats &GetStats() const;
+  // The worker processes' ids in prefork mode, -1 for one being replaced.
+  std::vector<pid_t> WorkerProcesses();
+  void DumpTrace(std::ostream &out);
+  // Writes the requests in flight for longer than the SetSlowRequests
+  // threshold, with the await each one is suspended in.
+  void DumpSlowRequests(std::ostream &out);
+  void ReopenAccessLog();
+  // Swaps in a new route table. Requests already past routing finish on the
+  // table they started with; the old table is destroyed once none remain.
+  // Worker processes hold copies made when they were forked, so once a
+  // prefork server has started this throws std::runtime_error.
+  void PublishRoutes(std::unique_ptr<RouteTable> routes);
 };
+// Appends the status line and headers WriteResponse sends, and data.body.
+// bodySize is the length of the body; dateBlock the Date and Server lines.
+void SerializeResponse(std::string &text, const ResponseData &data, std::size_t bodySize,
+                       bool keepAlive, std::string_view dateBlock);
+template <typename... Middleware> class RouteGroup;
 class ServerBuilder {
 private:
   Server server_;
+  std::unique_ptr<RouteTable> routes_ = std::make_unique<RouteTable>();
+
+  void AddRoute(Method method, std::string_view path, HTTP::Route route,
+                const RouteOptions &options);
 
 public:
   void SetThreads(int numThreads);
+  // Forks worker processes once the listeners are bound, each with its own
+  // SO_REUSEPORT listeners, threads and rings, and supervises them. Start
+  // must then be called before the program starts threads of its own.
+  void SetPrefork(PreforkOptions options);
   void SetPort(int port);
-  void AddRequest(Method method, std::string_view path, RespondType respond);
+  void AddListener(Listener listener);
+  void SetSocketProfile(SocketProfile profile);
+  void InheritListener(std::string_view path);
+  void SetMaxConnections(std::size_t perWorker);
+  void SetMaxInFlight(std::size_t perWorker);
+  void SetShedding(std::chrono::steady_clock::duration target,
+                   std::chrono::steady_clock::duration interval);
+  void SetRateLimit(RateLimit limit);
+  void SetOffloadThreads(int numThreads);
+  void SetMaxWebSocketMessage(std::size_t bytes);
+  void SetMaxHeaderSize(std::size_t bytes);
+  void SetMaxBodySize(std::size_t bytes);
+  void SetArenaSize(std::size_t bytes);
+  void SetTracing(double sampleRate, std::size_t eventsPerWorker = 1 << 16);
+  void SetAccessLog(AccessLogOptions options);
+  // Records a sample of connections' raw requests for benchmarks/replay.
+  void SetCapture(CaptureOptions options);
+  // Tracks where each HTTP/1.1 request is suspended so that slow ones can be
+  // reported by Server::DumpSlowRequests, on SIGUSR1, or by an admin route.
+  void SetSlowRequests(SlowRequestOptions options = {});
+  // A GET route answering with the slow-request report as text. Enables
+  // tracking with default options if SetSlowRequests was not called.
+  void AddSlowRequestReport(std::string_view path, RouteOptions options = {});
+  void AddRequest(Method method, std::string_view path, RespondType respond,
+                  RouteOptions options = {});
+  void AddStatic(std::string_view path, ResponseData response, RouteOptions options = {});
+  // A route whose handler is a coroutine, so it can await file I/O on the
+  // worker's ring instead of blocking the worker.
+  void AddAsync(Method method, std::string_view path, AsyncHandler handler,
+                RouteOptions options = {});
+  // Sizes the per-worker pool of buffers registered for HandlerContext::files.
+  void SetFileIO(FileIOOptions options);
+  void AddWebSocket(std::string_view path, WebSocketHandler handler, RouteOptions options = {});
+  void AddProxy(std::string_view prefix, std::vector<Upstream> upstreams,
+                ProxyOptions options = {});
+  // A route whose handler reads an urlencoded or multipart body as it
+  // arrives instead of receiving it in RequestData::body.
+  void AddForm(Method method, std::string_view path, FormHandler handler,
+               FormOptions formOptions = {}, RouteOptions options = {});
+  template <Method M, FixedString Path, typename Handler>
+  void Route(Handler handler, RouteOptions options = {}) {
+    using Template = RouteTemplate<Path>;
+    HTTP::Route route;
+    route.handler = std::make_shared<const Handler>(std::move(handler));
+    route.typed = [](const void *respond, const RequestData &request) {
+      return InvokeTyped<Handler, Template>(respond, request,
+                                            std::make_index_sequence<Template::captureCount>{});
+    };
+    route.matches = [](const RequestData &request) {
+      return MatchTyped<Template>(request, std::make_index_sequence<Template::captureCount>{});
+    };
+    AddRoute(M, Template::Pattern(), std::move(route), options);
+  }
+  // Routes added through the returned group run inside the middleware chain;
+  // routes added on the builder directly do not.
+  template <typename... Middleware> RouteGroup<Middleware...> With(Middleware... middleware) {
+    return RouteGroup<Middleware...>(*this, Chain<Middleware...>(std::move(middleware)...));
+  }
+  // Hands over the routes added so far as a table for Server::PublishRoutes
+  // and starts a new, empty one. The builder's other settings are ignored.
+  std::unique_ptr<RouteTable> BuildRoutes();
   Server Build();
 };
+template <typename... Middleware> class RouteGroup {
+  ServerBuilder &builder_;
+  Chain<Middleware...> chain_;
+
+public:
+  RouteGroup(ServerBuilder &builder, Chain<Middleware...> chain)
+      : builder_(builder), chain_(std::move(chain)) {}
+
+  template <typename... More> RouteGroup<Middleware..., More...> With(More... more) const {
+    return RouteGroup<Middleware..., More...>(builder_, chain_.With(std::move(more)...));
+  }
+  template <typename Respond>
+  void AddRequest(Method method, std::string_view path, Respond respond,
+                  RouteOptions options = {}) {
+    builder_.AddRequest(method, path, chain_.Wrap(std::move(respond)), std::move(options));
+  }
+  template <Method M, FixedString Path, typename Handler>
+  void Route(Handler handler, RouteOptions options = {}) {
+    builder_.Route<M, Path>(chain_.Wrap(std::move(handler)), std::move(options));
+  }
+};
 }
@@ -0,0 +1,87 @@
+#include "slow_requests.h"
+#include <algorithm>
+#include <future>
+#include <memory>
+namespace HTTP {
+std::atomic<unsigned> SlowRequestMonitor::signalGeneration_{0};
+
+std::string_view AwaitName(AwaitPoint point) {
+  constexpr std::string_view names[] = {"idle", "read", "handler", "offload", "upstream", "write"};
+  return names[point];
+}
+
+void SlowRequestMonitor::Register(Worker &worker) {
+  std::lock_guard lock(mutex_);
+  workers_.push_back(&worker);
+}
+
+void SlowRequestMonitor::Unregister(Worker &worker) {
+  std::lock_guard lock(mutex_);
+  std::erase(workers_, &worker);
+}
+
+void SlowRequestMonitor::Report(std::ostream &out) {
+  using Clock = std::chrono::steady_clock;
+  auto now = Clock::now();
+  std::vector<SlowRequest> slow;
+  std::vector<std::pair<std::uint32_t, std::future<std::vector<SlowRequest>>>> pending;
+  std::vector<std::pair<std::uint32_t, std::int64_t>> handlers;
+  {
+    std::lock_guard lock(mutex_);
+    for (Worker *worker : workers_) {
+      if (worker->ring == IOUring::Current()) {
+        worker->sweep(now, slow);
+        continue;
+      }
+      auto promise = std::make_shared<std::promise<std::vector<SlowRequest>>>();
+      pending.emplace_back(worker->index, promise->get_future());
+      handlers.emplace_back(worker->index,
+                            worker->handlerSince.load(std::memory_order_relaxed));
+      worker->ring->Post([worker, promise, now] {
+        std::vector<SlowRequest> found;
+        worker->sweep(now, found);
+        promise->set_value(std::move(found));
+      });
+    }
+  }
+  auto deadline = now + std::chrono::seconds(1);
+  std::vector<std::pair<std::uint32_t, std::int64_t>> unresponsive;
+  for (std::size_t i = 0; i < pending.size(); ++i) {
+    auto &future = pending[i].second;
+    if (future.wait_until(deadline) == std::future_status::ready) {
+      try {
+        auto found = future.get();
+        slow.insert(slow.end(), std::make_move_iterator(found.begin()),
+                    std::make_move_iterator(found.end()));
+        continue;
+      } catch (const std::future_error &) {
+        // The worker exited before it got to the sweep.
+        continue;
+      }
+    }
+    unresponsive.push_back(handlers[i]);
+  }
+
+  std::sort(slow.begin(), slow.end(),
+            [](const SlowRequest &a, const SlowRequest &b) { return a.age > b.age; });
+  auto milliseconds = [](Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+  };
+  out << slow.size() << " requests over " << options_.threshold.count() << " ms\n";
+  for (const SlowRequest &request : slow) {
+    out << "worker " << request.worker << " fd " << request.fd << ' '
+        << MethodName(request.method) << ' ' << (request.path.empty() ? "-" : request.path)
+        << ' ' << milliseconds(request.age) << " ms in " << AwaitName(request.await)
+        << " read " << request.bytesRead << " written " << request.bytesWritten << '\n';
+  }
+  for (auto [index, since] : unresponsive) {
+    out << "worker " << index << " did not answer";
+    if (since != 0) {
+      out << "; in a handler for "
+          << milliseconds(Clock::now() - Clock::time_point(Clock::duration(since))) << " ms";
+    }
+    out << '\n';
+  }
+  out.flush();
+}
+} // namespace HTTP
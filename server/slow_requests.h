@@ -0,0 +1,93 @@
+#pragma once
+#include "io_uring.h"
+#include "request_data.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+namespace HTTP {
+class ReadIterator;
+
+// What an HTTP/1.1 request is suspended in, or running.
+enum AwaitPoint : std::uint8_t {
+  AWAIT_IDLE,
+  AWAIT_READ,
+  AWAIT_HANDLER,
+  AWAIT_OFFLOAD,
+  AWAIT_UPSTREAM,
+  AWAIT_WRITE,
+};
+std::string_view AwaitName(AwaitPoint point);
+
+// The request in progress on a connection. Only the connection's worker
+// reads or writes it, so the request path pays plain stores and nothing else.
+struct RequestProbe {
+  AwaitPoint await{AWAIT_IDLE};
+  std::chrono::steady_clock::time_point started{};
+  // Null between requests and on HTTP/2 and WebSocket connections.
+  const RequestData *request{nullptr};
+  const ReadIterator *iterator{nullptr};
+  std::uint64_t readBase{0};
+  std::uint64_t written{0};
+};
+
+struct SlowRequest {
+  std::uint32_t worker;
+  int fd;
+  Method method;
+  std::string path;
+  AwaitPoint await;
+  std::chrono::steady_clock::duration age;
+  std::uint64_t bytesRead;
+  std::uint64_t bytesWritten;
+};
+
+struct SlowRequestOptions {
+  // Requests in flight for longer than this are reported.
+  std::chrono::milliseconds threshold{1000};
+  // Write a report to stderr on SIGUSR1.
+  bool dumpOnSignal{true};
+};
+
+// Collects reports of slow requests from every worker. Each worker sweeps
+// its own connections on its own thread, between completions, when a report
+// is asked for; nothing runs while no one asks. A worker blocked in a
+// synchronous handler cannot sweep, so it is reported from the time it
+// entered the handler instead.
+class SlowRequestMonitor {
+public:
+  using Sweep = std::function<void(std::chrono::steady_clock::time_point now,
+                                   std::vector<SlowRequest> &out)>;
+  struct Worker {
+    std::uint32_t index{0};
+    IOUring *ring{nullptr};
+    Sweep sweep;
+    // steady_clock ticks when the running synchronous handler started, or 0.
+    std::atomic<std::int64_t> handlerSince{0};
+  };
+
+private:
+  SlowRequestOptions options_;
+  std::mutex mutex_;
+  std::vector<Worker *> workers_;
+  static std::atomic<unsigned> signalGeneration_;
+
+public:
+  explicit SlowRequestMonitor(SlowRequestOptions options) : options_(options) {}
+  const SlowRequestOptions &Options() const { return options_; }
+  void Register(Worker &worker);
+  void Unregister(Worker &worker);
+  // Writes one line per slow request, and one per worker that did not
+  // answer within a second. May be called from a worker thread, e.g. by an
+  // admin route: that worker sweeps inline.
+  void Report(std::ostream &out);
+  // Async-signal-safe; see Server::Start.
+  static void RequestDump() { signalGeneration_.fetch_add(1, std::memory_order_relaxed); }
+  static unsigned DumpGeneration() { return signalGeneration_.load(std::memory_order_relaxed); }
+};
+} // namespace HTTP
@@ -0,0 +1,18 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+namespace HTTP {
+// In prefork mode each process has its own copy in SharedStats; a new
+// counter must also be listed in prefork.cpp.
+struct Stats {
+  std::atomic<std::uint64_t> shedConnections{0};
+  std::atomic<std::uint64_t> shedRequests{0};
+  std::atomic<std::uint64_t> rateLimited{0};
+  std::atomic<std::uint64_t> droppedLogRecords{0};
+  std::atomic<std::uint64_t> droppedCaptureRecords{0};
+  // Requests answered with the response of an identical one in flight.
+  std::atomic<std::uint64_t> coalescedRequests{0};
+  // Worker processes the prefork supervisor replaced after they exited.
+  std::atomic<std::uint64_t> processRestarts{0};
+};
+} // namespace HTTP
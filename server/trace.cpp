@@ -0,0 +1,171 @@
+#include "trace.h"
+#include "io_uring.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <optional>
+
+namespace HTTP {
+
+namespace {
+struct Phase {
+  const char *name;
+  TraceEvent begin;
+  TraceEvent end;
+};
+
+constexpr Phase kPhases[] = {
+    {"connect", TRACE_ACCEPT, TRACE_REQUEST_BEGIN},
+    {"read wait", TRACE_REQUEST_BEGIN, TRACE_FIRST_BYTE},
+    {"parse", TRACE_FIRST_BYTE, TRACE_PARSE_DONE},
+    {"handler", TRACE_HANDLER_START, TRACE_HANDLER_END},
+    {"respond", TRACE_HANDLER_END, TRACE_RESPONSE_DONE},
+};
+
+const char *OpName(std::uint8_t op) {
+  switch (op) {
+  case IOUring::ACCEPT:
+    return "accept";
+  case IOUring::READ:
+    return "read";
+  case IOUring::WRITE:
+    return "write";
+  case IOUring::CANCEL:
+    return "cancel";
+  case IOUring::CONNECT:
+    return "connect";
+  case IOUring::SPLICE:
+    return "splice";
+  default:
+    return "io";
+  }
+}
+
+struct Operation {
+  std::uint8_t op{0};
+  std::optional<std::uint64_t> enqueued;
+  std::optional<std::uint64_t> submitted;
+  std::optional<std::uint64_t> completed;
+};
+
+struct RequestTrace {
+  std::array<std::optional<std::uint64_t>, TRACE_RESPONSE_DONE + 1> marks;
+  std::map<std::uint32_t, Operation> operations;
+};
+
+void WriteEvent(std::ostream &out, bool &first, const char *name, char phase,
+                std::uint64_t id, std::size_t worker, double timestamp) {
+  out << (first ? "\n" : ",\n");
+  first = false;
+  out << R"({"name":")" << name << R"(","cat":"request","ph":")" << phase
+      << R"(","id":")" << std::hex << "0x" << id << std::dec << R"(","pid":1,"tid":)" << worker
+      << R"(,"ts":)" << timestamp << '}';
+}
+
+void WriteSpan(std::ostream &out, bool &first, const char *name, std::uint64_t id,
+               std::size_t worker, double begin, double end) {
+  WriteEvent(out, first, name, 'b', id, worker, begin);
+  WriteEvent(out, first, name, 'e', id, worker, end);
+}
+} // namespace
+
+void Tracer::Configure(double sampleRate, std::size_t capacity) {
+  period_ = sampleRate > 0 ? static_cast<std::uint32_t>(std::lround(1.0 / std::min(sampleRate, 1.0)))
+                           : 0;
+  countdown_ = period_;
+  records_.assign(period_ != 0 ? capacity : 0, TraceRecord{});
+  next_ = 0;
+  wrapped_ = false;
+  startTicks_ = Now();
+  startTime_ = std::chrono::steady_clock::now();
+}
+
+void Tracer::Append(std::uint32_t request, TraceEvent event, std::uint64_t ticks,
+                    std::uint32_t sequence, std::uint8_t op) {
+  if (records_.empty()) {
+    return;
+  }
+  records_[next_] = TraceRecord{ticks, request, sequence, event, op};
+  if (++next_ == records_.size()) {
+    next_ = 0;
+    wrapped_ = true;
+  }
+}
+
+// Calibrates ticks against the steady clock over the whole recording window,
+// so the TSC frequency never has to be known up front.
+Tracer::Snapshot Tracer::Take() const {
+  Snapshot snapshot;
+  if (wrapped_) {
+    snapshot.records.assign(records_.begin() + next_, records_.end());
+  }
+  snapshot.records.insert(snapshot.records.end(), records_.begin(), records_.begin() + next_);
+  std::uint64_t ticks = Now();
+  auto now = std::chrono::steady_clock::now();
+  double elapsed = std::chrono::duration<double, std::micro>(now - startTime_).count();
+  snapshot.startTicks = startTicks_;
+  snapshot.ticksPerMicrosecond = elapsed > 0 ? (ticks - startTicks_) / elapsed : 1.0;
+  snapshot.startMicroseconds =
+      std::chrono::duration<double, std::micro>(startTime_.time_since_epoch()).count();
+  return snapshot;
+}
+
+void WriteChromeTrace(std::ostream &out, const std::vector<Tracer::Snapshot> &workers) {
+  out << R"({"displayTimeUnit":"ns","traceEvents":[)";
+  out.precision(3);
+  out << std::fixed;
+  bool first = true;
+  for (std::size_t worker = 0; worker < workers.size(); ++worker) {
+    const auto &snapshot = workers[worker];
+    auto micros = [&](std::uint64_t ticks) {
+      return snapshot.startMicroseconds +
+             static_cast<double>(static_cast<std::int64_t>(ticks - snapshot.startTicks)) /
+                 snapshot.ticksPerMicrosecond;
+    };
+    std::map<std::uint32_t, RequestTrace> requests;
+    for (const auto &record : snapshot.records) {
+      auto &request = requests[record.request];
+      if (record.event <= TRACE_RESPONSE_DONE) {
+        request.marks[record.event] = record.ticks;
+        continue;
+      }
+      auto &operation = request.operations[record.sequence];
+      operation.op = record.op;
+      if (record.event == TRACE_ENQUEUE) {
+        operation.enqueued = record.ticks;
+      } else if (record.event == TRACE_SUBMIT) {
+        operation.submitted = record.ticks;
+      } else {
+        operation.completed = record.ticks;
+      }
+    }
+    for (const auto &[number, request] : requests) {
+      std::uint64_t id = (static_cast<std::uint64_t>(worker) << 32) | number;
+      const auto &begin = request.marks[TRACE_REQUEST_BEGIN];
+      const auto &end = request.marks[TRACE_RESPONSE_DONE];
+      if (begin && end) {
+        WriteSpan(out, first, "request", id, worker, micros(*begin), micros(*end));
+      }
+      for (const auto &phase : kPhases) {
+        const auto &from = request.marks[phase.begin];
+        const auto &to = request.marks[phase.end];
+        if (from && to) {
+          WriteSpan(out, first, phase.name, id, worker, micros(*from), micros(*to));
+        }
+      }
+      for (const auto &[sequence, operation] : request.operations) {
+        if (operation.enqueued && operation.submitted) {
+          WriteSpan(out, first, "queued", id, worker, micros(*operation.enqueued),
+                    micros(*operation.submitted));
+        }
+        if (operation.submitted && operation.completed) {
+          WriteSpan(out, first, OpName(operation.op), id, worker, micros(*operation.submitted),
+                    micros(*operation.completed));
+        }
+      }
+    }
+  }
+  out << "\n]}\n";
+}
+} // namespace HTTP
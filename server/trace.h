@@ -0,0 +1,103 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+namespace HTTP {
+enum TraceEvent : std::uint8_t {
+  TRACE_ACCEPT,
+  TRACE_REQUEST_BEGIN,
+  TRACE_FIRST_BYTE,
+  TRACE_PARSE_DONE,
+  TRACE_HANDLER_START,
+  TRACE_HANDLER_END,
+  TRACE_RESPONSE_DONE,
+  TRACE_ENQUEUE,
+  TRACE_SUBMIT,
+  TRACE_COMPLETE,
+};
+
+struct TraceRecord {
+  std::uint64_t ticks;
+  std::uint32_t request;
+  std::uint32_t sequence;
+  TraceEvent event;
+  std::uint8_t op;
+};
+
+// Per-worker ring buffer of timestamped events for sampled requests. Only the
+// owning worker thread writes to it; request id 0 means "not sampled" and
+// every Record() call for it returns after a single branch.
+class Tracer {
+public:
+  struct Snapshot {
+    std::vector<TraceRecord> records;
+    std::uint64_t startTicks;
+    double ticksPerMicrosecond;
+    double startMicroseconds;
+  };
+
+private:
+  std::vector<TraceRecord> records_;
+  std::size_t next_{0};
+  bool wrapped_{false};
+  std::uint32_t period_{0};
+  std::uint32_t countdown_{0};
+  std::uint32_t lastRequest_{0};
+  std::uint32_t lastSequence_{0};
+  std::uint64_t startTicks_{0};
+  std::chrono::steady_clock::time_point startTime_{};
+
+  void Append(std::uint32_t request, TraceEvent event, std::uint64_t ticks,
+              std::uint32_t sequence, std::uint8_t op);
+
+public:
+  static std::uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+#endif
+  }
+
+  void Configure(double sampleRate, std::size_t capacity);
+  bool Enabled() const { return period_ != 0; }
+
+  std::uint32_t Sample() {
+    if (period_ == 0 || --countdown_ != 0) {
+      return 0;
+    }
+    countdown_ = period_;
+    if (++lastRequest_ == 0) {
+      ++lastRequest_;
+    }
+    return lastRequest_;
+  }
+
+  std::uint32_t NextSequence() { return ++lastSequence_; }
+
+  void Record(std::uint32_t request, TraceEvent event) {
+    if (request != 0) {
+      Append(request, event, Now(), 0, 0);
+    }
+  }
+
+  void Record(std::uint32_t request, TraceEvent event, std::uint64_t ticks,
+              std::uint32_t sequence = 0, std::uint8_t op = 0) {
+    if (request != 0) {
+      Append(request, event, ticks, sequence, op);
+    }
+  }
+
+  Snapshot Take() const;
+};
+
+// Writes the snapshots (one per worker) as Chrome trace / Perfetto JSON, with
+// one async track per sampled request.
+void WriteChromeTrace(std::ostream &out, const std::vector<Tracer::Snapshot> &workers);
+} // namespace HTTP
@@ -1,5 +1,4 @@
 #include "trie.h"
-#include "http_error.h"
 #include "request_data.h"
 namespace HTTP {
 Trie::Node &Trie::Node::Move(char c) {
@@ -12,22 +11,29 @@ Trie::Node &Trie::Node::Move(char c) {
   }
   return *children[c];
 }
-const Trie::Node &Trie::Node::Move(char c) const {
-  try {
-    return *children.at(c);
-  } catch (...) {
-    throw HTTPError(404, "Not found");
-  }
+const Trie::Node *Trie::Node::Child(char c) const {
+  auto child = children.find(c);
+  return child == children.end() ? nullptr : child->second.get();
 }
-void Trie::AddRequest(Method method, RespondType respond,
-                      std::string_view path) {
+void Trie::AddRequest(Method method, Route route, std::string_view path) {
   Node *current = root_.get();
   for (auto c : path) {
     current = &current->Move(c);
   }
-  current->handlers[method] = respond;
+  current->handlers[method] = std::move(route);
+  current->allow.clear();
+  for (int candidate = GET; candidate <= DELETE; ++candidate) {
+    if (current->handlers[candidate]) {
+      if (!current->allow.empty()) {
+        current->allow += ", ";
+      }
+      current->allow += MethodName(static_cast<Method>(candidate));
+    }
+  }
+  current->notAllowed.emplace(405, "Method Not Allowed", "Method not allowed",
+                              "Allow: " + current->allow + "\r\n");
 }
-const Trie::Node &Trie::GetRoot() { return *root_; }
+const Trie::Node &Trie::GetRoot() const { return *root_; }
 Trie::Trie(Trie &&rhs) { root_ = std::move(rhs.root_); }
 Trie &Trie::operator=(Trie &&rhs) {
   root_ = std::move(rhs.root_);
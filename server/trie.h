@@ -1,19 +1,25 @@
 #pragma once
+#include "http_error.h"
 #include "request_data.h"
-#include <functional>
+#include "route.h"
 #include <memory>
 #include <optional>
+#include <string>
 #include <unordered_map>
 namespace HTTP {
-using RespondType = std::function<ResponseData(const RequestData &)>;
 class Trie {
   struct Node {
     std::unordered_map<char, std::unique_ptr<Node>> children;
-    std::optional<RespondType> handlers[5];
+    std::optional<Route> handlers[5];
     Node() = default;
     bool any = false;
+    // Methods with a handler here, for the Allow header of a 405, and the
+    // 405 itself, rebuilt whenever a handler is added.
+    std::string allow;
+    std::optional<CannedResponse> notAllowed;
     Node &Move(char c);
-    const Node &Move(char c) const;
+    // The child for c, or nullptr when no route continues with it.
+    const Node *Child(char c) const;
   };
   std::unique_ptr<Node> root_ = std::make_unique<Node>();
 
@@ -21,7 +27,7 @@ public:
   Trie() = default;
   Trie(Trie &&rhs);
   Trie &operator=(Trie &&rhs);
-  const Node &GetRoot();
-  void AddRequest(Method type, RespondType function, std::string_view path);
+  const Node &GetRoot() const;
+  void AddRequest(Method type, Route route, std::string_view path);
 };
 } // namespace HTTP
@@ -0,0 +1,176 @@
+#pragma once
+#include "request_data.h"
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+namespace HTTP {
+template <std::size_t N> struct FixedString {
+  char data[N]{};
+
+  consteval FixedString(const char (&text)[N]) {
+    for (std::size_t i = 0; i < N; ++i) {
+      data[i] = text[i];
+    }
+  }
+  constexpr std::string_view View() const { return {data, N - 1}; }
+};
+
+enum class CaptureType { STRING, U64, I64, U32, I32 };
+
+template <CaptureType T> struct CaptureValue;
+template <> struct CaptureValue<CaptureType::STRING> { using type = std::string_view; };
+template <> struct CaptureValue<CaptureType::U64> { using type = std::uint64_t; };
+template <> struct CaptureValue<CaptureType::I64> { using type = std::int64_t; };
+template <> struct CaptureValue<CaptureType::U32> { using type = std::uint32_t; };
+template <> struct CaptureValue<CaptureType::I32> { using type = std::int32_t; };
+
+namespace detail {
+constexpr bool nameChar(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+constexpr CaptureType captureType(std::string_view name) {
+  if (name.empty() || name == "str") {
+    return CaptureType::STRING;
+  }
+  if (name == "u64") {
+    return CaptureType::U64;
+  }
+  if (name == "i64") {
+    return CaptureType::I64;
+  }
+  if (name == "u32") {
+    return CaptureType::U32;
+  }
+  if (name == "i32") {
+    return CaptureType::I32;
+  }
+  throw "route template: unknown capture type (expected str, u64, i64, u32 or i32)";
+}
+
+// Walks the template once, validating it and reporting each capture's type.
+// It only ever runs during constant evaluation, where a throw is a compile error.
+template <typename OnCapture>
+constexpr std::size_t parseTemplate(std::string_view path, OnCapture onCapture) {
+  if (path.empty() || path[0] != '/') {
+    throw "route template: must start with '/'";
+  }
+  std::size_t count = 0;
+  bool lastWasCapture = false;
+  for (std::size_t i = 0; i < path.size(); ++i) {
+    char c = path[i];
+    if (c == '}' || c == '*' || c == '?' || c == ' ') {
+      throw "route template: unexpected character";
+    }
+    if (c != '{') {
+      lastWasCapture = false;
+      continue;
+    }
+    if (lastWasCapture) {
+      throw "route template: captures must be separated by literal text";
+    }
+    auto close = path.find('}', i);
+    if (close == std::string_view::npos) {
+      throw "route template: unterminated capture";
+    }
+    auto body = path.substr(i + 1, close - i - 1);
+    auto colon = body.find(':');
+    auto name = body.substr(0, colon);
+    if (name.empty()) {
+      throw "route template: capture needs a name";
+    }
+    for (char n : name) {
+      if (!nameChar(n)) {
+        throw "route template: capture names are [A-Za-z0-9_]";
+      }
+    }
+    onCapture(count++, captureType(colon == std::string_view::npos ? std::string_view{}
+                                                                    : body.substr(colon + 1)));
+    lastWasCapture = true;
+    i = close;
+  }
+  return count;
+}
+
+consteval std::size_t countCaptures(std::string_view path) {
+  return parseTemplate(path, [](std::size_t, CaptureType) {});
+}
+} // namespace detail
+
+template <FixedString Path> struct RouteTemplate {
+  static constexpr std::size_t captureCount = detail::countCaptures(Path.View());
+
+  static constexpr std::array<CaptureType, captureCount> types = [] {
+    std::array<CaptureType, captureCount> result{};
+    detail::parseTemplate(Path.View(),
+                          [&](std::size_t index, CaptureType type) { result[index] = type; });
+    return result;
+  }();
+
+  // The trie only knows '*' wildcards, so every capture collapses to one.
+  static constexpr auto pattern = [] {
+    std::array<char, Path.View().size() + 1> result{};
+    std::size_t length = 0;
+    auto path = Path.View();
+    for (std::size_t i = 0; i < path.size(); ++i) {
+      if (path[i] == '{') {
+        result[length++] = '*';
+        i = path.find('}', i);
+      } else {
+        result[length++] = path[i];
+      }
+    }
+    return std::pair{result, length};
+  }();
+
+  static constexpr std::string_view Pattern() { return {pattern.first.data(), pattern.second}; }
+};
+
+// Whether text converts to a capture of type T. A path whose captures do not
+// is routed as not found, before the handler runs.
+template <CaptureType T> bool CaptureMatches(std::string_view text) {
+  if constexpr (T == CaptureType::STRING) {
+    return true;
+  } else {
+    typename CaptureValue<T>::type value{};
+    auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return !text.empty() && error == std::errc() && end == text.data() + text.size();
+  }
+}
+
+// Converts a capture that CaptureMatches accepted.
+template <CaptureType T>
+typename CaptureValue<T>::type ConvertCapture(std::string_view text) {
+  if constexpr (T == CaptureType::STRING) {
+    return text;
+  } else {
+    typename CaptureValue<T>::type value{};
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+  }
+}
+
+template <typename Template, std::size_t... I>
+bool MatchTyped(const RequestData &request, std::index_sequence<I...>) {
+  return (CaptureMatches<Template::types[I]>(request.Capture(I)) && ...);
+}
+
+template <typename Handler, typename Template, std::size_t... I>
+ResponseData InvokeTyped(const void *handler, const RequestData &request,
+                         std::index_sequence<I...>) {
+  const auto &respond = *static_cast<const Handler *>(handler);
+  if constexpr (std::is_invocable_r_v<ResponseData, const Handler &, const RequestData &,
+                                      typename CaptureValue<Template::types[I]>::type...>) {
+    return respond(request, ConvertCapture<Template::types[I]>(request.Capture(I))...);
+  } else {
+    static_assert(std::is_invocable_r_v<ResponseData, const Handler &,
+                                        typename CaptureValue<Template::types[I]>::type...>,
+                  "handler must accept the route's captures, optionally after the request");
+    return respond(ConvertCapture<Template::types[I]>(request.Capture(I))...);
+  }
+}
+} // namespace HTTP
@@ -0,0 +1,424 @@
+#include "websocket.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <sys/socket.h>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+namespace HTTP {
+
+namespace {
+constexpr std::size_t kMaxOutbox = 4 * 1024 * 1024;
+
+static std::array<std::uint8_t, 20> sha1(std::string_view input) {
+  std::uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+  std::string message(input);
+  std::uint64_t bits = static_cast<std::uint64_t>(input.size()) * 8;
+  message.push_back(static_cast<char>(0x80));
+  while (message.size() % 64 != 56) {
+    message.push_back('\0');
+  }
+  for (int i = 7; i >= 0; --i) {
+    message.push_back(static_cast<char>(bits >> (i * 8)));
+  }
+  auto rotl = [](std::uint32_t x, int n) { return (x << n) | (x >> (32 - n)); };
+  for (size_t block = 0; block < message.size(); block += 64) {
+    std::uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      auto *p = reinterpret_cast<const unsigned char *>(message.data() + block + i * 4);
+      w[i] = (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+             (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3]);
+    }
+    for (int i = 16; i < 80; ++i) {
+      w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      std::uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      std::uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = rotl(b, 30);
+      b = a;
+      a = temp;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+  std::array<std::uint8_t, 20> digest;
+  for (int i = 0; i < 5; ++i) {
+    digest[i * 4] = h[i] >> 24;
+    digest[i * 4 + 1] = h[i] >> 16;
+    digest[i * 4 + 2] = h[i] >> 8;
+    digest[i * 4 + 3] = h[i];
+  }
+  return digest;
+}
+
+static std::string base64(const std::uint8_t *data, size_t size) {
+  static constexpr char alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  out.reserve((size + 2) / 3 * 4);
+  for (size_t i = 0; i < size; i += 3) {
+    std::uint32_t chunk = std::uint32_t(data[i]) << 16;
+    if (i + 1 < size) {
+      chunk |= std::uint32_t(data[i + 1]) << 8;
+    }
+    if (i + 2 < size) {
+      chunk |= data[i + 2];
+    }
+    out.push_back(alphabet[(chunk >> 18) & 63]);
+    out.push_back(alphabet[(chunk >> 12) & 63]);
+    out.push_back(i + 1 < size ? alphabet[(chunk >> 6) & 63] : '=');
+    out.push_back(i + 2 < size ? alphabet[chunk & 63] : '=');
+  }
+  return out;
+}
+
+static bool isControl(Opcode opcode) { return static_cast<std::uint8_t>(opcode) & 0x8; }
+} // namespace
+
+std::string WebSocketAccept(std::string_view key) {
+  std::string input(key);
+  input += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  auto digest = sha1(input);
+  return base64(digest.data(), digest.size());
+}
+
+void ApplyMask(char *data, std::size_t size, const std::uint8_t mask[4], std::size_t offset) {
+  std::uint8_t rotated[4];
+  for (int i = 0; i < 4; ++i) {
+    rotated[i] = mask[(offset + i) % 4];
+  }
+  std::uint32_t word;
+  std::memcpy(&word, rotated, sizeof(word));
+  std::size_t i = 0;
+#ifdef __AVX2__
+  __m256i mask256 = _mm256_set1_epi32(static_cast<int>(word));
+  for (; i + 32 <= size; i += 32) {
+    auto *p = reinterpret_cast<__m256i *>(data + i);
+    _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), mask256));
+  }
+#endif
+#ifdef __SSE2__
+  __m128i mask128 = _mm_set1_epi32(static_cast<int>(word));
+  for (; i + 16 <= size; i += 16) {
+    auto *p = reinterpret_cast<__m128i *>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask128));
+  }
+#endif
+  std::uint64_t mask64 = (std::uint64_t(word) << 32) | word;
+  for (; i + 8 <= size; i += 8) {
+    std::uint64_t chunk;
+    std::memcpy(&chunk, data + i, sizeof(chunk));
+    chunk ^= mask64;
+    std::memcpy(data + i, &chunk, sizeof(chunk));
+  }
+  for (; i < size; ++i) {
+    data[i] ^= rotated[i % 4];
+  }
+}
+
+WebSocket::WebSocket(IOUring &ring, ReadIterator &iterator, int fd, std::size_t maxMessage)
+    : ring_(ring), iterator_(iterator), fd_(fd), maxMessage_(maxMessage) {}
+
+std::shared_ptr<std::string> WebSocket::Frame(Opcode opcode, std::string_view payload) {
+  auto frame = std::make_shared<std::string>();
+  frame->reserve(payload.size() + 10);
+  frame->push_back(static_cast<char>(0x80 | static_cast<std::uint8_t>(opcode)));
+  if (payload.size() < 126) {
+    frame->push_back(static_cast<char>(payload.size()));
+  } else if (payload.size() <= 0xFFFF) {
+    frame->push_back(static_cast<char>(126));
+    frame->push_back(static_cast<char>(payload.size() >> 8));
+    frame->push_back(static_cast<char>(payload.size()));
+  } else {
+    frame->push_back(static_cast<char>(127));
+    for (int i = 7; i >= 0; --i) {
+      frame->push_back(static_cast<char>(static_cast<std::uint64_t>(payload.size()) >> (i * 8)));
+    }
+  }
+  frame->append(payload);
+  return frame;
+}
+
+bool WebSocket::WakeAwaiter::await_ready() const noexcept {
+  return socket_.outboxHead_ < socket_.outbox_.size() || socket_.closing_;
+}
+
+void WebSocket::WakeAwaiter::await_suspend(std::coroutine_handle<> h) noexcept {
+  socket_.waiting_ = h;
+}
+
+bool WebSocket::JoinAwaiter::await_ready() const noexcept { return !writer_ || writer_.done(); }
+
+std::coroutine_handle<> WebSocket::JoinAwaiter::await_suspend(std::coroutine_handle<> h) noexcept {
+  writer_.promise().continuation_ = h;
+  if (socket_.waiting_) {
+    auto writer = socket_.waiting_;
+    socket_.waiting_ = {};
+    return writer;
+  }
+  return std::noop_coroutine();
+}
+
+WebSocket::JoinAwaiter WebSocket::Join(Coroutine &writer) {
+  closing_ = true;
+  return JoinAwaiter{*this, writer};
+}
+
+Coroutine WebSocket::Writer() {
+  while (true) {
+    while (outboxHead_ < outbox_.size()) {
+      auto frame = std::move(outbox_[outboxHead_++]);
+      outboxBytes_ -= frame->size();
+      size_t sent = 0;
+      while (!failed_ && sent < frame->size()) {
+        size_t wrote = co_await ring_.WriteAsync(fd_, frame, sent, frame->size() - sent);
+        if (wrote == 0) {
+          failed_ = true;
+        }
+        sent += wrote;
+      }
+    }
+    outbox_.clear();
+    outboxHead_ = 0;
+    if (closing_) {
+      co_return;
+    }
+    co_await WakeAwaiter{*this};
+  }
+}
+
+void WebSocket::Send(std::shared_ptr<std::string> frame) {
+  if (closeSent_ || failed_) {
+    return;
+  }
+  if (outboxBytes_ + frame->size() > kMaxOutbox) {
+    failed_ = true;
+    (void)shutdown(fd_, SHUT_RDWR);
+    return;
+  }
+  outboxBytes_ += frame->size();
+  outbox_.push_back(std::move(frame));
+  if (waiting_) {
+    auto writer = waiting_;
+    waiting_ = {};
+    writer.resume();
+  }
+}
+
+void WebSocket::Send(Opcode opcode, std::string_view payload) {
+  Send(Frame(opcode, payload));
+}
+
+void WebSocket::Close(std::uint16_t code, std::string_view reason) {
+  if (closeSent_) {
+    return;
+  }
+  std::string payload;
+  payload.push_back(static_cast<char>(code >> 8));
+  payload.push_back(static_cast<char>(code));
+  payload.append(reason.substr(0, 123));
+  Send(Opcode::CLOSE, payload);
+  closeSent_ = true;
+}
+
+void WebSocket::Fail(std::uint16_t code) {
+  Close(code);
+  closed_ = true;
+}
+
+bool WebSocket::Closed() const { return closed_; }
+
+IOUring &WebSocket::Ring() const { return ring_; }
+
+Coroutine WebSocket::ReadExact(char *destination, std::size_t size, bool &ok) {
+  ok = true;
+  while (size > 0) {
+    co_await iterator_.Ensure();
+    size_t available = iterator_.Available();
+    if (available == 0) {
+      ok = false;
+      co_return;
+    }
+    size_t take = std::min(available, size);
+    std::memcpy(destination, iterator_.CurrentPtr(), take);
+    iterator_.Advance(take);
+    destination += take;
+    size -= take;
+  }
+  co_return;
+}
+
+Coroutine WebSocket::Read(WebSocketMessage &message) {
+  message.opcode = Opcode::CLOSE;
+  message.data.clear();
+  bool started = false;
+  std::string control;
+  while (!closed_) {
+    std::uint8_t header[2];
+    bool ok;
+    co_await ReadExact(reinterpret_cast<char *>(header), 2, ok);
+    if (!ok) {
+      closed_ = true;
+      co_return;
+    }
+    bool fin = header[0] & 0x80;
+    auto opcode = static_cast<Opcode>(header[0] & 0x0F);
+    std::uint64_t length = header[1] & 0x7F;
+    if ((header[0] & 0x70) || !(header[1] & 0x80)) {
+      Fail(1002);
+      co_return;
+    }
+    if (length >= 126) {
+      std::uint8_t extended[8];
+      size_t bytes = length == 126 ? 2 : 8;
+      co_await ReadExact(reinterpret_cast<char *>(extended), bytes, ok);
+      if (!ok) {
+        closed_ = true;
+        co_return;
+      }
+      length = 0;
+      for (size_t i = 0; i < bytes; ++i) {
+        length = (length << 8) | extended[i];
+      }
+      // RFC 6455 5.2: the most significant bit must be 0, and a length must
+      // use the shortest encoding that holds it.
+      if ((bytes == 8 && (length >> 63) != 0) || (bytes == 2 && length < 126) ||
+          (bytes == 8 && length <= 0xFFFF)) {
+        Fail(1002);
+        co_return;
+      }
+    }
+    std::uint8_t mask[4];
+    co_await ReadExact(reinterpret_cast<char *>(mask), 4, ok);
+    if (!ok) {
+      closed_ = true;
+      co_return;
+    }
+    if (isControl(opcode)) {
+      if (!fin || length > 125) {
+        Fail(1002);
+        co_return;
+      }
+      control.resize(length);
+      co_await ReadExact(control.data(), length, ok);
+      if (!ok) {
+        closed_ = true;
+        co_return;
+      }
+      ApplyMask(control.data(), control.size(), mask, 0);
+      if (opcode == Opcode::PING) {
+        Send(Opcode::PONG, control);
+        continue;
+      }
+      if (opcode == Opcode::PONG) {
+        continue;
+      }
+      if (opcode != Opcode::CLOSE) {
+        Fail(1002);
+        co_return;
+      }
+      std::uint16_t code = control.size() >= 2
+                               ? (std::uint16_t(std::uint8_t(control[0])) << 8) |
+                                     std::uint8_t(control[1])
+                               : 1000;
+      Close(code);
+      closed_ = true;
+      message.opcode = Opcode::CLOSE;
+      message.data = std::move(control);
+      co_return;
+    }
+    if (opcode == Opcode::CONTINUATION ? !started
+                                       : started || (opcode != Opcode::TEXT &&
+                                                     opcode != Opcode::BINARY)) {
+      Fail(1002);
+      co_return;
+    }
+    if (length > maxMessage_ - message.data.size()) {
+      Fail(1009);
+      co_return;
+    }
+    if (!started) {
+      started = true;
+      message.opcode = opcode;
+    }
+    size_t offset = message.data.size();
+    message.data.resize(offset + length);
+    co_await ReadExact(message.data.data() + offset, length, ok);
+    if (!ok) {
+      closed_ = true;
+      message.opcode = Opcode::CLOSE;
+      co_return;
+    }
+    ApplyMask(message.data.data() + offset, length, mask, 0);
+    if (fin) {
+      co_return;
+    }
+  }
+  co_return;
+}
+
+void WebSocketGroup::Join(WebSocket &socket) {
+  std::lock_guard lock(mutex_);
+  members_[&socket.Ring()].push_back(&socket);
+}
+
+void WebSocketGroup::Leave(WebSocket &socket) {
+  std::lock_guard lock(mutex_);
+  auto &members = members_[&socket.Ring()];
+  members.erase(std::remove(members.begin(), members.end(), &socket), members.end());
+}
+
+void WebSocketGroup::Deliver(IOUring &ring, const std::shared_ptr<std::string> &frame) {
+  std::vector<WebSocket *> members;
+  {
+    std::lock_guard lock(mutex_);
+    members = members_[&ring];
+  }
+  for (auto *socket : members) {
+    socket->Send(frame);
+  }
+}
+
+void WebSocketGroup::Broadcast(Opcode opcode, std::string_view payload) {
+  auto frame = WebSocket::Frame(opcode, payload);
+  std::vector<IOUring *> rings;
+  {
+    std::lock_guard lock(mutex_);
+    for (const auto &[ring, members] : members_) {
+      if (!members.empty()) {
+        rings.push_back(ring);
+      }
+    }
+  }
+  for (auto *ring : rings) {
+    if (ring == IOUring::Current()) {
+      Deliver(*ring, frame);
+    } else {
+      ring->Post([this, ring, frame] { Deliver(*ring, frame); });
+    }
+  }
+}
+
+} // namespace HTTP
@@ -0,0 +1,84 @@
+#pragma once
+#include "coroutine.h"
+#include "io_uring.h"
+#include "read_iterator.h"
+#include "request_data.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+namespace HTTP {
+enum class Opcode : std::uint8_t {
+  CONTINUATION = 0x0,
+  TEXT = 0x1,
+  BINARY = 0x2,
+  CLOSE = 0x8,
+  PING = 0x9,
+  PONG = 0xA
+};
+struct WebSocketMessage {
+  Opcode opcode{Opcode::CLOSE};
+  std::string data;
+};
+class WebSocket {
+  IOUring &ring_;
+  ReadIterator &iterator_;
+  int fd_;
+  std::vector<std::shared_ptr<std::string>> outbox_;
+  std::size_t outboxHead_{0};
+  std::size_t outboxBytes_{0};
+  std::coroutine_handle<> waiting_{};
+  bool closing_{false};
+  bool closeSent_{false};
+  bool closed_{false};
+  bool failed_{false};
+  std::size_t maxMessage_;
+
+  struct WakeAwaiter {
+    WebSocket &socket_;
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> h) noexcept;
+    void await_resume() const noexcept {}
+  };
+  struct JoinAwaiter {
+    WebSocket &socket_;
+    Coroutine &writer_;
+    bool await_ready() const noexcept;
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> h) noexcept;
+    void await_resume() const noexcept {}
+  };
+
+  Coroutine ReadExact(char *destination, std::size_t size, bool &ok);
+  void Fail(std::uint16_t code);
+
+public:
+  WebSocket(IOUring &ring, ReadIterator &iterator, int fd, std::size_t maxMessage);
+  Coroutine Writer();
+  JoinAwaiter Join(Coroutine &writer);
+  Coroutine Read(WebSocketMessage &message);
+  void Send(Opcode opcode, std::string_view payload);
+  void Send(std::shared_ptr<std::string> frame);
+  void Close(std::uint16_t code = 1000, std::string_view reason = {});
+  bool Closed() const;
+  IOUring &Ring() const;
+  static std::shared_ptr<std::string> Frame(Opcode opcode, std::string_view payload);
+};
+using WebSocketHandler = std::function<Coroutine(WebSocket &, const RequestData &)>;
+class WebSocketGroup {
+  std::mutex mutex_;
+  std::unordered_map<IOUring *, std::vector<WebSocket *>> members_;
+
+  void Deliver(IOUring &ring, const std::shared_ptr<std::string> &frame);
+
+public:
+  void Join(WebSocket &socket);
+  void Leave(WebSocket &socket);
+  void Broadcast(Opcode opcode, std::string_view payload);
+};
+std::string WebSocketAccept(std::string_view key);
+void ApplyMask(char *data, std::size_t size, const std::uint8_t mask[4], std::size_t offset);
+} // namespace HTTP